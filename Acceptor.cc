@@ -19,6 +19,7 @@ static int createNonblocking()
                                             __LINE__, 
                                             errno);
     }
+    return sockfd;
 }
 
 Acceptor::Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reuseport)
@@ -26,6 +27,8 @@ Acceptor::Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reusepor
       acceptSocket_(createNonblocking()),
       accpetChannel_(loop, acceptSocket_.fd()),
       listenning_(false),
+      maxAccepts_(kDefaultMaxAccepts),
+      completion_(false),
       idleFd_(::open("/dev/null", O_RDONLY | O_CLOEXEC))
 {
     acceptSocket_.setReuseAddr(true);
@@ -35,6 +38,19 @@ Acceptor::Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reusepor
         std::bind(&Acceptor::handleRead, this));
 }
 
+Acceptor::Acceptor(EventLoop *loop, int listenfd)
+    : loop_(loop),
+      acceptSocket_(listenfd),
+      accpetChannel_(loop, listenfd),
+      listenning_(false),
+      maxAccepts_(kDefaultMaxAccepts),
+      completion_(false),
+      idleFd_(::open("/dev/null", O_RDONLY | O_CLOEXEC))
+{
+    accpetChannel_.setReadCallback(
+        std::bind(&Acceptor::handleRead, this));
+}
+
 Acceptor::~Acceptor()
 {
     accpetChannel_.disableAll();
@@ -47,30 +63,74 @@ void Acceptor::listen()
     listenning_ = true;
     // Socket封装了监听的fd，实现了相应的控制
     acceptSocket_.listen();
+    if(completion_ && loop_->supportsCompletion())
+    {
+        accpetChannel_.enableCompletion(true);
+    }
     accpetChannel_.enableReading();
 }
 
+int Acceptor::acceptOne(InetAddress *peerAddr)
+{
+    if(!accpetChannel_.completion())
+    {
+        return acceptSocket_.accept(peerAddr);
+    }
+    int savedErrno = 0;
+    int connfd = loop_->takeAccepted(&accpetChannel_, &savedErrno);
+    if(connfd < 0)
+    {
+        errno = savedErrno;
+        return -1;
+    }
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    if(::getpeername(connfd, (struct sockaddr*)&addr, &len) == 0)
+    {
+        peerAddr->setSockAddr(addr);
+    }
+    return connfd;
+}
+
+// drain the backlog, but give the other channels a turn after maxAccepts_
 void Acceptor::handleRead()
 {
-    InetAddress peerAddr(0, "127.0.0.1");
-    int connfd = acceptSocket_.accept(&peerAddr);
-    if(connfd >= 0)
+    for(int i = 0; i < maxAccepts_; ++i)
     {
-        if(newConnectionCallback_)
+        InetAddress peerAddr(0, "127.0.0.1");
+        int connfd = acceptOne(&peerAddr);
+        if(connfd >= 0)
         {
-            newConnectionCallback_(connfd, peerAddr);
+            if(newConnectionCallback_)
+            {
+                newConnectionCallback_(connfd, peerAddr);
+            }
+            else
+            {
+                ::close(connfd);
+            }
+            continue;
         }
-        else
+
+        int savedErrno = errno;
+        if(savedErrno == EAGAIN)
         {
-            ::close(connfd);
+            break;  // drained, or another loop took it from the shared socket
         }
-    }
-    else
-    {
-        LOG_ERROR("%s:%s:%d accept err:%d \n", __FILE__,__FUNCTION__,__LINE__, errno);
-        if(errno == EMFILE)
+        LOG_ERROR("%s:%s:%d accept err:%d \n", __FILE__,__FUNCTION__,__LINE__, savedErrno);
+        if(savedErrno == EMFILE || savedErrno == ENFILE)
         {
             LOG_ERROR("%s:%s:%d socket reached limit! \n", __FILE__,__FUNCTION__,__LINE__);
+            // free the spare descriptor, take the connection and close it
+            // at once, so the peer is told instead of the loop spinning
+            ::close(idleFd_);
+            idleFd_ = ::accept(acceptSocket_.fd(), nullptr, nullptr);
+            if(idleFd_ >= 0)
+            {
+                ::close(idleFd_);
+            }
+            idleFd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
         }
+        break;
     }
-}
\ No newline at end of file
+}
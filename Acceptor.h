@@ -11,8 +11,27 @@ class Acceptor : noncopyable
 public:
     using NewConnectionCallback = std::function<void (int sockfd, const InetAddress&)>;
     Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reuseport);
+    // take over a bound socket, e.g. a dup() of another Acceptor's
+    Acceptor(EventLoop *loop, int listenfd);
     ~Acceptor();
 
+    EventLoop* getLoop() const { return loop_; }
+    int fd() const { return acceptSocket_.fd(); }
+    // the socket is shared with the Acceptors of other loops,
+    // wake up only one of them per connection, call before listen()
+    void setExclusive() { accpetChannel_.enableExclusive(); }
+    // with SO_REUSEPORT, take the connections whose SYN arrived on cpu
+    void setIncomingCpu(int cpu) { acceptSocket_.setIncomingCpu(cpu); }
+    // see Socket::setDeferAccept
+    void setDeferAccept(int seconds) { acceptSocket_.setDeferAccept(seconds); }
+    // accept up to this many connections per wakeup, 1 is one per EPOLLIN
+    void setMaxAcceptsPerWakeup(int maxAccepts) { maxAccepts_ = maxAccepts; }
+    // let the poller accept with a multishot request when it can,
+    // see Channel::enableCompletion, call before listen()
+    void setCompletion(bool on) { completion_ = on; }
+
+    static const int kDefaultMaxAccepts = 64;
+
     void setNewConnectionCallback(const NewConnectionCallback& cb)
     { newConnectionCallback_ = cb; }
 
@@ -21,11 +40,17 @@ public:
 
 private:
     void handleRead();
+    // the next connection, from the poller in completion mode
+    int acceptOne(InetAddress *peerAddr);
 
     EventLoop *loop_;
     Socket acceptSocket_;
     Channel accpetChannel_;
     NewConnectionCallback newConnectionCallback_;
     bool listenning_;
+    int maxAccepts_;
+    bool completion_;
+    // held open so a descriptor is free to accept and close a connection
+    // once we're out of them, else the pending one keeps EPOLLIN set
     int idleFd_;
 }; 
\ No newline at end of file
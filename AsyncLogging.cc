@@ -0,0 +1,286 @@
+#include "AsyncLogging.h"
+#include "LogFile.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unordered_map>
+
+const off_t AsyncLogging::kDefaultRollSize;
+const size_t AsyncLogging::kDefaultMaxQueuedBuffers;
+const size_t AsyncLogging::kBufferSize;
+
+static std::atomic<uint64_t> s_nextId(1);
+
+namespace
+{
+// the live AsyncLoggings by id, a thread that exits after its
+// AsyncLogging is gone finds nothing to retire its front end to
+std::mutex& registryMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+std::unordered_map<uint64_t, AsyncLogging*>& registry()
+{
+    static std::unordered_map<uint64_t, AsyncLogging*> loggings;
+    return loggings;
+}
+}
+
+struct AsyncLogging::FrontEndHolder
+{
+    ~FrontEndHolder() { release(); }
+
+    void release()
+    {
+        if(frontEnd)
+        {
+            // the registry lock keeps the owner from being destroyed meanwhile
+            std::lock_guard<std::mutex> lock(registryMutex());
+            auto it = registry().find(owner);
+            if(it != registry().end())
+            {
+                it->second->retire(frontEnd);
+            }
+            frontEnd.reset();
+        }
+    }
+
+    uint64_t owner = 0;
+    FrontEndPtr frontEnd;
+};
+
+AsyncLogging::AsyncLogging(const std::string& basename,
+                           off_t rollSize,
+                           int flushInterval,
+                           size_t maxQueuedBuffers,
+                           OverflowPolicy policy)
+    : basename_(basename),
+      rollSize_(rollSize),
+      flushInterval_(flushInterval),
+      maxQueuedBuffers_(maxQueuedBuffers),
+      policy_(policy),
+      id_(s_nextId++),
+      running_(false),
+      dropped_(0),
+      thread_(std::bind(&AsyncLogging::threadFunc, this), "AsyncLogging"),
+      submitted_(0),
+      writtenCount_(0)
+{
+    std::lock_guard<std::mutex> lock(registryMutex());
+    registry()[id_] = this;
+}
+
+AsyncLogging::~AsyncLogging()
+{
+    {
+        std::lock_guard<std::mutex> lock(registryMutex());
+        registry().erase(id_);
+    }
+    if(running_)
+    {
+        stop();
+    }
+}
+
+void AsyncLogging::start()
+{
+    running_ = true;
+    thread_.start();
+}
+
+void AsyncLogging::stop()
+{
+    // the output may be bound to this object, don't leave it dangling
+    Logger::instance().resetOutput();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    cond_.notify_one();
+    written_.notify_all();
+    thread_.join();
+}
+
+AsyncLogging::FrontEnd* AsyncLogging::frontEnd()
+{
+    // one AsyncLogging at a time is expected, a new one gets new front ends
+    static thread_local FrontEndHolder t_holder;
+    if(t_holder.owner != id_)
+    {
+        t_holder.release();
+        FrontEndPtr frontEnd(new FrontEnd);
+        frontEnd->current.reset(new LogBuffer);
+        t_holder.owner = id_;
+        t_holder.frontEnd = frontEnd;
+        std::lock_guard<std::mutex> lock(mutex_);
+        frontEnds_.push_back(std::move(frontEnd));
+    }
+    return t_holder.frontEnd.get();
+}
+
+void AsyncLogging::retire(const FrontEndPtr& frontEnd)
+{
+    std::lock_guard<std::mutex> frontLock(frontEnd->mutex);
+    std::lock_guard<std::mutex> lock(mutex_);
+    // the last lines go even over the bound, the thread can't wait
+    if(frontEnd->current->len > 0)
+    {
+        queue_.push_back(std::move(frontEnd->current));
+        ++submitted_;
+        cond_.notify_one();
+    }
+    frontEnd->current.reset();
+    frontEnds_.erase(std::find(frontEnds_.begin(), frontEnds_.end(), frontEnd));
+}
+
+void AsyncLogging::append(const char *line, size_t len)
+{
+    FrontEnd *front = frontEnd();
+    std::lock_guard<std::mutex> lock(front->mutex);
+    if(front->current->len + len > kBufferSize)
+    {
+        submit(front, false);
+    }
+    len = std::min(len, kBufferSize);
+    LogBuffer *buffer = front->current.get();
+    memcpy(buffer->data + buffer->len, line, len);
+    buffer->len += len;
+    ++buffer->messages;
+}
+
+void AsyncLogging::submit(FrontEnd *front, bool partial)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    // the partly filled ones are at most one per thread over the bound
+    if(!partial && queue_.size() >= maxQueuedBuffers_)
+    {
+        if(policy_ == kBlock && running_)
+        {
+            written_.wait(lock, [this]() { return queue_.size() < maxQueuedBuffers_ || !running_; });
+        }
+        else
+        {
+            dropped_ += front->current->messages;
+            front->current->len = 0;
+            front->current->messages = 0;
+            return;
+        }
+    }
+    queue_.push_back(std::move(front->current));
+    ++submitted_;
+    if(spares_.empty())
+    {
+        front->current.reset(new LogBuffer);
+    }
+    else
+    {
+        front->current = std::move(spares_.back());
+        spares_.pop_back();
+    }
+    if(!partial)
+    {
+        cond_.notify_one();
+    }
+}
+
+void AsyncLogging::collect(bool wait)
+{
+    // shared, a front end retired meanwhile stays valid
+    std::vector<FrontEndPtr> fronts;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        fronts = frontEnds_;
+    }
+    for(const FrontEndPtr& front : fronts)
+    {
+        std::unique_lock<std::mutex> lock(front->mutex, std::defer_lock);
+        if(wait)
+        {
+            lock.lock();
+        }
+        else if(!lock.try_lock())
+        {
+            continue;   // busy appending, and maybe waiting for us with kBlock
+        }
+        if(front->current && front->current->len > 0)
+        {
+            submit(front.get(), true);
+        }
+    }
+}
+
+void AsyncLogging::flush()
+{
+    collect(true);
+    std::unique_lock<std::mutex> lock(mutex_);
+    uint64_t target = submitted_;
+    cond_.notify_one();
+    written_.wait(lock, [this, target]() { return writtenCount_ >= target || !running_; });
+}
+
+void AsyncLogging::threadFunc()
+{
+    LogFile output(basename_, rollSize_);
+    std::vector<BufferPtr> writing;
+    std::vector<struct iovec> iov;
+    int64_t droppedReported = 0;
+    bool stopping = false;
+    while(!stopping)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if(queue_.empty() && running_)
+            {
+                cond_.wait_for(lock, std::chrono::seconds(flushInterval_));
+            }
+            stopping = !running_;
+        }
+        // the lines of quiet threads go out within flushInterval too
+        collect(stopping);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            writing.swap(queue_);
+        }
+
+        iov.clear();
+        char note[64];
+        int64_t dropped = dropped_;
+        if(dropped > droppedReported)
+        {
+            int len = snprintf(note, sizeof note, "AsyncLogging dropped %lld messages\n",
+                               static_cast<long long>(dropped - droppedReported));
+            iov.push_back({note, static_cast<size_t>(len)});
+            droppedReported = dropped;
+        }
+        for(auto& buffer : writing)
+        {
+            iov.push_back({buffer->data, buffer->len});
+        }
+        if(!iov.empty())
+        {
+            output.write(iov.data(), static_cast<int>(iov.size()));
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            writtenCount_ += writing.size();
+            for(auto& buffer : writing)
+            {
+                if(spares_.size() < maxQueuedBuffers_)
+                {
+                    buffer->len = 0;
+                    buffer->messages = 0;
+                    spares_.push_back(std::move(buffer));
+                }
+            }
+        }
+        writing.clear();
+        written_.notify_all();
+    }
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Thread.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+// the asynchronous logging backend
+// every thread appends its lines to a buffer of its own, a full buffer is
+// handed to the writer thread, which writes all the buffers queued with
+// one writev to a rolled LogFile; partly filled ones are collected every
+// flushInterval seconds, so no logging thread ever waits on the disk
+// the queue is bounded: with kDropNewest a buffer that finds it full is
+// dropped and counted, with kBlock its thread waits for the writer
+//
+//   AsyncLogging log("/var/log/server", 64 * 1024 * 1024);
+//   log.start();
+//   Logger::instance().setOutput(std::bind(&AsyncLogging::append, &log, _1, _2));
+//
+// stop() and the destructor point the Logger back to stdout, stop the
+// other threads' logging before them, as setOutput requires
+//
+// a thread's buffer is written out and freed when the thread exits
+class AsyncLogging : noncopyable
+{
+public:
+    enum OverflowPolicy
+    {
+        kDropNewest,
+        kBlock
+    };
+
+    AsyncLogging(const std::string& basename,
+                 off_t rollSize = kDefaultRollSize,
+                 int flushInterval = 1,
+                 size_t maxQueuedBuffers = kDefaultMaxQueuedBuffers,
+                 OverflowPolicy policy = kDropNewest);
+    ~AsyncLogging();
+
+    void start();
+    // writes out what was appended before it returns,
+    // the Logger writes to stdout afterwards
+    void stop();
+
+    // a log line, from any thread
+    void append(const char *line, size_t len);
+    // write out everything appended so far and wait for it, e.g. before exit
+    void flush();
+
+    int64_t droppedMessages() const { return dropped_; }
+
+    static const off_t kDefaultRollSize = 64 * 1024 * 1024;
+    static const size_t kDefaultMaxQueuedBuffers = 64;
+    static const size_t kBufferSize = 64 * 1024;
+
+private:
+    struct LogBuffer
+    {
+        LogBuffer() : len(0), messages(0) {}
+        size_t len;
+        size_t messages;
+        char data[kBufferSize];
+    };
+    using BufferPtr = std::unique_ptr<LogBuffer>;
+    // the buffer of a thread, its mutex is only contended when the
+    // buffer is collected by the writer or flush()
+    struct FrontEnd
+    {
+        std::mutex mutex;
+        BufferPtr current;  // null once its thread exited
+    };
+    using FrontEndPtr = std::shared_ptr<FrontEnd>;
+    // the front end of the calling thread, retired when the thread exits
+    struct FrontEndHolder;
+
+    FrontEnd* frontEnd();
+    // its thread exits: queue what it holds, free the rest
+    void retire(const FrontEndPtr& frontEnd);
+    // hand the front end's buffer to the writer, under its mutex
+    void submit(FrontEnd *frontEnd, bool partial);
+    // queue the partly filled buffers, the writer skips the busy ones
+    void collect(bool wait);
+    void threadFunc();
+
+    const std::string basename_;
+    const off_t rollSize_;
+    const int flushInterval_;
+    const size_t maxQueuedBuffers_;
+    const OverflowPolicy policy_;
+    const uint64_t id_;     // tells the thread local front ends apart
+    std::atomic_bool running_;
+    std::atomic<int64_t> dropped_;
+    Thread thread_;
+
+    std::mutex mutex_;
+    std::condition_variable cond_;      // wakes the writer
+    std::condition_variable written_;   // wakes kBlock producers and flush()
+    std::vector<BufferPtr> queue_;
+    std::vector<BufferPtr> spares_;     // written buffers, reused
+    std::vector<FrontEndPtr> frontEnds_;
+    uint64_t submitted_;    // buffers queued so far
+    uint64_t writtenCount_; // buffers written so far
+};
@@ -0,0 +1,600 @@
+#include "BinaryLogging.h"
+#include "Logger.h"
+#include "Thread.h"
+#include "Timestamp.h"
+
+#include <chrono>
+#include <errno.h>
+#include <fcntl.h>
+#include <map>
+#include <sys/uio.h>
+#include <unistd.h>
+
+const size_t BinaryLogging::kDefaultRingBytes;
+
+std::mutex BinaryLogging::activeMutex_;
+BinaryLogging *BinaryLogging::active_ = nullptr;
+std::atomic<uint64_t> BinaryLogging::activeId_(0);
+std::mutex BinaryLogging::sitesMutex_;
+std::vector<BinaryLogging::SiteInfo> BinaryLogging::sites_;
+
+namespace
+{
+// the file starts with the magic and the version
+const char kMagic[8] = {'M', 'Y', 'M', 'U', 'D', 'U', 'O', 'B'};
+const uint32_t kVersion = 1;
+// the ids of the entries that aren't records, 0 pads the end of a ring
+const uint32_t kPadding = 0;
+const uint32_t kFormatEntry = 0xffffffff;
+const uint32_t kDroppedEntry = 0xfffffffe;
+
+std::atomic<uint64_t> s_nextId(1);
+
+size_t align8(size_t size)
+{
+    return (size + 7) & ~static_cast<size_t>(7);
+}
+
+void appendRaw(std::vector<char> *out, const void *data, size_t len)
+{
+    const char *p = static_cast<const char*>(data);
+    out->insert(out->end(), p, p + len);
+}
+
+void appendU32(std::vector<char> *out, uint32_t value)
+{
+    appendRaw(out, &value, sizeof value);
+}
+}
+
+BinaryLogging::Ring::Ring(size_t bytes)
+    : data_(new char[align8(bytes)]),
+      capacity_(align8(bytes)),
+      head_(0),
+      published_(0),
+      tail_(0),
+      retired_(false),
+      dropped_(0)
+{
+}
+
+char* BinaryLogging::Ring::reserve(size_t size)
+{
+    uint64_t tail = tail_.load(std::memory_order_acquire);
+    size_t index = head_ % capacity_;
+    size_t contiguous = capacity_ - index;
+    size_t needed = size <= contiguous ? size : contiguous + size;
+    if(head_ + needed - tail > capacity_)
+    {
+        return nullptr;
+    }
+    if(size > contiguous)
+    {
+        // no room before the end, pad to it and go on at the beginning;
+        // all sizes are multiples of 8, the id and the size fit
+        uint32_t pad[2] = {kPadding, static_cast<uint32_t>(contiguous)};
+        memcpy(data_.get() + index, pad, sizeof pad);
+        head_ += contiguous;
+        index = 0;
+    }
+    return data_.get() + index;
+}
+
+void BinaryLogging::Ring::drain(std::vector<char> *out)
+{
+    uint64_t head = published_.load(std::memory_order_acquire);
+    uint64_t tail = tail_.load(std::memory_order_relaxed);
+    while(tail < head)
+    {
+        const char *record = data_.get() + tail % capacity_;
+        uint32_t id;
+        uint32_t size;
+        memcpy(&id, record, sizeof id);
+        memcpy(&size, record + 4, sizeof size);
+        if(id != kPadding)
+        {
+            appendRaw(out, record, size);
+        }
+        tail += size;
+    }
+    tail_.store(tail, std::memory_order_release);
+}
+
+struct BinaryLogging::RingHolder
+{
+    ~RingHolder() { release(); }
+
+    void release()
+    {
+        if(ring)
+        {
+            ring->retire();
+            ring.reset();
+        }
+    }
+
+    uint64_t owner = 0;
+    RingPtr ring;
+};
+
+BinaryLogging::BinaryLogging(const std::string& basename, size_t ringBytes, int flushIntervalMs)
+    : basename_(basename),
+      ringBytes_(ringBytes),
+      flushIntervalMs_(flushIntervalMs),
+      id_(s_nextId++),
+      fd_(-1),
+      sitesWritten_(0),
+      dropped_(0),
+      droppedWritten_(0),
+      thread_(new Thread(std::bind(&BinaryLogging::threadFunc, this), "BinaryLogging")),
+      running_(false),
+      flushRequests_(0),
+      flushesDone_(0)
+{
+}
+
+BinaryLogging::~BinaryLogging()
+{
+    if(running_)
+    {
+        stop();
+    }
+    if(fd_ >= 0)
+    {
+        ::close(fd_);
+    }
+}
+
+void BinaryLogging::start()
+{
+    char name[32];
+    snprintf(name, sizeof name, ".%d.blog", ::getpid());
+    std::string filename = basename_ + name;
+    fd_ = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd_ < 0)
+    {
+        // the text logs keep going to the Logger output
+        LOG_ERROR("BinaryLogging::start open %s err:%d\n", filename.c_str(), errno);
+        return;
+    }
+    std::vector<char> header;
+    appendRaw(&header, kMagic, sizeof kMagic);
+    appendU32(&header, kVersion);
+    appendU32(&header, 0);
+    if(::write(fd_, header.data(), header.size()) < 0)
+    {
+        LOG_ERROR("BinaryLogging::start write err:%d\n", errno);
+    }
+
+    running_ = true;
+    thread_->start();
+    std::lock_guard<std::mutex> lock(activeMutex_);
+    active_ = this;
+    activeId_.store(id_, std::memory_order_release);
+}
+
+void BinaryLogging::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(activeMutex_);
+        if(active_ == this)
+        {
+            active_ = nullptr;
+            activeId_.store(0, std::memory_order_release);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    cond_.notify_one();
+    thread_->join();
+}
+
+void BinaryLogging::flush()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    uint64_t ticket = ++flushRequests_;
+    cond_.notify_one();
+    flushed_.wait(lock, [this, ticket]() { return flushesDone_ >= ticket || !running_; });
+}
+
+BinaryLogging::Ring* BinaryLogging::ring()
+{
+    // one BinaryLogging at a time is expected, a new one gets new rings
+    static thread_local RingHolder t_holder;
+    uint64_t id = activeId_.load(std::memory_order_acquire);
+    if(id == 0)
+    {
+        return nullptr;
+    }
+    if(t_holder.owner == id)
+    {
+        return t_holder.ring.get();
+    }
+    // stop() can't run meanwhile, the BinaryLogging is still there
+    std::lock_guard<std::mutex> activeLock(activeMutex_);
+    BinaryLogging *log = active_;
+    if(log == nullptr)
+    {
+        return nullptr;
+    }
+    t_holder.release();
+    RingPtr ring(new Ring(log->ringBytes_));
+    t_holder.owner = log->id_;
+    t_holder.ring = ring;
+    std::lock_guard<std::mutex> lock(log->mutex_);
+    log->rings_.push_back(std::move(ring));
+    return t_holder.ring.get();
+}
+
+uint32_t BinaryLogging::registerSite(Site *site, const uint8_t *types, size_t numArgs)
+{
+    std::lock_guard<std::mutex> lock(sitesMutex_);
+    uint32_t id = site->id.load(std::memory_order_relaxed);
+    if(id == 0)
+    {
+        sites_.push_back(SiteInfo{site, std::vector<uint8_t>(types, types + numArgs)});
+        id = static_cast<uint32_t>(sites_.size());
+        site->id.store(id, std::memory_order_relaxed);
+    }
+    return id;
+}
+
+int64_t BinaryLogging::nowMicros()
+{
+    return Timestamp::now().microSecondsSinceEpoch();
+}
+
+void BinaryLogging::threadFunc()
+{
+    bool stopping = false;
+    while(!stopping)
+    {
+        uint64_t requests;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait_for(lock, std::chrono::milliseconds(flushIntervalMs_),
+                           [this]() { return !running_ || flushRequests_ > flushesDone_; });
+            requests = flushRequests_;
+            stopping = !running_;
+        }
+        writeOut();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            flushesDone_ = requests;
+        }
+        flushed_.notify_all();
+    }
+}
+
+void BinaryLogging::writeOut()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for(size_t i = 0; i < rings_.size(); )
+        {
+            // read before the drain, which then has all a retired one holds
+            bool retired = rings_[i]->retired();
+            rings_[i]->drain(&pending_);
+            dropped_ += rings_[i]->takeDropped();
+            if(retired)
+            {
+                rings_[i] = std::move(rings_.back());
+                rings_.pop_back();
+            }
+            else
+            {
+                ++i;
+            }
+        }
+    }
+
+    // a site is registered before its records are in a ring, those
+    // drained above are all here
+    std::vector<char> entries;
+    {
+        std::lock_guard<std::mutex> lock(sitesMutex_);
+        for(; sitesWritten_ < sites_.size(); ++sitesWritten_)
+        {
+            const SiteInfo& info = sites_[sitesWritten_];
+            size_t fileLen = strlen(info.site->file);
+            size_t formatLen = strlen(info.site->format);
+            size_t size = align8(8 + 6 * 4 + info.types.size() + fileLen + formatLen);
+            size_t start = entries.size();
+            appendU32(&entries, kFormatEntry);
+            appendU32(&entries, static_cast<uint32_t>(size));
+            appendU32(&entries, static_cast<uint32_t>(sitesWritten_ + 1));
+            appendU32(&entries, static_cast<uint32_t>(info.site->level));
+            appendU32(&entries, static_cast<uint32_t>(info.site->line));
+            appendU32(&entries, static_cast<uint32_t>(info.types.size()));
+            appendU32(&entries, static_cast<uint32_t>(fileLen));
+            appendU32(&entries, static_cast<uint32_t>(formatLen));
+            appendRaw(&entries, info.types.data(), info.types.size());
+            appendRaw(&entries, info.site->file, fileLen);
+            appendRaw(&entries, info.site->format, formatLen);
+            entries.resize(start + size);
+        }
+    }
+    int64_t dropped = dropped_;
+    if(dropped > droppedWritten_)
+    {
+        int64_t count = dropped - droppedWritten_;
+        appendU32(&entries, kDroppedEntry);
+        appendU32(&entries, 16);
+        appendRaw(&entries, &count, sizeof count);
+        droppedWritten_ = dropped;
+    }
+
+    struct iovec iov[2] = {{entries.data(), entries.size()}, {pending_.data(), pending_.size()}};
+    size_t total = entries.size() + pending_.size();
+    size_t written = 0;
+    while(written < total)
+    {
+        ssize_t n = ::writev(fd_, iov, 2);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            fprintf(stderr, "BinaryLogging::writeOut err:%d\n", errno);
+            break;
+        }
+        written += n;
+        // a short write, go on from where it stopped
+        for(struct iovec& v : iov)
+        {
+            size_t done = std::min(static_cast<size_t>(n), v.iov_len);
+            v.iov_base = static_cast<char*>(v.iov_base) + done;
+            v.iov_len -= done;
+            n -= done;
+        }
+    }
+    pending_.clear();
+}
+
+namespace
+{
+struct Format
+{
+    int level;
+    std::vector<uint8_t> types;
+    std::string format;
+};
+
+bool readExactly(FILE *in, void *buf, size_t len)
+{
+    return len == 0 || fread(buf, 1, len, in) == len;
+}
+
+// one conversion of the format with its argument, p moves past it
+void formatArg(std::string *text, const std::string& spec, uint8_t type,
+               const char **p, const char *end)
+{
+    char conversion = spec.back();
+    bool wantsString = conversion == 's';
+    bool wantsDouble = strchr("eEfFgGaA", conversion) != nullptr;
+    char buf[256];
+    int len = 0;
+    if(type == BinaryLogging::kString)
+    {
+        uint32_t size = 0;
+        if(end - *p < 4 || (memcpy(&size, *p, 4), size > static_cast<size_t>(end - *p - 4)))
+        {
+            // the record is cut short
+            *p = end;
+            text->append("?");
+            return;
+        }
+        std::string value(*p + 4, size);
+        *p += 4 + size;
+        if(wantsString)
+        {
+            len = snprintf(buf, sizeof buf, spec.c_str(), value.c_str());
+        }
+        else
+        {
+            text->append(value);
+            return;
+        }
+    }
+    else
+    {
+        int64_t value = 0;
+        if(end - *p < 8)
+        {
+            *p = end;
+            text->append("?");
+            return;
+        }
+        memcpy(&value, *p, 8);
+        *p += 8;
+        if(wantsString || (type == BinaryLogging::kDouble) != wantsDouble)
+        {
+            // the format and the argument disagree, snprintf can't take it
+            text->append("?");
+            return;
+        }
+        switch(type)
+        {
+        case BinaryLogging::kInt32:
+            len = snprintf(buf, sizeof buf, spec.c_str(), static_cast<int>(value));
+            break;
+        case BinaryLogging::kUInt32:
+            len = snprintf(buf, sizeof buf, spec.c_str(), static_cast<unsigned>(value));
+            break;
+        case BinaryLogging::kInt64:
+            len = snprintf(buf, sizeof buf, spec.c_str(), static_cast<long long>(value));
+            break;
+        case BinaryLogging::kUInt64:
+            len = snprintf(buf, sizeof buf, spec.c_str(), static_cast<unsigned long long>(value));
+            break;
+        case BinaryLogging::kDouble:
+        {
+            double d;
+            memcpy(&d, &value, sizeof d);
+            len = snprintf(buf, sizeof buf, spec.c_str(), d);
+            break;
+        }
+        case BinaryLogging::kPointer:
+            len = snprintf(buf, sizeof buf, spec.c_str(), reinterpret_cast<void*>(value));
+            break;
+        default:
+            break;
+        }
+    }
+    text->append(buf, std::max(0, std::min(len, static_cast<int>(sizeof buf) - 1)));
+}
+
+// the message of a record, as snprintf would have made it
+std::string formatRecord(const Format& format, const char *args, const char *end)
+{
+    std::string text;
+    const char *f = format.format.c_str();
+    size_t arg = 0;
+    while(*f)
+    {
+        const char *percent = strchr(f, '%');
+        if(percent == nullptr)
+        {
+            text.append(f);
+            break;
+        }
+        text.append(f, percent);
+        if(percent[1] == '%')
+        {
+            text.push_back('%');
+            f = percent + 2;
+            continue;
+        }
+        const char *conversion = percent + 1;
+        while(*conversion && strchr("-+ #0123456789.hlLqjzt", *conversion))
+        {
+            ++conversion;
+        }
+        if(*conversion == '\0' || arg >= format.types.size())
+        {
+            text.append(percent);
+            break;
+        }
+        formatArg(&text, std::string(percent, conversion + 1), format.types[arg++], &args, end);
+        f = conversion + 1;
+    }
+    return text;
+}
+}
+
+bool BinaryLogging::decode(FILE *in, FILE *out)
+{
+    char header[16];
+    if(!readExactly(in, header, sizeof header) || memcmp(header, kMagic, sizeof kMagic) != 0)
+    {
+        return false;
+    }
+
+    std::vector<Format> formats;
+    std::vector<char> entry;
+    // each thread's records reach the file in batches, so a line can come
+    // after later lines of other threads; lines wait here until a record
+    // kReorderMicros newer has been read and leave in time order
+    const int64_t kReorderMicros = 1000 * 1000;
+    std::multimap<int64_t, std::string> pending;
+    int64_t newest = 0;
+    bool ok = true;
+    auto flush = [&](int64_t upTo) {
+        auto last = pending.lower_bound(upTo);
+        for(auto it = pending.begin(); it != last; ++it)
+        {
+            fputs(it->second.c_str(), out);
+        }
+        pending.erase(pending.begin(), last);
+    };
+    uint32_t head[2];
+    while(readExactly(in, head, sizeof head))
+    {
+        uint32_t id = head[0];
+        uint32_t size = head[1];
+        if(size < sizeof head)
+        {
+            ok = false;
+            break;
+        }
+        entry.resize(size - sizeof head);
+        if(!readExactly(in, entry.data(), entry.size()))
+        {
+            ok = false;
+            break;
+        }
+        const char *p = entry.data();
+        const char *end = p + entry.size();
+
+        if(id == kFormatEntry)
+        {
+            uint32_t fields[6];
+            if(entry.size() < sizeof fields)
+            {
+                ok = false;
+                break;
+            }
+            memcpy(fields, p, sizeof fields);
+            p += sizeof fields;
+            // fields: id level line numArgs fileLen formatLen
+            if(fields[0] == 0 || static_cast<uint64_t>(fields[3]) + fields[4] + fields[5]
+                                     > static_cast<size_t>(end - p))
+            {
+                ok = false;
+                break;
+            }
+            if(formats.size() < fields[0])
+            {
+                formats.resize(fields[0]);
+            }
+            Format& format = formats[fields[0] - 1];
+            format.level = static_cast<int>(fields[1]);
+            format.types.assign(p, p + fields[3]);
+            p += fields[3] + fields[4];
+            format.format.assign(p, fields[5]);
+        }
+        else if(id == kDroppedEntry)
+        {
+            int64_t count;
+            if(entry.size() < sizeof count)
+            {
+                ok = false;
+                break;
+            }
+            memcpy(&count, p, sizeof count);
+            char line[64];
+            snprintf(line, sizeof line, "BinaryLogging dropped %lld messages\n",
+                     static_cast<long long>(count));
+            pending.emplace(newest, line);
+        }
+        else if(id >= 1 && id <= formats.size())
+        {
+            int64_t micros;
+            if(entry.size() < sizeof micros)
+            {
+                ok = false;
+                break;
+            }
+            memcpy(&micros, p, sizeof micros);
+            const Format& format = formats[id - 1];
+            std::string text = formatRecord(format, p + sizeof micros, end);
+            // the line Logger::log writes
+            std::string line = Logger::levelPrefix(format.level);
+            line += Timestamp(micros).toString();
+            line += " : ";
+            line += text;
+            line += '\n';
+            pending.emplace(micros, std::move(line));
+            if(micros > newest)
+            {
+                newest = micros;
+                flush(newest - kReorderMicros);
+            }
+        }
+    }
+    flush(INT64_MAX);
+    return ok;
+}
@@ -0,0 +1,267 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+class Thread;
+
+// the binary logging backend: while one runs, the LOG_* macros don't
+// format, a call copies the raw arguments into a ring of its thread and a
+// writer thread moves the rings to basename.pid.blog; decode() (the
+// logdecoder tool) turns the file into the usual text lines
+// every call site has a static Site, constant initialized, with its format;
+// the site gets its id on its first call and the writer puts the format
+// into the file before the first record that uses it
+// a record that doesn't fit in the ring is dropped and counted
+// a ring is shared by its thread and the BinaryLogging, the thread lets go
+// of it when it exits and the writer drops it after the last drain, so
+// either may go first; a call finds its ring by the running one's id and
+// only touches the BinaryLogging itself to get a new ring, under the same
+// lock stop() takes, so threads may keep logging through stop() and the
+// destructor
+//
+//   BinaryLogging log("/var/log/server");
+//   log.start();
+class BinaryLogging : noncopyable
+{
+public:
+    struct Site
+    {
+        const char *format;
+        const char *file;
+        int line;
+        int level;
+        std::atomic<uint32_t> id;  // 0 until the first call
+    };
+
+    explicit BinaryLogging(const std::string& basename,
+                           size_t ringBytes = kDefaultRingBytes,
+                           int flushIntervalMs = 10);
+    ~BinaryLogging();
+
+    void start();
+    void stop();
+    // write out everything logged so far and wait for it
+    void flush();
+
+    // as of the last write out, flush() first for an exact count
+    int64_t droppedMessages() const { return dropped_; }
+
+    // whether the LOG_* macros go to a running BinaryLogging
+    static bool active() { return activeId_.load(std::memory_order_relaxed) != 0; }
+
+    // false when an argument has no binary form (a class, a function
+    // pointer, long double...), the caller formats the line as text then
+    template<typename... Args>
+    static bool log(Site *site, Args... args)
+    { return logIf(AllLoggable<Args...>(), site, args...); }
+
+    // the text lines of a .blog file in time order, false if it is not
+    // one or is cut short
+    static bool decode(FILE *in, FILE *out);
+
+    static const size_t kDefaultRingBytes = 1024 * 1024;
+
+    // the argument types a record can hold
+    enum ArgType : uint8_t
+    {
+        kInt32,
+        kUInt32,
+        kInt64,
+        kUInt64,
+        kDouble,
+        kString,
+        kPointer,
+    };
+
+private:
+    // a record is {id, size, microseconds} and the arguments, padded to 8
+    struct RecordHeader
+    {
+        uint32_t id;
+        uint32_t size;
+        int64_t micros;
+    };
+
+    // filled by one logging thread, emptied by the writer
+    class Ring : noncopyable
+    {
+    public:
+        explicit Ring(size_t bytes);
+        // room for size bytes, nullptr if the ring is full
+        char* reserve(size_t size);
+        void commit(size_t size) { head_ += size; published_.store(head_, std::memory_order_release); }
+        // append the records published so far to out
+        void drain(std::vector<char> *out);
+        // its thread exited, nothing is published after this
+        void retire() { retired_.store(true, std::memory_order_release); }
+        bool retired() const { return retired_.load(std::memory_order_acquire); }
+        // a record didn't fit, the writer adds them up
+        void drop() { dropped_.fetch_add(1, std::memory_order_relaxed); }
+        int64_t takeDropped() { return dropped_.exchange(0, std::memory_order_relaxed); }
+
+    private:
+        std::unique_ptr<char[]> data_;
+        const size_t capacity_;
+        uint64_t head_;     // the producer's own
+        std::atomic<uint64_t> published_;
+        std::atomic<uint64_t> tail_;
+        std::atomic_bool retired_;
+        std::atomic<int64_t> dropped_;
+    };
+    using RingPtr = std::shared_ptr<Ring>;
+    // the ring of the calling thread, retired when the thread exits
+    struct RingHolder;
+
+    template<typename T>
+    struct IsLoggable : std::integral_constant<bool,
+        std::is_integral<T>::value || std::is_enum<T>::value
+        || std::is_same<T, float>::value || std::is_same<T, double>::value
+        || (std::is_pointer<T>::value
+            && !std::is_function<typename std::remove_pointer<T>::type>::value)>
+    {};
+    template<typename... Ts>
+    struct AllLoggable : std::true_type {};
+    template<typename T, typename... Rest>
+    struct AllLoggable<T, Rest...> : std::integral_constant<bool,
+        IsLoggable<T>::value && AllLoggable<Rest...>::value>
+    {};
+
+    template<typename... Args>
+    static bool logIf(std::false_type, Site*, Args...) { return false; }
+    template<typename... Args>
+    static bool logIf(std::true_type, Site *site, Args... args);
+
+    static Ring* ring();
+    static uint32_t registerSite(Site *site, const uint8_t *types, size_t numArgs);
+    void threadFunc();
+    // the records of all rings, then the formats they use
+    void writeOut();
+
+    // sizes and writes of the arguments, by type
+    template<typename T>
+    static typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value, ArgType>::type
+    argType(T)
+    {
+        return std::is_signed<T>::value ? (sizeof(T) <= 4 ? kInt32 : kInt64)
+                                        : (sizeof(T) <= 4 ? kUInt32 : kUInt64);
+    }
+    static ArgType argType(double) { return kDouble; }
+    static ArgType argType(const char*) { return kString; }
+    static ArgType argType(const void*) { return kPointer; }
+
+    template<typename T>
+    static typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value, size_t>::type
+    argSize(T) { return 8; }
+    static size_t argSize(double) { return 8; }
+    static size_t argSize(const char *s) { return 4 + (s ? strlen(s) : 6); }
+    static size_t argSize(const void*) { return 8; }
+
+    template<typename T>
+    static typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value, char*>::type
+    writeArg(char *p, T value)
+    {
+        // widened, decode() narrows it back by its type
+        int64_t wide = static_cast<int64_t>(value);
+        memcpy(p, &wide, 8);
+        return p + 8;
+    }
+    static char* writeArg(char *p, double value) { memcpy(p, &value, 8); return p + 8; }
+    static char* writeArg(char *p, const char *s)
+    {
+        if(s == nullptr)
+        {
+            s = "(null)";
+        }
+        uint32_t len = static_cast<uint32_t>(strlen(s));
+        memcpy(p, &len, 4);
+        memcpy(p + 4, s, len);
+        return p + 4 + len;
+    }
+    static char* writeArg(char *p, const void *pointer)
+    {
+        uint64_t value = reinterpret_cast<uintptr_t>(pointer);
+        memcpy(p, &value, 8);
+        return p + 8;
+    }
+
+    static size_t argsSize() { return 0; }
+    template<typename T, typename... Rest>
+    static size_t argsSize(T first, Rest... rest) { return argSize(first) + argsSize(rest...); }
+    static void writeArgs(char*) {}
+    template<typename T, typename... Rest>
+    static void writeArgs(char *p, T first, Rest... rest) { writeArgs(writeArg(p, first), rest...); }
+
+    static int64_t nowMicros();
+
+    struct SiteInfo
+    {
+        const Site *site;
+        std::vector<uint8_t> types;
+    };
+
+    // the running one, set and cleared under activeMutex_, the calls
+    // check the id without the lock
+    static std::mutex activeMutex_;
+    static BinaryLogging *active_;
+    static std::atomic<uint64_t> activeId_;
+    // the sites, by id - 1, for all instances
+    static std::mutex sitesMutex_;
+    static std::vector<SiteInfo> sites_;
+
+    const std::string basename_;
+    const size_t ringBytes_;
+    const int flushIntervalMs_;
+    const uint64_t id_;     // tells the thread local rings apart
+    int fd_;
+    size_t sitesWritten_;   // the formats in the file so far
+    std::atomic<int64_t> dropped_;
+    int64_t droppedWritten_;
+    std::unique_ptr<Thread> thread_;
+    bool running_;
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::condition_variable flushed_;
+    uint64_t flushRequests_;
+    uint64_t flushesDone_;
+    std::vector<RingPtr> rings_;
+    std::vector<char> pending_;     // drained, not written yet
+};
+
+template<typename... Args>
+bool BinaryLogging::logIf(std::true_type, Site *site, Args... args)
+{
+    uint32_t id = site->id.load(std::memory_order_relaxed);
+    if(id == 0)
+    {
+        const uint8_t types[] = {argType(args)..., 0};
+        id = registerSite(site, types, sizeof...(Args));
+    }
+    size_t size = (sizeof(RecordHeader) + argsSize(args...) + 7) & ~static_cast<size_t>(7);
+    Ring *r = ring();
+    char *p = r ? r->reserve(size) : nullptr;
+    if(p == nullptr)
+    {
+        if(r != nullptr)
+        {
+            r->drop();
+        }
+        return true;
+    }
+    RecordHeader header = {id, static_cast<uint32_t>(size), nowMicros()};
+    memcpy(p, &header, sizeof header);
+    writeArgs(p + sizeof header, args...);
+    r->commit(size);
+    return true;
+}
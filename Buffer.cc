@@ -1,47 +1,329 @@
 #include "Buffer.h"
+#include "BufferPool.h"
 
 #include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/socket.h>
 #include <sys/uio.h>
 #include <unistd.h>
+#include <linux/errqueue.h>
 
-ssize_t Buffer::readFd(int fd, int *saveErrno)
+namespace
+{
+
+char kEmpty[Buffer::kCheaprepend + 1];
+
+}
+
+// initialSize is kept for the interface, the chunks are taken lazily
+Buffer::Buffer(size_t /* initialSize */)
+    : head_(nullptr),
+      tail_(nullptr),
+      readable_(0)
+{
+}
+
+Buffer::~Buffer()
+{
+    while(head_ != nullptr)
+    {
+        popHead();
+    }
+}
+
+void Buffer::swap(Buffer &rhs)
+{
+    std::swap(head_, rhs.head_);
+    std::swap(tail_, rhs.tail_);
+    std::swap(readable_, rhs.readable_);
+    std::swap(arrivalTime_, rhs.arrivalTime_);
+}
+
+// a chunk larger than kChunkSize only holds a message that must stay
+// contiguous, it comes from a bigger size class of the pool
+Buffer::Chunk* Buffer::newChunk(size_t capacity)
+{
+    size_t allocated = 0;
+    size_t size = std::max(sizeof(Chunk) + capacity, static_cast<size_t>(kChunkSize));
+    Chunk *chunk = static_cast<Chunk*>(BufferPool::threadPool().allocate(size, &allocated));
+    chunk->next = nullptr;
+    chunk->capacity = allocated - sizeof(Chunk);
+    chunk->readIndex = chunk->writeIndex = 0;
+    return chunk;
+}
+
+void Buffer::freeChunk(Chunk *chunk)
+{
+    BufferPool::deallocate(chunk);
+}
+
+void Buffer::appendChunk(size_t minCapacity)
+{
+    if(head_ == nullptr)
+    {
+        head_ = tail_ = newChunk(kCheaprepend + minCapacity);
+        head_->readIndex = head_->writeIndex = kCheaprepend;
+    }
+    else
+    {
+        tail_->next = newChunk(minCapacity);
+        tail_ = tail_->next;
+    }
+}
+
+void Buffer::popHead()
+{
+    Chunk *chunk = head_;
+    head_ = chunk->next;
+    if(head_ == nullptr)
+    {
+        tail_ = nullptr;
+    }
+    freeChunk(chunk);
+}
+
+void Buffer::retrieve(size_t len)
+{
+    if(len >= readable_)
+    {
+        retrieveAll();
+        return;
+    }
+
+    readable_ -= len;
+    while(len > 0)
+    {
+        size_t readable = head_->readable();
+        if(len < readable)
+        {
+            head_->readIndex += len;
+            break;
+        }
+        len -= readable;
+        popHead();
+    }
+}
+
+// drained, give every chunk back to the pool
+void Buffer::retrieveAll()
+{
+    while(head_ != nullptr)
+    {
+        popHead();
+    }
+    readable_ = 0;
+}
+
+std::string Buffer::retrieveAsString(size_t len)
+{
+    len = std::min(len, readable_);
+    std::string result;
+    result.reserve(len);
+    size_t left = len;
+    for(Chunk *chunk = head_; chunk != nullptr && left > 0; chunk = chunk->next)
+    {
+        size_t n = std::min(left, chunk->readable());
+        result.append(chunk->data() + chunk->readIndex, n);
+        left -= n;
+    }
+    retrieve(len);  // 对缓冲区进行复位
+    return result;
+}
+
+void Buffer::append(const char *data, size_t len)
+{
+    while(len > 0)
+    {
+        if(writableBytes() == 0)
+        {
+            appendChunk(0);
+        }
+        size_t n = std::min(len, writableBytes());
+        memcpy(beginWrite(), data, n);
+        hasWritten(n);
+        data += n;
+        len -= n;
+    }
+}
+
+void Buffer::append(Buffer *rhs)
+{
+    if(rhs->readable_ == 0)
+    {
+        return;
+    }
+    if(readable_ == 0)
+    {
+        retrieveAll();
+        swap(*rhs);
+        return;
+    }
+    tail_->next = rhs->head_;
+    tail_ = rhs->tail_;
+    readable_ += rhs->readable_;
+    rhs->head_ = rhs->tail_ = nullptr;
+    rhs->readable_ = 0;
+}
+
+const char* Buffer::pullUp(size_t len)
+{
+    len = std::min(len, readable_);
+    if(len == 0)
+    {
+        return kEmpty + kCheaprepend;
+    }
+
+    // the bytes after len stay where they are
+    Chunk *chunk = newChunk(kCheaprepend + len);
+    chunk->readIndex = chunk->writeIndex = kCheaprepend;
+    while(chunk->readable() < len)
+    {
+        size_t n = std::min(len - chunk->readable(), head_->readable());
+        memcpy(chunk->data() + chunk->writeIndex, head_->data() + head_->readIndex, n);
+        chunk->writeIndex += n;
+        head_->readIndex += n;
+        if(head_->readable() == 0)
+        {
+            popHead();
+        }
+    }
+    chunk->next = head_;
+    head_ = chunk;
+    if(tail_ == nullptr)
+    {
+        tail_ = chunk;
+    }
+    return chunk->data() + chunk->readIndex;
+}
+
+ssize_t Buffer::readTimestamped(int fd, struct iovec *vec, int iovcnt)
+{
+    char control[CMSG_SPACE(sizeof(struct scm_timestamping))];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof msg);
+    msg.msg_iov = vec;
+    msg.msg_iovlen = iovcnt;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof control;
+    const ssize_t n = ::recvmsg(fd, &msg, 0);
+    if(n > 0 && readable_ == 0)
+    {
+        // the oldest unread bytes are these, nothing arrived with them
+        // if the socket has no timestamping on
+        arrivalTime_ = Timestamp();
+        for(struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING)
+            {
+                struct scm_timestamping stamps;
+                memcpy(&stamps, CMSG_DATA(cmsg), sizeof stamps);
+                // ts[0] is the software one
+                arrivalTime_ = Timestamp(static_cast<int64_t>(stamps.ts[0].tv_sec) * Timestamp::kMicroSecondsPerSecond
+                                         + stamps.ts[0].tv_nsec / 1000);
+            }
+        }
+    }
+    return n;
+}
+
+ssize_t Buffer::readFd(int fd, int *saveErrno, bool rxTimestamps)
 {
     char extrabuf[65536];
     struct iovec vec[2];
+    Chunk *oldTail = nullptr;
+    bool added = writableBytes() == 0;
+    if(added)
+    {
+        // data is arriving, read the first chunk of it in place
+        oldTail = tail_;
+        appendChunk(0);
+    }
     const size_t writable = writableBytes();
 
-    vec[0].iov_base = begin() + writerIndex_;
+    vec[0].iov_base = beginWrite();
     vec[0].iov_len = writable;
 
     vec[1].iov_base = extrabuf;
     vec[1].iov_len = sizeof(extrabuf);
 
     const int iovcnt = (writable < sizeof(extrabuf)) ? 2 : 1;
-    const ssize_t n = readv(fd, vec, iovcnt);
+    ssize_t n;
+    if(rxTimestamps)
+    {
+        n = readTimestamped(fd, vec, iovcnt);
+    }
+    else
+    {
+        n = readv(fd, vec, iovcnt);
+    }
 
-    if(n < 0)
+    if(n <= 0)
     {
-        *saveErrno = errno;
+        if(n < 0)
+        {
+            *saveErrno = errno;
+        }
+        if(added)
+        {
+            // nothing came, the chunk goes back to the pool, an idle
+            // connection doesn't keep one
+            freeChunk(tail_);
+            tail_ = oldTail;
+            if(oldTail != nullptr)
+            {
+                oldTail->next = nullptr;
+            }
+            else
+            {
+                head_ = nullptr;
+            }
+        }
     }
     else if(static_cast<size_t>(n) <= writable)
     {
-        writerIndex_ += n;
+        hasWritten(n);
     }
     else
     {
-        writerIndex_ = buffer_.size();
+        hasWritten(writable);
         append(extrabuf, n - writable);
     }
     
     return n;
 }
 
-ssize_t Buffer::writeFd(int fd, int *saveErrno)
+// gather up to IOV_MAX chunks into one writev
+ssize_t Buffer::writeFd(int fd, int *saveErrno, int flags)
 {
-    ssize_t n = write(fd, peek(), readableBytes());
+    struct iovec vec[IOV_MAX];
+    int iovcnt = 0;
+    for(Chunk *chunk = head_; chunk != nullptr && iovcnt < IOV_MAX; chunk = chunk->next)
+    {
+        if(chunk->readable() > 0)
+        {
+            vec[iovcnt].iov_base = chunk->data() + chunk->readIndex;
+            vec[iovcnt].iov_len = chunk->readable();
+            ++iovcnt;
+        }
+    }
+
+    ssize_t n;
+    if(flags == 0)
+    {
+        n = writev(fd, vec, iovcnt);
+    }
+    else
+    {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof msg);
+        msg.msg_iov = vec;
+        msg.msg_iovlen = iovcnt;
+        n = sendmsg(fd, &msg, flags);
+    }
     if(n < 0)
     {
         *saveErrno = errno;
     }
     return n;
-}
\ No newline at end of file
+}
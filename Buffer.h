@@ -1,132 +1,166 @@
 #pragma once
  
+#include "noncopyable.h"
+#include "Timestamp.h"
+
 #include <algorithm>
 #include <string>
-#include <vector>
-
-class Buffer
+#include <sys/types.h>
+
+struct iovec;
+
+// Buffer is a chain of fixed-size chunks taken from the BufferPool of the thread
+// append never moves the bytes already in the buffer, writeFd drains
+// the whole chain with one writev
+//
+// peek() still returns all readable bytes contiguously, when they span
+// several chunks it pulls them up into one chunk first; peek(len) pulls
+// up only len bytes and forEachChunk() reads the chain without copying
+//
+// an empty Buffer holds no chunk: the first one is taken on the first
+// write and all of them go back to the pool once drained, so idle
+// connections cost no buffer memory
+class Buffer : noncopyable
 {
 public:
     static const size_t kCheaprepend = 8;
     static const size_t kInitialSize = 1024;
+    // the bytes of a pool chunk, header included
+    static const size_t kChunkSize = 4096;
 
-explicit Buffer(size_t initialSize = kInitialSize)
-    : buffer_(kCheaprepend + kInitialSize),
-      readerIndex_(kCheaprepend),
-      writerIndex_(kCheaprepend)
-{
-}
+    explicit Buffer(size_t initialSize = kInitialSize);
+    ~Buffer();
+
+    void swap(Buffer &rhs);
 
     size_t readableBytes() const
     {
-        return writerIndex_ - readerIndex_;
+        return readable_;
     }
 
+    // contiguous bytes writable at beginWrite()
     size_t writableBytes() const
     {
-        return buffer_.size() - writerIndex_;
+        return tail_ ? tail_->capacity - tail_->writeIndex : 0;
     }
 
     size_t prependableBytes() const
     {
-        return readerIndex_;
+        return head_ ? head_->readIndex : kCheaprepend;
     }
 
     // 返回缓存区中可读数据的起始地址
-    const char* peek() const
+    const char* peek()
     {
-        return begin() + readerIndex_;
+        return peek(readable_);
     }
 
-    // onMessage string <- Buffer
-    void retrieve(size_t len)
+    // the first len bytes contiguously, at most readableBytes()
+    const char* peek(size_t len)
     {
-        if(len < readableBytes())
-        {
-            readerIndex_ += len;
-        }
-        else
+        if(head_ != nullptr && head_->readable() >= len)
         {
-            retrieveAll();
+            return head_->data() + head_->readIndex;
         }
+        return pullUp(len);
     }
 
-    void retrieveAll()
+    // f(data, len) on the readable bytes of every chunk in order
+    template <typename F>
+    void forEachChunk(F f) const
     {
-        readerIndex_ = writerIndex_ = kCheaprepend;
+        for(const Chunk *chunk = head_; chunk != nullptr; chunk = chunk->next)
+        {
+            if(chunk->readable() > 0)
+            {
+                f(chunk->data() + chunk->readIndex, chunk->readable());
+            }
+        }
     }
 
+    // onMessage string <- Buffer
+    void retrieve(size_t len);
+
+    void retrieveAll();
+
     std::string retrieveAllAsString()
     {
         return retrieveAsString(readableBytes());
     }
 
-    std::string retrieveAsString(size_t len)
-    {
-        std::string result(peek(), len);
-        retrieve(len);  // 对缓冲区进行复位
-        return result;
-    }
+    std::string retrieveAsString(size_t len);
 
     void ensureWriteableBytes(size_t len)
     {
         if(writableBytes() < len)
         {
-            makeSpace(len);
+            appendChunk(len);
         }
     }
 
     // [data, data + len]上的数据添加到缓冲区
-    void append(const char *data, size_t len)
-    {
-        ensureWriteableBytes(len);
-        std::copy(data, data + len, beginWrite());
-        writerIndex_ += len;
-    }
+    void append(const char *data, size_t len);
+    // move the chunks of rhs to the tail, no copy, rhs is left empty
+    void append(Buffer *rhs);
 
     char* beginWrite()
     {
-        return begin() + writerIndex_;
+        return tail_ ? tail_->data() + tail_->writeIndex : nullptr;
     }
 
     const char* beginWrite() const
     {
-        return begin() + writerIndex_;
-    }
-
-    ssize_t readFd(int fd, int *saveErrno);
-    ssize_t writeFd(int fd, int *saveErrno);
-
-private:
-
-    char* begin()
-    {
-        return &*buffer_.begin();
+        return tail_ ? tail_->data() + tail_->writeIndex : nullptr;
     }
 
-    const char* begin() const
+    // len bytes had been written at beginWrite()
+    void hasWritten(size_t len)
     {
-        return &*buffer_.cbegin();
-    }
-
-    void makeSpace(size_t len)
-    {
-        if(writableBytes() + prependableBytes() < len + kCheaprepend)
-        {
-            buffer_.resize(writerIndex_ + len);
-        }
-        else
+        if(len > 0)
         {
-            size_t readable = readableBytes();
-            std::copy(begin() + readerIndex_,
-                      begin() + writerIndex_,
-                      begin() + kCheaprepend);
-            readerIndex_ = kCheaprepend;
-            writerIndex_ = readerIndex_ + readable;
+            tail_->writeIndex += len;
+            readable_ += len;
         }
     }
 
-    std::vector<char> buffer_;
-    size_t readerIndex_;
-    size_t writerIndex_;
-};;
\ No newline at end of file
+    // with rxTimestamps it is a recvmsg that takes the kernel receive
+    // time of the socket too, see Socket::setRxTimestamps
+    ssize_t readFd(int fd, int *saveErrno, bool rxTimestamps = false);
+    // when the oldest unread bytes arrived, as the kernel saw them: the
+    // time of the read that found the buffer empty, invalid without
+    // rxTimestamps; TCP reports the last segment a read takes in
+    Timestamp arrivalTime() const { return arrivalTime_; }
+    // flags such as MSG_MORE turn the writev into a sendmsg
+    ssize_t writeFd(int fd, int *saveErrno, int flags = 0);
+
+private:
+    struct Chunk
+    {
+        Chunk *next;
+        size_t capacity;    // the bytes of data()
+        size_t readIndex;
+        size_t writeIndex;
+
+        char* data() { return reinterpret_cast<char*>(this + 1); }
+        const char* data() const { return reinterpret_cast<const char*>(this + 1); }
+        size_t readable() const { return writeIndex - readIndex; }
+    };
+
+    static Chunk* newChunk(size_t capacity);
+    static void freeChunk(Chunk *chunk);
+
+    // link a chunk of at least minCapacity writable bytes at the tail,
+    // anything up to a pool chunk gets a pool chunk
+    void appendChunk(size_t minCapacity);
+    void popHead();
+    // copy the first len readable bytes into one head chunk,
+    // return the start of them
+    const char* pullUp(size_t len);
+    // the readv of readFd as a recvmsg, taking the SCM_TIMESTAMPING
+    ssize_t readTimestamped(int fd, struct iovec *vec, int iovcnt);
+
+    Chunk *head_;
+    Chunk *tail_;
+    size_t readable_;
+    Timestamp arrivalTime_;
+};
@@ -0,0 +1,190 @@
+#include "BufferPool.h"
+#include "Logger.h"
+
+#include <errno.h>
+#include <new>
+#include <sys/mman.h>
+
+std::atomic<size_t> BufferPool::s_maxCachedBytes_(BufferPool::kDefaultMaxCachedBytes);
+std::atomic<bool> BufferPool::s_hugePages_(false);
+
+constexpr int kHugeClass = -1;  // larger than every size class
+constexpr size_t kArenaSize = 2 * 1024 * 1024;
+
+// in front of every block, max_align_t keeps the payload aligned
+struct BufferPool::Header
+{
+    struct Info
+    {
+        int sizeClass;
+        bool fromArena;
+    };
+    union
+    {
+        Info info;
+        max_align_t align;
+    };
+};
+
+namespace
+{
+// the pool is gone during thread exit, blocks freed after that go to malloc
+__thread bool t_poolDestroyed = false;
+}
+
+BufferPool& BufferPool::threadPool()
+{
+    static thread_local BufferPool pool;
+    return pool;
+}
+
+BufferPool::BufferPool()
+    : cachedBytes_(0),
+      hits_(0),
+      misses_(0)
+{
+    for(int i = 0; i < kNumSizeClasses; ++i)
+    {
+        freeLists_[i] = nullptr;
+    }
+}
+
+BufferPool::~BufferPool()
+{
+    t_poolDestroyed = true;
+    for(int i = 0; i < kNumSizeClasses; ++i)
+    {
+        while(freeLists_[i] != nullptr)
+        {
+            FreeNode *node = freeLists_[i];
+            freeLists_[i] = node->next;
+            Header *header = reinterpret_cast<Header*>(node) - 1;
+            if(!header->info.fromArena)
+            {
+                ::operator delete(header);
+            }
+        }
+    }
+}
+
+int BufferPool::sizeClass(size_t size)
+{
+    for(int i = 0; i < kNumSizeClasses; ++i)
+    {
+        if(size <= classSize(i))
+        {
+            return i;
+        }
+    }
+    return kHugeClass;
+}
+
+void* BufferPool::allocate(size_t size, size_t *allocated)
+{
+    int cls = sizeClass(size);
+    size_t blockSize = cls == kHugeClass ? size : classSize(cls);
+    *allocated = blockSize;
+
+    bool refilled = false;
+    if(cls != kHugeClass && freeLists_[cls] == nullptr && s_hugePages_)
+    {
+        refilled = refillFromArena(cls);
+    }
+
+    if(cls == kHugeClass || freeLists_[cls] == nullptr)
+    {
+        increase(misses_);
+        Header *header = static_cast<Header*>(::operator new(sizeof(Header) + blockSize));
+        header->info.sizeClass = cls;
+        header->info.fromArena = false;
+        return header + 1;
+    }
+
+    // a block of a new arena is a miss too, the free list had none
+    increase(refilled ? misses_ : hits_);
+    FreeNode *node = freeLists_[cls];
+    freeLists_[cls] = node->next;
+    cachedBytes_.store(cachedBytes_.load(std::memory_order_relaxed) - blockSize,
+                       std::memory_order_relaxed);
+    return node;
+}
+
+void BufferPool::deallocate(void *block)
+{
+    Header *header = static_cast<Header*>(block) - 1;
+    if(header->info.sizeClass == kHugeClass)
+    {
+        ::operator delete(header);
+    }
+    else if(t_poolDestroyed)
+    {
+        if(!header->info.fromArena)
+        {
+            ::operator delete(header);
+        }
+    }
+    else
+    {
+        threadPool().put(header);
+    }
+}
+
+// the cap only frees malloc blocks: an arena block can't be given back,
+// so it always returns to the free list and may keep cachedBytes over the cap
+void BufferPool::put(Header *header)
+{
+    int cls = header->info.sizeClass;
+    size_t cached = cachedBytes_.load(std::memory_order_relaxed);
+    if(!header->info.fromArena
+        && cached + classSize(cls) > s_maxCachedBytes_.load(std::memory_order_relaxed))
+    {
+        ::operator delete(header);
+        return;
+    }
+
+    // the link lives in the payload, the header stays for deallocate
+    FreeNode *node = reinterpret_cast<FreeNode*>(header + 1);
+    node->next = freeLists_[cls];
+    freeLists_[cls] = node;
+    cachedBytes_.store(cached + classSize(cls), std::memory_order_relaxed);
+}
+
+// an arena served by hits only, its blocks can't be freed one by one
+bool BufferPool::refillFromArena(int cls)
+{
+    // map twice the size to cut a 2 MB aligned arena out of it
+    void *raw = ::mmap(nullptr, 2 * kArenaSize, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(raw == MAP_FAILED)
+    {
+        LOG_ERROR("BufferPool arena mmap error:%d\n", errno);
+        return false;
+    }
+    uintptr_t start = reinterpret_cast<uintptr_t>(raw);
+    uintptr_t aligned = (start + kArenaSize - 1) & ~(kArenaSize - 1);
+    if(aligned > start)
+    {
+        ::munmap(raw, aligned - start);
+    }
+    ::munmap(reinterpret_cast<void*>(aligned + kArenaSize), start + kArenaSize - aligned);
+    if(::madvise(reinterpret_cast<void*>(aligned), kArenaSize, MADV_HUGEPAGE) < 0)
+    {
+        LOG_ERROR("BufferPool madvise(MADV_HUGEPAGE) error:%d\n", errno);
+    }
+
+    const size_t blockSize = sizeof(Header) + classSize(cls);
+    size_t carved = 0;
+    for(uintptr_t p = aligned; p + blockSize <= aligned + kArenaSize; p += blockSize)
+    {
+        Header *header = reinterpret_cast<Header*>(p);
+        header->info.sizeClass = cls;
+        header->info.fromArena = true;
+        FreeNode *node = reinterpret_cast<FreeNode*>(header + 1);
+        node->next = freeLists_[cls];
+        freeLists_[cls] = node;
+        carved += classSize(cls);
+    }
+    cachedBytes_.store(cachedBytes_.load(std::memory_order_relaxed) + carved,
+                       std::memory_order_relaxed);
+    return true;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// the blocks Buffer chunks are made of, cached per thread so that a loop
+// reuses what its connections freed without malloc or a lock
+//
+// a block freed in another thread goes to that thread's pool,
+// blocks larger than the biggest size class go straight to malloc
+class BufferPool : noncopyable
+{
+public:
+    // 4 KB, 16 KB, 64 KB, 256 KB
+    static const int kNumSizeClasses = 4;
+    static const size_t kMinBlockSize = 4096;
+    static const size_t kDefaultMaxCachedBytes = 4 * 1024 * 1024;
+
+    // the pool of the calling thread
+    static BufferPool& threadPool();
+
+    // the bytes of free blocks one thread may keep, the rest go back to malloc;
+    // huge page arena blocks are exempt, they can't be returned
+    static void setMaxCachedBytes(size_t bytes) { s_maxCachedBytes_ = bytes; }
+    // carve blocks from 2 MB madvise(MADV_HUGEPAGE) arenas,
+    // the arena blocks are never returned to the system
+    static void setHugePages(bool on) { s_hugePages_ = on; }
+
+    // *allocated is set to the usable bytes, at least size
+    void* allocate(size_t size, size_t *allocated);
+    // may be called in any thread
+    static void deallocate(void *block);
+
+    // hit: served from the free list, miss: had to ask malloc or map a new arena
+    int64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+    int64_t misses() const { return misses_.load(std::memory_order_relaxed); }
+    size_t cachedBytes() const { return cachedBytes_.load(std::memory_order_relaxed); }
+
+    BufferPool();
+    ~BufferPool();
+
+private:
+    struct Header;
+    struct FreeNode
+    {
+        FreeNode *next;
+    };
+
+    static int sizeClass(size_t size);
+    static size_t classSize(int sizeClass) { return kMinBlockSize << (2 * sizeClass); }
+
+    void put(Header *header);
+    bool refillFromArena(int sizeClass);
+
+    // only the owner thread writes them, other threads may read
+    static void increase(std::atomic<int64_t> &counter)
+    { counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); }
+
+    FreeNode *freeLists_[kNumSizeClasses];
+    std::atomic<size_t> cachedBytes_;
+    std::atomic<int64_t> hits_;
+    std::atomic<int64_t> misses_;
+
+    static std::atomic<size_t> s_maxCachedBytes_;
+    static std::atomic<bool> s_hugePages_;
+};
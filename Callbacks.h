@@ -2,6 +2,7 @@
 
 #include <memory>
 #include <functional>
+#include <string>
 
 class Buffer;
 class TcpConnection;
@@ -15,3 +16,18 @@ using MessageCallback = std::function<void (const TcpConnectionPtr&,
                                             Buffer* buffer,
                                             Timestamp receiveTime)>;
 using HighWaterMarkCallback = std::function<void (const TcpConnectionPtr&, size_t)>;
+using TimerCallback = std::function<void ()>;
+// an immutable payload shared with the connection until it is sent
+using PayloadPtr = std::shared_ptr<const std::string>;
+
+// the callbacks of a connection, one copy is shared by all the
+// connections of a TcpServer instead of five std::function each
+struct ConnectionCallbacks
+{
+    ConnectionCallback connectionCallback;
+    MessageCallback messageCallback;
+    WriteCompleteCallback writeCompleteCallback;
+    CloseCallback closeCallback;
+    HighWaterMarkCallback highWaterMarkCallback;
+};
+using ConnectionCallbacksPtr = std::shared_ptr<ConnectionCallbacks>;
@@ -14,6 +14,10 @@ Channel::Channel(EventLoop *loop, int fd)
       events_(0),
       revents_(0),
       index_(-1),
+      edgeTriggered_(false),
+      exclusive_(false),
+      completion_(false),
+      listening_(false),
       tied_(false)
 {
 }
@@ -36,6 +40,35 @@ void Channel::update()
     loop_->updateChannel(this);
 }
 
+void Channel::setEvents(int events)
+{
+    int oldPollEvents = pollEvents();
+    events_ = events;
+    // edge-triggered skips the update when only the write interest changed
+    if(!edgeTriggered_ || pollEvents() != oldPollEvents)
+    {
+        update();
+    }
+}
+
+int Channel::pollEvents() const
+{
+    if(isNoneEvent())
+    {
+        return events_;
+    }
+    if(exclusive_)
+    {
+        // EPOLLEXCLUSIVE refuses EPOLLPRI
+        return (events_ & ~EPOLLPRI) | EPOLLEXCLUSIVE;
+    }
+    if(!edgeTriggered_)
+    {
+        return events_;
+    }
+    return (events_ & kReadEvent) | kWriteEvent | EPOLLET;
+}
+
 // remove channel(as same that remove the fd)
 void Channel::remove()
 {
@@ -83,7 +116,8 @@ void Channel::handleEventWithGuard(Timestamp receiveTime)
             readCallback_(receiveTime);
         }
     }
-    if(revents_ & (EPOLLOUT))
+    // edge-triggered reports EPOLLOUT even when nothing to write
+    if((revents_ & EPOLLOUT) && isWriting())
     {
         if(writeCallback_) writeCallback_();
     }
@@ -35,19 +35,39 @@ public:
 
     int fd() const {return fd_;}
     int events() const {return events_;}
+    int revents() const {return revents_;}
     void set_revents(int revt) {revents_ = revt;}
 
     // change the event on fd
-    void enableReading(){events_ |= kReadEvent; update();}
-    void disableReading(){events_ &= ~kReadEvent; update();}
-    void enableWriting(){events_ |= kWriteEvent; update();}
-    void disableWriting(){events_ &= ~kWriteEvent; update();}
-    void disableAll() {events_ &= kNoneEvent; update();}
+    void enableReading(){setEvents(events_ | kReadEvent);}
+    void disableReading(){setEvents(events_ & ~kReadEvent);}
+    void enableWriting(){setEvents(events_ | kWriteEvent);}
+    void disableWriting(){setEvents(events_ & ~kWriteEvent);}
+    void disableAll() {setEvents(kNoneEvent);}
 
     // return the state of event
     bool isNoneEvent() const {return events_ == kNoneEvent;}
-    bool isReading() const {return events_ == kReadEvent;}
-    bool isWriting() const {return events_ == kWriteEvent;}
+    bool isReading() const {return events_ & kReadEvent;}
+    bool isWriting() const {return events_ & kWriteEvent;}
+
+    // edge-triggered, call before the channel is added to the poller
+    // EPOLLOUT stays registered, so enable/disableWriting need no epoll_ctl,
+    // the handlers must read/write until EAGAIN
+    void enableEdgeTriggered() {edgeTriggered_ = true;}
+    bool edgeTriggered() const {return edgeTriggered_;}
+    // EPOLLEXCLUSIVE, for a fd several loops wait on such as a shared
+    // listening socket, call before the channel is added to the poller,
+    // the events can't be modified afterwards, only removed
+    void enableExclusive() {exclusive_ = true;}
+    // the events registered in epoll
+    int pollEvents() const;
+    // the poller does the I/O, see Poller::supportsCompletion; listening
+    // channels accept, the others receive and send. call before the
+    // channel is added to the poller
+    void enableCompletion(bool listening = false)
+    {completion_ = true; listening_ = listening;}
+    bool completion() const {return completion_;}
+    bool listening() const {return listening_;}
 
     // use by poller
     int index() {return index_;}
@@ -60,6 +80,7 @@ public:
 private:
 
     void update();
+    void setEvents(int events);
     void handleEventWithGuard(Timestamp receiveTime);
 
     static const int kNoneEvent;
@@ -71,6 +92,10 @@ private:
     int events_;    // intersting things
     int revents_;   // had occured
     int index_;
+    bool edgeTriggered_;
+    bool exclusive_;
+    bool completion_;
+    bool listening_;
 
     // avoid the cicle reference
     std::weak_ptr<void> tie_;
@@ -1,16 +1,22 @@
 #include "Poller.h"
 #include "EPollPoller.h"
+#include "IoUringPoller.h"
+#include "Logger.h"
+
 #include <stdlib.h>
 
 // Dependency inversion principle
 Poller* Poller::newDefaultPoller(EventLoop* loop)
 {
-    if(::getenv("MUDUO_USE_POLL"))
-    {
-        return nullptr;
-    }
-    else
+    if(::getenv("MUDUO_USE_URING"))
     {
-        return new EPollPoller(loop);
+        IoUringPoller *poller = new IoUringPoller(loop);
+        if(poller->ok())
+        {
+            return poller;
+        }
+        LOG_ERROR("io_uring is not available, fall back to epoll\n");
+        delete poller;
     }
+    return new EPollPoller(loop);
 }
\ No newline at end of file
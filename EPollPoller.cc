@@ -114,7 +114,7 @@ void EPollPoller::update(int operation, Channel* channel)
 {
     struct epoll_event event;
     memset(&event, 0, sizeof(event));
-    event.events = channel->events();
+    event.events = channel->pollEvents();
     event.data.ptr = channel;
     int fd = channel->fd();
     if(::epoll_ctl(epoll_fd, operation, fd, &event) < 0)
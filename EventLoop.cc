@@ -2,6 +2,7 @@
 #include "Logger.h"
 #include "Poller.h"
 #include "Channel.h"
+#include "TimerQueue.h"
 
 #include <sys/eventfd.h>
 #include <unistd.h>
@@ -26,12 +27,22 @@ int createEventFd()
 EventLoop::EventLoop()
     : looping_(false),
       quit_(false),
-      callingPendingFunctors_(false),
+      exited_(false),
       threadId_(CurrentThread::tid()),
       poller_(Poller::newDefaultPoller(this)),
+      timerQueue_(new TimerQueue(this)),
       wakeupFd_(createEventFd()),
-      weakupChannel_(new Channel(this, wakeupFd_))
+      weakupChannel_(new Channel(this, wakeupFd_)),
       //currentActiveChannel_(nullptr)
+      callingPendingFunctors_(false),
+      wakeupPending_(false),
+      callingAfterFunctors_(false),
+      functorsQueuedAfter_(false),
+      wakeupCount_(0),
+      connections_(0),
+      pendingConnections_(0),
+      bufferedBytes_(0),
+      lagScaled_(0)
 {
     LOG_DEBUG("EventLoop created %p in thread %d \n", this, threadId_);
     if(t_loopInThisThread)
@@ -60,6 +71,7 @@ EventLoop::~EventLoop()
 void EventLoop::loop()
 {
     looping_ = true;
+    exited_ = false;
     quit_ = false;
     LOG_INFO("EventLoop %p start looping \n", this);
     while(!quit_)
@@ -76,8 +88,22 @@ void EventLoop::loop()
         // subEventLoop 被 mainLoop 唤醒后 需要执行回调函数
         // 下面的回调函数是由 mainLoop指定的
         doPendingFunctors();
+        // a flush can queue functors, e.g. the write complete callback,
+        // they run now instead of after the next poll
+        while(doAfterFunctors())
+        {
+            doPendingFunctors();
+        }
+
+        // lag = lag * 7/8 + busy * 1/8, kept as 8 * lag
+        int64_t busy = Timestamp::now().microSecondsSinceEpoch()
+                     - pollReturnTime_.microSecondsSinceEpoch();
+        int64_t scaled = lagScaled_.load(std::memory_order_relaxed);
+        lagScaled_.store(scaled - scaled / 8 + busy, std::memory_order_relaxed);
     }
     LOG_INFO("EventLoop %p stop looping \n", this);
+    looping_ = false;
+    exited_ = true;
 }
 
 // quit函数可能被其他线程所调用，那么需要唤醒其所在的线程  
@@ -105,14 +131,21 @@ void EventLoop::runInLoop(Functor cb)
 // put cb on queue, weakup the thread of loop
 void EventLoop::queueInLoop(Functor cb)
 {
-    {
-        std::unique_lock<std::mutex> lock(mutex_);
-        pendingFunctors_.emplace_back(cb);
-    }
+    pendingFunctors_.push(std::move(cb));
     // callingPendingFunctors_ == true 表示loop正在执行回调函数，执行完后要再次唤醒
     if(!isInLoopThread() || callingPendingFunctors_)
     {
-        wakeup();
+        // the loop is awake or a wakeup is on the way,
+        // doPendingFunctors will see cb after it clears the flag
+        if(!wakeupPending_.exchange(true, std::memory_order_acq_rel))
+        {
+            wakeup();
+        }
+    }
+    else if(callingAfterFunctors_)
+    {
+        // loop() runs doPendingFunctors again before it polls
+        functorsQueuedAfter_ = true;
     }
 }
 
@@ -125,6 +158,33 @@ void EventLoop::wakeup()
     {
         LOG_ERROR("EventLoop::wakeup() writes write %lu bytes instead of 8\n", n);
     }
+    wakeupCount_.fetch_add(1, std::memory_order_relaxed);
+}
+
+TimerId EventLoop::runAt(Timestamp time, TimerCallback cb)
+{
+    // the queue counts on the monotonic clock, the wall time is taken
+    // as the delay from now
+    int64_t delay = time.microSecondsSinceEpoch() - Timestamp::now().microSecondsSinceEpoch();
+    Timestamp when(Timestamp::monotonic().microSecondsSinceEpoch() + delay);
+    return timerQueue_->addTimer(std::move(cb), when, 0.0);
+}
+
+TimerId EventLoop::runAfter(double delay, TimerCallback cb)
+{
+    Timestamp time(addTime(Timestamp::monotonic(), delay));
+    return timerQueue_->addTimer(std::move(cb), time, 0.0);
+}
+
+TimerId EventLoop::runEvery(double interval, TimerCallback cb)
+{
+    Timestamp time(addTime(Timestamp::monotonic(), interval));
+    return timerQueue_->addTimer(std::move(cb), time, interval);
+}
+
+void EventLoop::cancel(TimerId timerId)
+{
+    timerQueue_->cancel(timerId);
 }
 
 // EventLoop => Poller
@@ -143,23 +203,73 @@ bool EventLoop::hasChannel(Channel *channel)
     return poller_->hasChannel(channel);
 }
 
+bool EventLoop::supportsEdgeTriggered() const
+{
+    return poller_->supportsEdgeTriggered();
+}
+
+bool EventLoop::supportsCompletion() const
+{
+    return poller_->supportsCompletion();
+}
+
+ssize_t EventLoop::takeReceived(Channel *channel, Buffer *buf, size_t maxBytes, int *saveErrno)
+{
+    return poller_->takeReceived(channel, buf, maxBytes, saveErrno);
+}
+
+void EventLoop::submitSend(Channel *channel, Buffer *buf)
+{
+    poller_->submitSend(channel, buf);
+}
+
+ssize_t EventLoop::takeSent(Channel *channel, int *saveErrno)
+{
+    return poller_->takeSent(channel, saveErrno);
+}
+
+int EventLoop::takeAccepted(Channel *channel, int *saveErrno)
+{
+    return poller_->takeAccepted(channel, saveErrno);
+}
+
 
 void EventLoop::doPendingFunctors()
 {
-    std::vector<Functor> functors;
     callingPendingFunctors_ = true;
-    {
-        std::unique_lock<std::mutex> lock(mutex_);
-        functors.swap(pendingFunctors_);
-    }
+    // clear before draining, a producer that comes after has to wake us again
+    wakeupPending_.exchange(false, std::memory_order_acq_rel);
 
-    for(const Functor &functor : functors)
+    pendingFunctors_.consume([](Functor &functor)
     {
         functor(); // 执行当前 loop需要执行的回调操作
-    }
+    });
     callingPendingFunctors_ = false;
 }
 
+void EventLoop::queueAfterFunctors(Functor cb)
+{
+    afterFunctors_.push_back(std::move(cb));
+}
+
+bool EventLoop::doAfterFunctors()
+{
+    callingAfterFunctors_ = true;
+    functorsQueuedAfter_ = false;
+    // what they run may queue more, e.g. a flush completing a write
+    while(!afterFunctors_.empty())
+    {
+        std::vector<Functor> functors;
+        functors.swap(afterFunctors_);
+        for(const Functor &functor : functors)
+        {
+            functor();
+        }
+    }
+    callingAfterFunctors_ = false;
+    return functorsQueuedAfter_;
+}
+
 void EventLoop::handleRead()
 {
     uint64_t one = 1;
@@ -4,14 +4,18 @@
 #include <vector>
 #include <atomic>
 #include <memory>
-#include <mutex>
 
 #include "noncopyable.h"
 #include "Timestamp.h"
 #include "CurrentThread.h"
+#include "Callbacks.h"
+#include "TimerId.h"
+#include "MpscQueue.h"
+#include "LatencyHistogram.h"
 
 class Channel;
 class Poller;
+class TimerQueue;
 
 // Channel and Poller
 class EventLoop
@@ -26,6 +30,11 @@ public:
     void loop();
     // quit the loop of event
     void quit();
+    // inside loop(), false before it starts and once it returned
+    bool looping() const { return looping_; }
+    // loop() returned, nothing queued runs any more until it is entered
+    // again; unlike !looping() it is false before the loop first starts
+    bool exited() const { return exited_; }
 
     Timestamp pollReturnTime() const {return pollReturnTime_;}
     
@@ -33,14 +42,54 @@ public:
     void runInLoop(Functor cb);
     // put cb on queue, weakup the thread of loop
     void queueInLoop(Functor cb);
+    // run cb at the end of this iteration, after the pending functors and
+    // the ones they queued, so it sees everything they produced; loop thread only
+    void queueAfterFunctors(Functor cb);
 
     // use to weakup the thread of loop
     void wakeup();
+    // the write(wakeupFd_) had been done, for statistics
+    int64_t wakeupCount() const { return wakeupCount_; }
+
+    // timers, thread safe
+    // run cb at time, a wall clock time, taken as the delay from now
+    TimerId runAt(Timestamp time, TimerCallback cb);
+    // run cb after delay seconds
+    TimerId runAfter(double delay, TimerCallback cb);
+    // run cb every interval seconds
+    TimerId runEvery(double interval, TimerCallback cb);
+    void cancel(TimerId timerId);
 
     // EventLoop => Poller
     void updateChannel(Channel *channel);
     void removeChannel(Channel *channel);
     bool hasChannel(Channel *channel);
+    bool supportsEdgeTriggered() const;
+    // completion mode I/O, see Poller::supportsCompletion
+    bool supportsCompletion() const;
+    ssize_t takeReceived(Channel *channel, Buffer *buf, size_t maxBytes, int *saveErrno);
+    void submitSend(Channel *channel, Buffer *buf);
+    ssize_t takeSent(Channel *channel, int *saveErrno);
+    int takeAccepted(Channel *channel, int *saveErrno);
+
+    // load of the loop, read by EventLoopThreadPool from other threads
+    // the TcpConnections of this loop, counted from ctor to dtor
+    void addConnections(int delta) { connections_ += delta; }
+    int connections() const { return connections_; }
+    // the accepted sockets queued for this loop, not yet connections, so
+    // a burst of accepts doesn't all go to the loop that looked idlest
+    void addPendingConnections(int delta) { pendingConnections_ += delta; }
+    int pendingConnections() const { return pendingConnections_; }
+    // the bytes its TcpConnections keep in memory, see MemoryBudget
+    // only the loop adds, others read it
+    void addBufferedBytes(int64_t delta)
+    { bufferedBytes_.fetch_add(delta, std::memory_order_relaxed); }
+    int64_t bufferedBytes() const { return bufferedBytes_.load(std::memory_order_relaxed); }
+    // the time an iteration spends past poll(), moving average
+    int64_t lagMicroSeconds() const { return lagScaled_.load(std::memory_order_relaxed) / 8; }
+    // kernel arrival to message callback of the connections with
+    // TcpConnection::setRxTimestamps, added by the loop, read by anyone
+    LatencyHistogram& rxLatency() { return rxLatency_; }
 
     // judge EventLoop whether in thread on that own
     bool isInLoopThread() const {return  threadId_ == CurrentThread::tid();}
@@ -49,13 +98,17 @@ private:
 
     void handleRead();
     void doPendingFunctors();
+    // true if what ran queued functors with queueInLoop
+    bool doAfterFunctors();
 
     using ChannelList = std::vector<Channel*>;
     std::atomic_bool looping_;
     std::atomic_bool quit_; // the sign of quit
+    std::atomic_bool exited_;
     const pid_t threadId_;  // record the thread of currnet loop 
     Timestamp pollReturnTime_;
     std::unique_ptr<Poller> poller_;
+    std::unique_ptr<TimerQueue> timerQueue_;
     
     // mainReactor send acceptor to subReactor
     // to handle channel
@@ -67,7 +120,19 @@ private:
 
     // Identify whether the current loop has a callback function that needs to be executed
     std::atomic_bool callingPendingFunctors_;
-    std::vector<Functor> pendingFunctors_;  // store the callback that need to be called
-    // used to protect the pendingFunctors_
-    std::mutex mutex_;
+    MpscQueue<Functor> pendingFunctors_;  // store the callback that need to be called
+    // a wakeup had been written and doPendingFunctors has not run since,
+    // only the first producer after that pays the write(wakeupFd_)
+    std::atomic_bool wakeupPending_;
+    std::vector<Functor> afterFunctors_;  // only touched in the loop thread
+    bool callingAfterFunctors_;
+    bool functorsQueuedAfter_;
+    std::atomic<int64_t> wakeupCount_;
+
+    std::atomic_int connections_;
+    std::atomic_int pendingConnections_;
+    std::atomic<int64_t> bufferedBytes_;
+    // 8 times the lag, so steps under 8 us are not truncated away
+    std::atomic<int64_t> lagScaled_;
+    LatencyHistogram rxLatency_;
 };
\ No newline at end of file
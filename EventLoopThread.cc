@@ -1,18 +1,31 @@
 #include "EventLoopThread.h"
 #include "EventLoop.h"
+#include "Logger.h"
+
+#include <errno.h>
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 EventLoopThread::EventLoopThread(const ThreadInitCallback& cb,
                             const std::string& name)
     : loop_(NULL),
       exiting_(false),
       thread_(std::bind(&EventLoopThread::threadFunc, this), name),
-      callback_(cb)
+      callback_(cb),
+      cpu_(-1)
 {
 }
 
 EventLoopThread::~EventLoopThread()
 {
-    exiting_ = true;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        exiting_ = true;
+    }
+    cond_.notify_all();
     if(loop_ != nullptr)
     {
         loop_->quit();
@@ -39,6 +52,11 @@ EventLoop* EventLoopThread::startLoop()
 // 这是上面创建的新线程所执行的线程函数
 void EventLoopThread::threadFunc()
 {
+    // pinned first, so the loop's own memory is already node local
+    if(cpu_ >= 0)
+    {
+        pinToCpu();
+    }
     // one loop per thread
     EventLoop loop;
     if(callback_){
@@ -52,6 +70,32 @@ void EventLoopThread::threadFunc()
     }
 
     loop.loop();
-    std::lock_guard<std::mutex> lock(mutex_);
+    // a loop quit early stays valid until the thread object goes, the
+    // pool hands out its pointer and EventLoop::exited() is read on it
+    std::unique_lock<std::mutex> lock(mutex_);
+    while(!exiting_)
+    {
+        cond_.wait(lock);
+    }
     loop_ = NULL;
-}
\ No newline at end of file
+}
+
+void EventLoopThread::pinToCpu()
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu_, &set);
+    int err = ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set);
+    if(err != 0)
+    {
+        LOG_ERROR("EventLoopThread::pinToCpu cpu=%d err:%d \n", cpu_, err);
+        return;
+    }
+    // pages first touched by this thread come from the node of its cpu,
+    // also when the process was started with an interleave policy;
+    // the BufferPool is per thread, so the buffers stay local
+    if(::syscall(SYS_set_mempolicy, MPOL_LOCAL, nullptr, 0) < 0)
+    {
+        LOG_ERROR("EventLoopThread::pinToCpu set_mempolicy err:%d \n", errno);
+    }
+}
@@ -16,13 +16,19 @@ public:
                 const std::string& name = std::string());
     ~EventLoopThread();
 
+    // run the loop on this cpu only, memory allocated by the thread
+    // comes from its NUMA node, call before startLoop
+    void setCpu(int cpu) { cpu_ = cpu; }
+
     EventLoop* startLoop();
 private:
     void threadFunc();
+    void pinToCpu();
     EventLoop* loop_;
     bool exiting_;
     Thread thread_;
     std::mutex mutex_;
     std::condition_variable cond_;
     ThreadInitCallback callback_;
+    int cpu_;   // -1 not pinned
 };
\ No newline at end of file
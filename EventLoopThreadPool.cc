@@ -2,11 +2,26 @@
 #include "EventLoop.h"
 #include "EventLoopThread.h"
 
+#include <algorithm>
+#include <sched.h>
+#include <set>
+#include <stdio.h>
+
+// splitmix64, spreads close keys such as neighbouring addresses
+static uint64_t mixHash(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
 EventLoopThreadPool::EventLoopThreadPool(EventLoop* baseLoop, const std::string& nameArg)
     : baseLoop_(baseLoop),
       name_(nameArg),
       started_(false),
       numThreads_(0),
+      strategy_(kRoundRobin),
       next_(0)
 {
 }
@@ -22,32 +37,87 @@ void EventLoopThreadPool::start(const ThreadInitCallback& cb)
     started_ = true;
     for(int i = 0; i < numThreads_; ++i)
     {
-        char buf[name_.size() + 32] = {0,};
+        char buf[name_.size() + 32];
         snprintf(buf, sizeof(buf), "%s%d", name_.c_str(), i);
         EventLoopThread* t = new EventLoopThread(cb, buf);
+        t->setCpu(cpuOf(i));
         threads_.push_back(std::unique_ptr<EventLoopThread>(t));
         loops_.push_back(t->startLoop());   // 创建新线程，绑定一个新的EventLoop
+        for(int v = 0; v < kVirtualNodes; ++v)
+        {
+            ring_.push_back(std::make_pair(mixHash((static_cast<uint64_t>(i) << 32) | v), loops_.back()));
+        }
     }
+    std::sort(ring_.begin(), ring_.end());
     if( numThreads_ == 0 && cb)
     {
         cb(baseLoop_);
     }
 }
 
-EventLoop* EventLoopThreadPool::getNextLoop()
+EventLoop* EventLoopThreadPool::getNextLoop(size_t hashCode)
+{
+    if(loops_.empty())
+    {
+        return baseLoop_;
+    }
+    switch(strategy_)
+    {
+    case kLeastConnections:
+    case kLeastLag:
+        return leastLoaded();
+    case kConsistentHash:
+        return getLoopForHash(hashCode);
+    default:
+        return nextRoundRobin();
+    }
+}
+
+EventLoop* EventLoopThreadPool::nextRoundRobin()
+{
+    // rounds-robin
+    EventLoop *loop = loops_[next_];
+    ++next_;
+    if(static_cast<size_t>(next_) >= loops_.size())
+    {
+        next_ = 0;
+    }
+    return loop;
+}
+
+EventLoop* EventLoopThreadPool::leastLoaded()
 {
-    EventLoop* loop = baseLoop_;
-    if(!loops_.empty())
+    // start at the round-robin position so equal loads still spread
+    size_t start = next_;
+    nextRoundRobin();
+    EventLoop *best = nullptr;
+    int64_t bestLoad = 0;
+    for(size_t i = 0; i < loops_.size(); ++i)
     {
-        // rounds-robin
-        loop = loops_[next_];
-        ++next_;
-        if(static_cast<size_t>(next_) >= loops_.size())
+        EventLoop *loop = loops_[(start + i) % loops_.size()];
+        int64_t load = strategy_ == kLeastConnections
+                           ? loop->connections() + loop->pendingConnections()
+                           : loop->lagMicroSeconds();
+        if(best == nullptr || load < bestLoad)
         {
-            next_ = 0;
+            best = loop;
+            bestLoad = load;
         }
     }
-    return loop;
+    return best;
+}
+
+EventLoop* EventLoopThreadPool::getLoopForHash(size_t hashCode)
+{
+    if(ring_.empty())
+    {
+        return loops_.empty() ? baseLoop_ : loops_[hashCode % loops_.size()];
+    }
+    std::pair<uint64_t, EventLoop*> key(mixHash(hashCode), nullptr);
+    auto it = std::lower_bound(ring_.begin(), ring_.end(), key,
+        [](const std::pair<uint64_t, EventLoop*> &a, const std::pair<uint64_t, EventLoop*> &b)
+        { return a.first < b.first; });
+    return it == ring_.end() ? ring_.front().second : it->second;
 }
 
 
@@ -61,4 +131,58 @@ std::vector<EventLoop*> EventLoopThreadPool::getAllLoops()
     {
         return loops_;
     }
-}
\ No newline at end of file
+}
+
+EventLoop* EventLoopThreadPool::getLoopForCpu(int cpu) const
+{
+    for(size_t i = 0; i < loops_.size(); ++i)
+    {
+        if(cpuOf(i) == cpu)
+        {
+            return loops_[i];
+        }
+    }
+    return nullptr;
+}
+
+static int readTopology(int cpu, const char *name)
+{
+    char path[128];
+    snprintf(path, sizeof path, "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+    FILE *fp = ::fopen(path, "r");
+    int value = -1;
+    if(fp != nullptr)
+    {
+        if(::fscanf(fp, "%d", &value) != 1)
+        {
+            value = -1;
+        }
+        ::fclose(fp);
+    }
+    return value;
+}
+
+std::vector<int> EventLoopThreadPool::physicalCoreCpus()
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    ::sched_getaffinity(0, sizeof(allowed), &allowed);
+
+    std::vector<int> cpus;
+    std::set<std::pair<int, int>> cores;  // (package, core)
+    for(int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    {
+        if(!CPU_ISSET(cpu, &allowed))
+        {
+            continue;
+        }
+        // hyperthread siblings share the pair, keep the first of them
+        std::pair<int, int> core(readTopology(cpu, "physical_package_id"),
+                                 readTopology(cpu, "core_id"));
+        if(core.second < 0 || cores.insert(core).second)
+        {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
@@ -2,6 +2,9 @@
 
 #include <functional>
 #include <memory>
+#include <stdint.h>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "noncopyable.h"
@@ -9,9 +12,6 @@
 class EventLoop;
 class EventLoopThread;
 
-class EventLoop;
-class EventLoopThread;
-
 class EventLoopThreadPool : noncopyable
 {
 public:
@@ -20,16 +20,39 @@ public:
     EventLoopThreadPool(EventLoop* baseLoop, const std::string& nameArg);
     ~EventLoopThreadPool();
 
+    // how getNextLoop() picks a loop
+    enum Strategy
+    {
+        kRoundRobin,
+        kLeastConnections,  // EventLoop::connections()
+        kLeastLag,          // EventLoop::lagMicroSeconds()
+        kConsistentHash     // getNextLoop(hashCode), same key same loop
+    };
+
     void setThreadNum(int numThreads) { numThreads_ = numThreads; }
+    void setStrategy(Strategy strategy) { strategy_ = strategy; }
+    // pin sub loop i to cpus[i % cpus.size()], call before start()
+    void setCpuList(const std::vector<int>& cpus) { cpus_ = cpus; }
+    // one cpu of every physical core the process may run on,
+    // core by core, for setCpuList
+    static std::vector<int> physicalCoreCpus();
     void start(const ThreadInitCallback& cb = ThreadInitCallback());
 
-    // valid after calling start(), round-robin
-    EventLoop* getNextLoop();
+    // valid after calling start(), by the strategy, ties go round-robin
+    // hashCode is only used by kConsistentHash
+    EventLoop* getNextLoop(size_t hashCode = 0);
 
-    // EventLoop* getLoopForHash(size_t hashCode);
+    // consistent hashing, adding a loop only moves the keys it takes over
+    EventLoop* getLoopForHash(size_t hashCode);
 
     std::vector<EventLoop*> getAllLoops();
 
+    // the sub loop pinned to the cpu, nullptr if none
+    EventLoop* getLoopForCpu(int cpu) const;
+    // the cpu sub loop i is pinned to, -1 if not pinned
+    int cpuOf(size_t i) const
+    { return cpus_.empty() ? -1 : cpus_[i % cpus_.size()]; }
+
     bool started() const
     { return started_; }
 
@@ -37,11 +60,21 @@ public:
     { return name_; }
 
 private:
+    // the next loop of round-robin, where the least-* scans start
+    EventLoop* nextRoundRobin();
+    EventLoop* leastLoaded();
+
+    static const int kVirtualNodes = 160;   // per loop on the hash ring
+
     EventLoop* baseLoop_;
     std::string name_;
     bool started_;
     int numThreads_;
+    Strategy strategy_;
     int next_;
     std::vector<std::unique_ptr<EventLoopThread>> threads_;
     std::vector<EventLoop*> loops_;
+    std::vector<int> cpus_;
+    // sorted by the point
+    std::vector<std::pair<uint64_t, EventLoop*>> ring_;
 };
\ No newline at end of file
@@ -0,0 +1,1050 @@
+#include "IoUringPoller.h"
+#include "Logger.h"
+#include "Channel.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Channel::index of the io_uring backend:
+// -1 had not been added, 0 added but no poll in flight,
+// > 0 the generation of the poll in flight, carried in user_data
+constexpr int kNew = -1;
+constexpr int kDisarmed = 0;
+
+// user_data of the POLL_REMOVE and ASYNC_CANCEL requests, its completion is ignored
+constexpr uint64_t kIgnoreData = ~0ULL;
+// user_data of the requests setupRing tries the kernel with
+constexpr uint64_t kProbeData = ~1ULL;
+// user_data of the completion mode requests: the Completion, the Op in
+// the low bits; a poll's generation never reaches the top bit
+constexpr uint64_t kCompletionTag = 1ULL << 63;
+constexpr uint64_t kOpMask = 3;
+
+static uint64_t pollData(int fd, int generation)
+{
+    return (static_cast<uint64_t>(generation) << 32) | static_cast<uint32_t>(fd);
+}
+
+IoUringPoller::Completion::Completion(Channel *ch, int fdArg, bool listeningArg)
+    : channel(ch),
+      fd(fdArg),
+      listening(listeningArg),
+      inFlight(0),
+      round(0),
+      receiving(false),
+      cancelling(false),
+      sending(false),
+      eof(false),
+      recvError(0),
+      acceptError(0),
+      sent(0),
+      sendError(0)
+{
+    memset(&msg, 0, sizeof(msg));
+}
+
+static uint64_t completionData(const void *completion, int op)
+{
+    return kCompletionTag | reinterpret_cast<uintptr_t>(completion) | static_cast<uint64_t>(op);
+}
+
+IoUringPoller::IoUringPoller(EventLoop* loop)
+    : Poller(loop),
+      ringFd_(-1),
+      sqRing_(MAP_FAILED),
+      sqRingSize_(0),
+      cqRing_(MAP_FAILED),
+      cqRingSize_(0),
+      sqes_(static_cast<struct io_uring_sqe*>(MAP_FAILED)),
+      sqLocalTail_(0),
+      toSubmit_(0),
+      nextGeneration_(1),
+      completionOk_(false),
+      bufRing_(nullptr),
+      recvBuffers_(nullptr),
+      bufTail_(0),
+      round_(0),
+      inFlightOps_(0)
+{
+    if(!setupRing())
+    {
+        destroyRing();
+    }
+}
+
+IoUringPoller::~IoUringPoller()
+{
+    for(auto &item : completions_)
+    {
+        release(item.second);
+    }
+    completions_.clear();
+    if(ringFd_ >= 0 && inFlightOps_ > 0)
+    {
+        // the kernel may still write into the buffers or read the output,
+        // wait for the cancelled requests
+        ChannelList ignored;
+        for(int i = 0; i < 50 && inFlightOps_ > 0; ++i)
+        {
+            enter(1, 100);
+            reapCompletions(&ignored);
+        }
+        if(inFlightOps_ > 0)
+        {
+            LOG_ERROR("io_uring %d requests did not complete\n", inFlightOps_);
+        }
+    }
+    for(Completion *c : retired_)
+    {
+        delete c;
+    }
+    if(ringFd_ >= 0 && toSubmit_ > 0)
+    {
+        // a poll holds its file, the cancels of the removed channels let a
+        // closed listening socket go now rather than with the ring's teardown
+        enter(0, 0);
+    }
+    destroyRing();
+}
+
+bool IoUringPoller::setupRing()
+{
+    memset(&params_, 0, sizeof(params_));
+    ringFd_ = static_cast<int>(::syscall(__NR_io_uring_setup, kRingEntries, &params_));
+    if(ringFd_ < 0)
+    {
+        LOG_ERROR("io_uring_setup error:%d\n", errno);
+        return false;
+    }
+    // the timeout of io_uring_enter needs IORING_ENTER_EXT_ARG
+    if(!(params_.features & IORING_FEAT_EXT_ARG) || !(params_.features & IORING_FEAT_NODROP))
+    {
+        LOG_ERROR("io_uring features %x are too old\n", params_.features);
+        return false;
+    }
+
+    sqRingSize_ = params_.sq_off.array + params_.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params_.cq_off.cqes + params_.cq_entries * sizeof(struct io_uring_cqe);
+    const bool singleMmap = params_.features & IORING_FEAT_SINGLE_MMAP;
+    if(singleMmap)
+    {
+        sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+    }
+
+    sqRing_ = ::mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQ_RING);
+    if(sqRing_ == MAP_FAILED)
+    {
+        LOG_ERROR("io_uring mmap sq ring error:%d\n", errno);
+        return false;
+    }
+    if(singleMmap)
+    {
+        cqRing_ = sqRing_;
+    }
+    else
+    {
+        cqRing_ = ::mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_CQ_RING);
+        if(cqRing_ == MAP_FAILED)
+        {
+            LOG_ERROR("io_uring mmap cq ring error:%d\n", errno);
+            return false;
+        }
+    }
+    sqes_ = static_cast<struct io_uring_sqe*>(::mmap(nullptr,
+                     params_.sq_entries * sizeof(struct io_uring_sqe),
+                     PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     ringFd_, IORING_OFF_SQES));
+    if(sqes_ == MAP_FAILED)
+    {
+        LOG_ERROR("io_uring mmap sqes error:%d\n", errno);
+        return false;
+    }
+
+    char *sq = static_cast<char*>(sqRing_);
+    sqHead_ = reinterpret_cast<unsigned*>(sq + params_.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned*>(sq + params_.sq_off.tail);
+    sqMask_ = reinterpret_cast<unsigned*>(sq + params_.sq_off.ring_mask);
+    sqArray_ = reinterpret_cast<unsigned*>(sq + params_.sq_off.array);
+    sqLocalTail_ = *sqTail_;
+
+    char *cq = static_cast<char*>(cqRing_);
+    cqHead_ = reinterpret_cast<unsigned*>(cq + params_.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned*>(cq + params_.cq_off.tail);
+    cqMask_ = reinterpret_cast<unsigned*>(cq + params_.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + params_.cq_off.cqes);
+
+    std::vector<bool> supported;
+    if(!probeOpcodes(&supported) || !supported[IORING_OP_POLL_ADD]
+       || !supported[IORING_OP_POLL_REMOVE])
+    {
+        LOG_ERROR("io_uring has no IORING_OP_POLL_ADD\n");
+        return false;
+    }
+
+    // edge-triggered channels get multishot polls
+    int probeFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(probeFd < 0)
+    {
+        LOG_ERROR("io_uring probe eventfd error:%d\n", errno);
+        return false;
+    }
+    struct io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = probeFd;
+    sqe->poll32_events = EPOLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = kProbeData;
+    bool multishot = probeStaysArmed();
+    ::close(probeFd);
+    if(!multishot)
+    {
+        LOG_ERROR("io_uring has no multishot poll\n");
+        return false;
+    }
+
+    // the completion mode is optional, the readiness backend works without it
+    completionOk_ = supported[IORING_OP_RECV] && supported[IORING_OP_SENDMSG]
+                    && supported[IORING_OP_ACCEPT] && supported[IORING_OP_ASYNC_CANCEL]
+                    && setupBufferRing() && probeCompletion();
+    return true;
+}
+
+void IoUringPoller::destroyRing()
+{
+    if(sqes_ != MAP_FAILED)
+    {
+        ::munmap(sqes_, params_.sq_entries * sizeof(struct io_uring_sqe));
+        sqes_ = static_cast<struct io_uring_sqe*>(MAP_FAILED);
+    }
+    if(cqRing_ != MAP_FAILED && cqRing_ != sqRing_)
+    {
+        ::munmap(cqRing_, cqRingSize_);
+    }
+    cqRing_ = MAP_FAILED;
+    if(sqRing_ != MAP_FAILED)
+    {
+        ::munmap(sqRing_, sqRingSize_);
+        sqRing_ = MAP_FAILED;
+    }
+    if(ringFd_ >= 0)
+    {
+        ::close(ringFd_);
+        ringFd_ = -1;
+    }
+    // after the ring, which unregisters them
+    if(bufRing_ != nullptr)
+    {
+        ::munmap(bufRing_, kRecvBuffers * sizeof(struct io_uring_buf));
+        bufRing_ = nullptr;
+    }
+    if(recvBuffers_ != nullptr)
+    {
+        ::munmap(recvBuffers_, kRecvBuffers * kRecvBufferSize);
+        recvBuffers_ = nullptr;
+    }
+    completionOk_ = false;
+}
+
+bool IoUringPoller::probeOpcodes(std::vector<bool> *supported)
+{
+    std::vector<char> mem(sizeof(struct io_uring_probe)
+                          + IORING_OP_LAST * sizeof(struct io_uring_probe_op));
+    struct io_uring_probe *probe = reinterpret_cast<struct io_uring_probe*>(mem.data());
+    if(::syscall(__NR_io_uring_register, ringFd_, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) < 0)
+    {
+        LOG_ERROR("io_uring probe error:%d\n", errno);
+        return false;
+    }
+    supported->assign(IORING_OP_LAST, false);
+    for(int i = 0; i < probe->ops_len && i < IORING_OP_LAST; ++i)
+    {
+        if(probe->ops[i].op < IORING_OP_LAST)
+        {
+            (*supported)[probe->ops[i].op] = probe->ops[i].flags & IO_URING_OP_SUPPORTED;
+        }
+    }
+    return true;
+}
+
+bool IoUringPoller::probeStaysArmed()
+{
+    enter(0, 0);
+    if(reapProbe())
+    {
+        return false;
+    }
+    struct io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = kProbeData;
+    sqe->user_data = kIgnoreData;
+    // the cancelled request completes before its fd is closed
+    for(int i = 0; i < 10; ++i)
+    {
+        enter(1, 100);
+        if(reapProbe())
+        {
+            break;
+        }
+    }
+    return true;
+}
+
+bool IoUringPoller::reapProbe()
+{
+    bool found = false;
+    unsigned head = *cqHead_;
+    unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    for(; head != tail; ++head)
+    {
+        if(cqes_[head & *cqMask_].user_data == kProbeData)
+        {
+            found = true;
+        }
+    }
+    __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+    return found;
+}
+
+bool IoUringPoller::setupBufferRing()
+{
+    void *ring = ::mmap(nullptr, kRecvBuffers * sizeof(struct io_uring_buf),
+                        PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    void *buffers = ::mmap(nullptr, kRecvBuffers * kRecvBufferSize,
+                           PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(ring == MAP_FAILED || buffers == MAP_FAILED)
+    {
+        LOG_ERROR("io_uring mmap recv buffers error:%d\n", errno);
+        if(ring != MAP_FAILED)
+        {
+            ::munmap(ring, kRecvBuffers * sizeof(struct io_uring_buf));
+        }
+        if(buffers != MAP_FAILED)
+        {
+            ::munmap(buffers, kRecvBuffers * kRecvBufferSize);
+        }
+        return false;
+    }
+    bufRing_ = static_cast<struct io_uring_buf*>(ring);
+    recvBuffers_ = static_cast<char*>(buffers);
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+    reg.ring_entries = kRecvBuffers;
+    reg.bgid = kBufferGroup;
+    if(::syscall(__NR_io_uring_register, ringFd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    {
+        LOG_ERROR("io_uring buffer ring error:%d, no completion mode\n", errno);
+        return false;
+    }
+    for(unsigned bid = 0; bid < kRecvBuffers; ++bid)
+    {
+        recycleBuffer(static_cast<uint16_t>(bid));
+    }
+    return true;
+}
+
+// a multishot recv waiting on an idle socket stays armed, multishot accept
+// came a release before it and is taken to work with it
+bool IoUringPoller::probeCompletion()
+{
+    int fds[2];
+    if(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) < 0)
+    {
+        LOG_ERROR("io_uring probe socketpair error:%d\n", errno);
+        return false;
+    }
+    struct io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fds[0];
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = kBufferGroup;
+    sqe->user_data = kProbeData;
+    bool multishot = probeStaysArmed();
+    ::close(fds[0]);
+    ::close(fds[1]);
+    if(!multishot)
+    {
+        LOG_ERROR("io_uring has no multishot recv, no completion mode\n");
+    }
+    return multishot;
+}
+
+Timestamp IoUringPoller::poll(int timeoutMs, ChannelList* activeChannels)
+{
+    ++round_;
+    rearmFired();
+    for(int fd : resync_)
+    {
+        auto it = completions_.find(fd);
+        if(it != completions_.end())
+        {
+            syncCompletion(it->second);
+        }
+    }
+    resync_.clear();
+
+    // what the handlers left is reported again, without waiting
+    bool pending = false;
+    if(!ready_.empty())
+    {
+        std::vector<int> ready;
+        ready.swap(ready_);
+        for(int fd : ready)
+        {
+            auto it = completions_.find(fd);
+            if(it != completions_.end() && it->second->channel->isReading()
+               && hasPendingRead(it->second))
+            {
+                reportActive(it->second, EPOLLIN, activeChannels);
+                pending = true;
+            }
+        }
+    }
+
+    int ret = enter(1, pending ? 0 : timeoutMs);
+    int saveErrno = errno;
+    Timestamp now(Timestamp::now());
+    if(ret < 0 && saveErrno != ETIME && saveErrno != EINTR)
+    {
+        errno = saveErrno;
+        LOG_ERROR("IoUringPoller::poll() err \n");
+    }
+
+    reapCompletions(activeChannels);
+    return now;
+}
+
+// EventLoop -> Channel::update -> Poller::updateChannel
+// no syscall here, the sqes are submitted by the next poll()
+void IoUringPoller::updateChannel(Channel* channel)
+{
+    const int index = channel->index();
+    const int fd = channel->fd();
+
+    if(index == kNew)
+    {
+        channels_[fd] = channel;
+        if(channel->completion())
+        {
+            completions_[fd] = new Completion(channel, fd, channel->listening());
+        }
+    }
+    else if(index > kDisarmed)
+    {
+        // the events changed, the poll in flight is replaced by a new generation
+        cancelPoll(fd, index);
+    }
+
+    uint32_t mask = pollMask(channel);
+    if(mask == 0)
+    {
+        channel->set_index(kDisarmed);
+    }
+    else
+    {
+        int generation = nextGeneration_;
+        nextGeneration_ = nextGeneration_ == INT32_MAX ? 1 : nextGeneration_ + 1;
+        channel->set_index(generation);
+        armPoll(fd, generation, mask, channel->edgeTriggered());
+    }
+
+    if(channel->completion())
+    {
+        syncCompletion(completionOf(channel));
+    }
+}
+
+void IoUringPoller::removeChannel(Channel* channel)
+{
+    int fd = channel->fd();
+    channels_.erase(fd);
+
+    LOG_INFO("func=%s => fd=%d\n", __FUNCTION__, fd);
+
+    const int index = channel->index();
+    if(index > kDisarmed)
+    {
+        cancelPoll(fd, index);
+    }
+    channel->set_index(kNew);
+
+    auto it = completions_.find(fd);
+    if(it != completions_.end())
+    {
+        Completion *c = it->second;
+        completions_.erase(it);
+        release(c);
+    }
+}
+
+ssize_t IoUringPoller::takeReceived(Channel* channel, Buffer* buf, size_t maxBytes, int* saveErrno)
+{
+    Completion *c = completionOf(channel);
+    if(c == nullptr)
+    {
+        *saveErrno = EBADF;
+        return -1;
+    }
+    size_t n = std::min(c->received.readableBytes(), maxBytes);
+    if(n > 0)
+    {
+        if(n == c->received.readableBytes())
+        {
+            buf->append(&c->received);
+        }
+        else
+        {
+            buf->append(c->received.peek(n), n);
+            c->received.retrieve(n);
+        }
+        if(!c->receiving)
+        {
+            resync_.push_back(c->fd);   // stopped at kMaxReceived
+        }
+        return static_cast<ssize_t>(n);
+    }
+    if(c->eof)
+    {
+        return 0;
+    }
+    *saveErrno = c->recvError != 0 ? c->recvError : EAGAIN;
+    return -1;
+}
+
+void IoUringPoller::submitSend(Channel* channel, Buffer* buf)
+{
+    Completion *c = completionOf(channel);
+    if(c == nullptr || c->sendError != 0)
+    {
+        // the connection learns of the error from takeSent
+        buf->retrieveAll();
+        return;
+    }
+    c->output.append(buf);
+    if(!c->sending)
+    {
+        armSend(c);
+        if(channel->index() > kDisarmed)
+        {
+            // the ring reports the send, an EPOLLOUT would only wake us
+            cancelPoll(channel->fd(), channel->index());
+            channel->set_index(kDisarmed);
+        }
+    }
+}
+
+ssize_t IoUringPoller::takeSent(Channel* channel, int* saveErrno)
+{
+    Completion *c = completionOf(channel);
+    if(c == nullptr)
+    {
+        *saveErrno = EBADF;
+        return -1;
+    }
+    if(c->sendError != 0)
+    {
+        // what was sent before it is dropped with the rest
+        *saveErrno = c->sendError;
+        c->sendError = 0;
+        c->sent = 0;
+        return -1;
+    }
+    if(c->sent > 0)
+    {
+        ssize_t n = static_cast<ssize_t>(c->sent);
+        c->sent = 0;
+        return n;
+    }
+    *saveErrno = EAGAIN;
+    return -1;
+}
+
+int IoUringPoller::takeAccepted(Channel* channel, int* saveErrno)
+{
+    Completion *c = completionOf(channel);
+    if(c == nullptr)
+    {
+        *saveErrno = EBADF;
+        return -1;
+    }
+    if(!c->accepted.empty())
+    {
+        int connfd = c->accepted.front();
+        c->accepted.pop_front();
+        return connfd;
+    }
+    if(c->acceptError != 0)
+    {
+        // the multishot accept ended on it, armed again by the next poll()
+        *saveErrno = c->acceptError;
+        c->acceptError = 0;
+        resync_.push_back(c->fd);
+        return -1;
+    }
+    *saveErrno = EAGAIN;
+    return -1;
+}
+
+struct io_uring_sqe* IoUringPoller::getSqe()
+{
+    unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    if(sqLocalTail_ - head >= params_.sq_entries)
+    {
+        // the sq ring is full, submit without waiting
+        enter(0, 0);
+    }
+    unsigned idx = sqLocalTail_ & *sqMask_;
+    struct io_uring_sqe *sqe = &sqes_[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqArray_[idx] = idx;
+    ++sqLocalTail_;
+    ++toSubmit_;
+    return sqe;
+}
+
+int IoUringPoller::enter(unsigned minComplete, int timeoutMs)
+{
+    __atomic_store_n(sqTail_, sqLocalTail_, __ATOMIC_RELEASE);
+
+    unsigned flags = 0;
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    memset(&arg, 0, sizeof(arg));
+    if(minComplete > 0)
+    {
+        flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        if(timeoutMs >= 0)
+        {
+            ts.tv_sec = timeoutMs / 1000;
+            ts.tv_nsec = (timeoutMs % 1000) * 1000 * 1000;
+            arg.ts = reinterpret_cast<uint64_t>(&ts);
+        }
+    }
+
+    int ret = static_cast<int>(::syscall(__NR_io_uring_enter, ringFd_, toSubmit_, minComplete,
+                                         flags, minComplete > 0 ? &arg : nullptr,
+                                         minComplete > 0 ? sizeof(arg) : 0));
+    if(ret >= 0)
+    {
+        toSubmit_ -= std::min(toSubmit_, static_cast<unsigned>(ret));
+    }
+    return ret;
+}
+
+// the poll mask of a channel: Channel::pollEvents() always asks an
+// edge-triggered channel for EPOLLOUT, it gets a multishot poll which
+// completes once per wakeup like EPOLLET, EPOLLET and EPOLLEXCLUSIVE
+// themselves are left to epoll. a completion channel is polled only for
+// the EPOLLOUT of the output the ring doesn't send
+uint32_t IoUringPoller::pollMask(const Channel* channel) const
+{
+    if(channel->completion())
+    {
+        const Completion *c = completionOf(channel);
+        return channel->isWriting() && c != nullptr && !c->sending ? EPOLLOUT : 0;
+    }
+    return static_cast<uint32_t>(channel->pollEvents() & ~(EPOLLET | EPOLLEXCLUSIVE));
+}
+
+void IoUringPoller::armPoll(int fd, int generation, uint32_t events, bool multishot)
+{
+    struct io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    sqe->len = multishot ? IORING_POLL_ADD_MULTI : 0;
+    sqe->user_data = pollData(fd, generation);
+}
+
+void IoUringPoller::cancelPoll(int fd, int generation)
+{
+    struct io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = pollData(fd, generation);
+    sqe->user_data = kIgnoreData;
+}
+
+// one-shot polls keep the level-triggered semantics of EPollPoller:
+// an fd that is still readable completes again right after re-arming,
+// a multishot poll is only re-armed when the kernel ended it
+void IoUringPoller::rearmFired()
+{
+    for(const auto &item : fired_)
+    {
+        ChannelMap::const_iterator it = channels_.find(item.first);
+        if(it == channels_.end())
+        {
+            continue;
+        }
+        Channel *channel = it->second;
+        // updateChannel had armed a new generation, or disarmed it
+        if(channel->index() == item.second)
+        {
+            uint32_t mask = pollMask(channel);
+            if(mask != 0)
+            {
+                armPoll(item.first, item.second, mask, channel->edgeTriggered());
+            }
+            else
+            {
+                channel->set_index(kDisarmed);
+            }
+        }
+    }
+    fired_.clear();
+}
+
+void IoUringPoller::reapCompletions(ChannelList* activeChannels)
+{
+    unsigned head = *cqHead_;
+    unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    for(; head != tail; ++head)
+    {
+        const struct io_uring_cqe &cqe = cqes_[head & *cqMask_];
+        if(cqe.user_data == kIgnoreData || cqe.user_data == kProbeData)
+        {
+            continue;
+        }
+        if(cqe.user_data & kCompletionTag)
+        {
+            handleCompletion(cqe, activeChannels);
+            continue;
+        }
+        int fd = static_cast<int>(cqe.user_data & 0xffffffff);
+        int generation = static_cast<int>(cqe.user_data >> 32);
+        ChannelMap::const_iterator it = channels_.find(fd);
+        if(it == channels_.end() || it->second->index() != generation)
+        {
+            continue;   // a replaced or removed poll
+        }
+
+        Channel *channel = it->second;
+        if(!(cqe.flags & IORING_CQE_F_MORE))
+        {
+            fired_.push_back(std::make_pair(fd, generation));
+        }
+        if(cqe.res < 0)
+        {
+            LOG_ERROR("io_uring poll fd=%d err:%d\n", fd, -cqe.res);
+            continue;
+        }
+        if(channel->completion())
+        {
+            reportActive(completionOf(channel), cqe.res, activeChannels);
+            continue;
+        }
+        if(channel->edgeTriggered())
+        {
+            // a multishot poll may complete several times in one round
+            ChannelList::iterator dup = std::find(activeChannels->begin(),
+                                                  activeChannels->end(), channel);
+            if(dup != activeChannels->end())
+            {
+                channel->set_revents(channel->revents() | cqe.res);
+                continue;
+            }
+        }
+        channel->set_revents(cqe.res);
+        activeChannels->push_back(channel); // return poller to EventLoop
+    }
+    __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+}
+
+IoUringPoller::Completion* IoUringPoller::completionOf(const Channel* channel) const
+{
+    auto it = completions_.find(channel->fd());
+    return it != completions_.end() && it->second->channel == channel ? it->second : nullptr;
+}
+
+void IoUringPoller::syncCompletion(Completion* c)
+{
+    Channel *channel = c->channel;
+    if(channel->isReading())
+    {
+        bool stopped = c->listening ? c->acceptError != 0
+                                    : c->eof || c->recvError != 0 || c->received.readableBytes() >= kMaxReceived;
+        if(!c->receiving && !stopped)
+        {
+            armReceive(c);
+        }
+        if(hasPendingRead(c))
+        {
+            ready_.push_back(c->fd);
+        }
+    }
+    else if(c->receiving && !c->cancelling)
+    {
+        // what still arrives is kept until reading starts again
+        cancelOp(c, c->listening ? kAcceptOp : kRecvOp);
+    }
+
+    if(channel->index() == kDisarmed)
+    {
+        uint32_t mask = pollMask(channel);
+        if(mask != 0)
+        {
+            int generation = nextGeneration_;
+            nextGeneration_ = nextGeneration_ == INT32_MAX ? 1 : nextGeneration_ + 1;
+            channel->set_index(generation);
+            armPoll(c->fd, generation, mask, false);
+        }
+    }
+}
+
+void IoUringPoller::armReceive(Completion* c)
+{
+    struct io_uring_sqe *sqe = getSqe();
+    sqe->fd = c->fd;
+    if(c->listening)
+    {
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+        sqe->user_data = completionData(c, kAcceptOp);
+    }
+    else
+    {
+        sqe->opcode = IORING_OP_RECV;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = kBufferGroup;
+        sqe->user_data = completionData(c, kRecvOp);
+    }
+    c->receiving = true;
+    ++c->inFlight;
+    ++inFlightOps_;
+}
+
+// one sendmsg of the first chunks of the output, the rest goes when it completes
+void IoUringPoller::armSend(Completion* c)
+{
+    c->iov.clear();
+    c->output.forEachChunk([c](const char *data, size_t len)
+    {
+        if(c->iov.size() < static_cast<size_t>(kMaxSendIov))
+        {
+            struct iovec vec;
+            vec.iov_base = const_cast<char*>(data);
+            vec.iov_len = len;
+            c->iov.push_back(vec);
+        }
+    });
+    memset(&c->msg, 0, sizeof(c->msg));
+    c->msg.msg_iov = c->iov.data();
+    c->msg.msg_iovlen = c->iov.size();
+
+    struct io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = c->fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&c->msg);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = completionData(c, kSendOp);
+    c->sending = true;
+    ++c->inFlight;
+    ++inFlightOps_;
+}
+
+void IoUringPoller::cancelOp(Completion* c, Op op)
+{
+    struct io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = completionData(c, op);
+    sqe->user_data = kIgnoreData;
+    if(op != kSendOp)
+    {
+        c->cancelling = true;
+    }
+}
+
+bool IoUringPoller::hasPendingRead(const Completion* c) const
+{
+    return c->received.readableBytes() > 0 || c->eof || c->recvError != 0
+           || !c->accepted.empty() || c->acceptError != 0;
+}
+
+void IoUringPoller::handleCompletion(const struct io_uring_cqe& cqe, ChannelList* activeChannels)
+{
+    Completion *c = reinterpret_cast<Completion*>(cqe.user_data & ~(kCompletionTag | kOpMask));
+    const int op = static_cast<int>(cqe.user_data & kOpMask);
+    const bool more = op != kSendOp && (cqe.flags & IORING_CQE_F_MORE);
+    if(!more)
+    {
+        --c->inFlight;
+        --inFlightOps_;
+    }
+
+    int revents = 0;
+    if(op == kRecvOp)
+    {
+        if(cqe.flags & IORING_CQE_F_BUFFER)
+        {
+            uint16_t bid = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+            if(cqe.res > 0 && c->channel != nullptr)
+            {
+                c->received.append(recvBuffers_ + bid * kRecvBufferSize, cqe.res);
+                if(c->received.readableBytes() >= kMaxReceived && more && !c->cancelling)
+                {
+                    cancelOp(c, kRecvOp);   // armed again once it is taken
+                }
+            }
+            recycleBuffer(bid);
+        }
+        if(cqe.res == 0)
+        {
+            c->eof = true;
+        }
+        else if(cqe.res < 0 && cqe.res != -ENOBUFS && cqe.res != -ECANCELED)
+        {
+            c->recvError = -cqe.res;
+        }
+        // out of buffers ends the multishot, it is armed again once they're back
+        if(cqe.res >= 0 || c->recvError != 0)
+        {
+            revents = EPOLLIN;
+        }
+    }
+    else if(op == kAcceptOp)
+    {
+        if(cqe.res >= 0)
+        {
+            if(c->channel != nullptr)
+            {
+                c->accepted.push_back(cqe.res);
+            }
+            else
+            {
+                ::close(cqe.res);
+            }
+            revents = EPOLLIN;
+        }
+        else if(cqe.res != -ECANCELED)
+        {
+            c->acceptError = -cqe.res;
+            revents = EPOLLIN;
+        }
+    }
+    else
+    {
+        c->sending = false;
+        if(cqe.res > 0)
+        {
+            c->output.retrieve(cqe.res);
+            c->sent += cqe.res;
+        }
+        else if(cqe.res < 0)
+        {
+            if(cqe.res != -ECANCELED)
+            {
+                c->sendError = -cqe.res;
+            }
+            c->output.retrieveAll();
+        }
+        if(c->output.readableBytes() > 0 && c->channel != nullptr)
+        {
+            armSend(c); // a short send, the connection hears of it when all is out
+        }
+        else
+        {
+            revents = EPOLLOUT;
+        }
+    }
+    if(op != kSendOp && !more)
+    {
+        c->receiving = false;
+        c->cancelling = false;
+    }
+
+    if(c->channel == nullptr)
+    {
+        if(c->inFlight == 0)
+        {
+            retired_.erase(c);
+            delete c;
+        }
+        return;
+    }
+    if(!more)
+    {
+        resync_.push_back(c->fd);
+    }
+    Channel *channel = c->channel;
+    if(((revents & EPOLLIN) && channel->isReading()) || ((revents & EPOLLOUT) && channel->isWriting()))
+    {
+        reportActive(c, revents, activeChannels);
+    }
+}
+
+void IoUringPoller::reportActive(Completion* c, int revents, ChannelList* activeChannels)
+{
+    Channel *channel = c->channel;
+    int old = 0;
+    if(c->round == round_)
+    {
+        old = channel->revents();
+        channel->set_revents(old | revents);
+    }
+    else
+    {
+        c->round = round_;
+        channel->set_revents(revents);
+        activeChannels->push_back(channel); // return poller to EventLoop
+    }
+    if((revents & EPOLLIN) && !(old & EPOLLIN))
+    {
+        ready_.push_back(c->fd);
+    }
+}
+
+void IoUringPoller::recycleBuffer(uint16_t bid)
+{
+    // the tail shares the first entry with its resv field
+    struct io_uring_buf *buf = &bufRing_[bufTail_ & (kRecvBuffers - 1)];
+    buf->addr = reinterpret_cast<uint64_t>(recvBuffers_ + bid * kRecvBufferSize);
+    buf->len = kRecvBufferSize;
+    buf->bid = bid;
+    ++bufTail_;
+    __atomic_store_n(&bufRing_[0].resv, bufTail_, __ATOMIC_RELEASE);
+}
+
+// the channel is gone: its requests are cancelled, the Completion is
+// freed once they all completed
+void IoUringPoller::release(Completion* c)
+{
+    c->channel = nullptr;
+    for(int connfd : c->accepted)
+    {
+        ::close(connfd);
+    }
+    c->accepted.clear();
+    c->received.retrieveAll();
+    if(c->receiving && !c->cancelling)
+    {
+        cancelOp(c, c->listening ? kAcceptOp : kRecvOp);
+    }
+    if(c->sending)
+    {
+        cancelOp(c, kSendOp);
+    }
+    if(c->inFlight == 0)
+    {
+        delete c;
+    }
+    else
+    {
+        retired_.insert(c);
+    }
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include "Buffer.h"
+#include "Poller.h"
+
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+class Channel;
+
+// io_uring backend, selected by Poller::newDefaultPoller when MUDUO_USE_URING is set
+//
+// readiness: every Channel has one one-shot IORING_OP_POLL_ADD in flight,
+// the polls fired in the last round are re-armed in batch, so poll() does
+// all of them and the wait in a single io_uring_enter, and
+// enableWriting/disableWriting cost no syscall. edge-triggered channels
+// get a multishot poll that is never re-armed
+//
+// completion: for a channel with Channel::enableCompletion the ring does
+// the socket I/O itself. A reading channel has a multishot IORING_OP_RECV
+// which takes its buffers from a ring of buffers registered with the
+// kernel, the data is copied into a Buffer here and the buffer given back
+// at once; a listening channel has a multishot IORING_OP_ACCEPT; the bytes
+// handed over by submitSend go by IORING_OP_SENDMSG. A read event then
+// means takeReceived or takeAccepted has something, a write event that
+// the send finished, and the handlers take them without a syscall. Such a
+// channel is only polled for EPOLLOUT while it writes something the ring
+// doesn't send, a file or a payload
+class IoUringPoller : public Poller
+{
+public:
+    IoUringPoller(EventLoop* loop);
+    ~IoUringPoller() override;
+
+    // false when the kernel has no usable io_uring, the caller falls back to epoll
+    bool ok() const { return ringFd_ >= 0; }
+
+    Timestamp poll(int timeoutMs, ChannelList* activeChannels) override;
+    void updateChannel(Channel* channel) override;
+    void removeChannel(Channel* channel) override;
+
+    bool supportsEdgeTriggered() const override { return true; }
+
+    bool supportsCompletion() const override { return completionOk_; }
+    ssize_t takeReceived(Channel* channel, Buffer* buf, size_t maxBytes, int* saveErrno) override;
+    void submitSend(Channel* channel, Buffer* buf) override;
+    ssize_t takeSent(Channel* channel, int* saveErrno) override;
+    int takeAccepted(Channel* channel, int* saveErrno) override;
+
+private:
+    static const unsigned kRingEntries = 1024;
+    // the buffers the multishot recvs pick from
+    static const unsigned kRecvBuffers = 256;
+    static const size_t kRecvBufferSize = 4096;
+    static const uint16_t kBufferGroup = 0;
+    // the received bytes a connection leaves untaken before its recv is
+    // cancelled, so a paused or busy one doesn't hold the ring's buffers' worth
+    static const size_t kMaxReceived = 64 * 1024;
+    // the chunks one sendmsg gathers
+    static const int kMaxSendIov = 64;
+
+    // the ring's I/O for a completion channel, it lives until the last of
+    // its requests completed, even after removeChannel
+    struct Completion
+    {
+        Completion(Channel *ch, int fd, bool listening);
+
+        Channel *channel;   // nullptr once removed
+        int fd;
+        bool listening;     // accepts instead of receiving
+        int inFlight;       // requests whose last completion has not come
+        unsigned round;     // the poll() it was last reported in
+        bool receiving;     // the multishot recv or accept is armed
+        bool cancelling;    // and a cancel for it is on the way
+        bool sending;       // a sendmsg is in flight
+        bool eof;
+        int recvError;
+        Buffer received;
+        std::deque<int> accepted;
+        int acceptError;
+        Buffer output;      // handed over, not sent yet
+        size_t sent;        // sent, not taken yet
+        int sendError;
+        std::vector<struct iovec> iov;
+        struct msghdr msg;
+    };
+    enum Op { kRecvOp = 0, kSendOp = 1, kAcceptOp = 2 };
+
+    bool setupRing();
+    void destroyRing();
+    // the opcodes this kernel knows, by IORING_REGISTER_PROBE
+    bool probeOpcodes(std::vector<bool> *supported);
+    // the request just queued with kProbeData stays armed, an old kernel
+    // rejects an unknown flag such as multishot at once; it is cancelled
+    bool probeStaysArmed();
+    // consume the completions, true if the probe's was among them
+    bool reapProbe();
+    bool setupBufferRing();
+    bool probeCompletion();
+
+    struct io_uring_sqe* getSqe();
+    // submit the queued sqes and wait for at least minComplete completions
+    int enter(unsigned minComplete, int timeoutMs);
+
+    uint32_t pollMask(const Channel* channel) const;
+    void armPoll(int fd, int generation, uint32_t events, bool multishot);
+    void cancelPoll(int fd, int generation);
+    void rearmFired();
+    void reapCompletions(ChannelList* activeChannels);
+
+    Completion* completionOf(const Channel* channel) const;
+    // arm or cancel the multishot recv or accept and the EPOLLOUT poll of
+    // a completion channel as its events ask, note what waits to be taken
+    void syncCompletion(Completion* c);
+    void armReceive(Completion* c);
+    void armSend(Completion* c);
+    void cancelOp(Completion* c, Op op);
+    bool hasPendingRead(const Completion* c) const;
+    void handleCompletion(const struct io_uring_cqe& cqe, ChannelList* activeChannels);
+    void reportActive(Completion* c, int revents, ChannelList* activeChannels);
+    void recycleBuffer(uint16_t bid);
+    void release(Completion* c);
+
+    int ringFd_;
+    struct io_uring_params params_;
+
+    void *sqRing_;
+    size_t sqRingSize_;
+    void *cqRing_;
+    size_t cqRingSize_;
+    struct io_uring_sqe *sqes_;
+
+    unsigned *sqHead_;
+    unsigned *sqTail_;
+    unsigned *sqMask_;
+    unsigned *sqArray_;
+    unsigned sqLocalTail_;  // sqes filled but not published yet end here
+    unsigned toSubmit_;
+
+    unsigned *cqHead_;
+    unsigned *cqTail_;
+    unsigned *cqMask_;
+    struct io_uring_cqe *cqes_;
+
+    // the generation of every Channel is kept in Channel::index
+    int nextGeneration_;
+    // (fd, generation) of the polls fired in the last round
+    std::vector<std::pair<int, int>> fired_;
+
+    bool completionOk_;
+    struct io_uring_buf *bufRing_;
+    char *recvBuffers_;
+    uint16_t bufTail_;
+    unsigned round_;
+    int inFlightOps_;
+    std::unordered_map<int, Completion*> completions_;
+    // removed with requests still in flight
+    std::unordered_set<Completion*> retired_;
+    // fds to sync at the next poll(): a multishot ended, a send finished
+    std::vector<int> resync_;
+    // fds with results not taken yet, reported again while they read
+    std::vector<int> ready_;
+};
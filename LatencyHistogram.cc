@@ -0,0 +1,57 @@
+#include "LatencyHistogram.h"
+
+#include <stdio.h>
+
+const int LatencyHistogram::kBuckets;
+
+LatencyHistogram::LatencyHistogram()
+{
+    for(auto& bucket : buckets_)
+    {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+int64_t LatencyHistogram::count() const
+{
+    int64_t total = 0;
+    for(int i = 0; i < kBuckets; ++i)
+    {
+        total += bucket(i);
+    }
+    return total;
+}
+
+int64_t LatencyHistogram::percentile(double q) const
+{
+    int64_t total = count();
+    int64_t seen = 0;
+    for(int i = 0; i < kBuckets; ++i)
+    {
+        seen += bucket(i);
+        if(total > 0 && seen >= q * total)
+        {
+            return bucketLimit(i);
+        }
+    }
+    return 0;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other)
+{
+    for(int i = 0; i < kBuckets; ++i)
+    {
+        buckets_[i].fetch_add(other.bucket(i), std::memory_order_relaxed);
+    }
+}
+
+std::string LatencyHistogram::toString() const
+{
+    char buf[128];
+    snprintf(buf, sizeof buf, "n=%lld p50<=%lldus p99<=%lldus max<=%lldus",
+             static_cast<long long>(count()),
+             static_cast<long long>(percentile(0.5)),
+             static_cast<long long>(percentile(0.99)),
+             static_cast<long long>(percentile(1.0)));
+    return buf;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+
+// a log2 histogram of microseconds, bucket 0 holds 0, bucket i holds
+// [2^(i-1), 2^i); one thread adds, any thread reads, all relaxed
+class LatencyHistogram : noncopyable
+{
+public:
+    static const int kBuckets = 32;
+
+    LatencyHistogram();
+
+    void add(int64_t microSeconds)
+    {
+        int i = microSeconds <= 0 ? 0 : 64 - __builtin_clzll(static_cast<uint64_t>(microSeconds));
+        buckets_[i < kBuckets ? i : kBuckets - 1].fetch_add(1, std::memory_order_relaxed);
+    }
+    int64_t bucket(int i) const { return buckets_[i].load(std::memory_order_relaxed); }
+    // the largest value bucket i holds
+    static int64_t bucketLimit(int i) { return i == 0 ? 0 : (int64_t(1) << i) - 1; }
+
+    int64_t count() const;
+    // the limit of the bucket the fraction q of the samples is at or below
+    int64_t percentile(double q) const;
+    // add the samples of other, e.g. to sum up the loops
+    void merge(const LatencyHistogram& other);
+    // "n=1000 p50<=15us p99<=63us max<=127us"
+    std::string toString() const;
+
+private:
+    std::atomic<int64_t> buckets_[kBuckets];
+};
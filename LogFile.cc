@@ -0,0 +1,95 @@
+#include "LogFile.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+LogFile::LogFile(const std::string& basename, off_t rollSize, int rollSeconds)
+    : basename_(basename),
+      rollSize_(rollSize),
+      rollSeconds_(rollSeconds),
+      fd_(-1),
+      written_(0),
+      lastRoll_(0),
+      period_(0)
+{
+    roll();
+}
+
+LogFile::~LogFile()
+{
+    if(fd_ >= 0)
+    {
+        ::close(fd_);
+    }
+}
+
+void LogFile::roll()
+{
+    time_t now = ::time(nullptr);
+    // the name only has seconds, a file filled within one keeps growing
+    // until the next
+    if(fd_ >= 0 && now == lastRoll_)
+    {
+        return;
+    }
+    struct tm tm;
+    ::localtime_r(&now, &tm);
+    char name[64];
+    snprintf(name, sizeof name, ".%04d%02d%02d-%02d%02d%02d.%d.log",
+             tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+             tm.tm_hour, tm.tm_min, tm.tm_sec, ::getpid());
+    std::string filename = basename_ + name;
+
+    int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if(fd < 0)
+    {
+        // no Logger here, it may be what writes to us
+        fprintf(stderr, "LogFile::roll open %s err:%d\n", filename.c_str(), errno);
+        return;
+    }
+    if(fd_ >= 0)
+    {
+        ::close(fd_);
+    }
+    fd_ = fd;
+    written_ = 0;
+    lastRoll_ = now;
+    period_ = now / rollSeconds_ * rollSeconds_;
+}
+
+void LogFile::write(const struct iovec *iov, int iovcnt)
+{
+    if(fd_ < 0)
+    {
+        return;
+    }
+    while(iovcnt > 0)
+    {
+        int count = std::min(iovcnt, IOV_MAX);
+        ssize_t n = ::writev(fd_, iov, count);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            fprintf(stderr, "LogFile::write err:%d\n", errno);
+            return;
+        }
+        written_ += n;
+        // a short write to a file only comes with a full disk, drop the rest
+        iov += count;
+        iovcnt -= count;
+    }
+
+    if(written_ > rollSize_ || ::time(nullptr) / rollSeconds_ * rollSeconds_ != period_)
+    {
+        roll();
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <string>
+#include <sys/types.h>
+#include <time.h>
+
+struct iovec;
+
+// the file the AsyncLogging backend writes, rolled to a new one once it
+// grows past rollSize bytes or a rollSeconds period begins,
+// named basename.YYYYmmdd-HHMMSS.pid.log; used by one thread
+class LogFile : noncopyable
+{
+public:
+    LogFile(const std::string& basename, off_t rollSize, int rollSeconds = 24 * 60 * 60);
+    ~LogFile();
+
+    // one writev for the pieces, no user space buffering
+    void write(const struct iovec *iov, int iovcnt);
+    void roll();
+
+private:
+    const std::string basename_;
+    const off_t rollSize_;
+    const int rollSeconds_;
+    int fd_;
+    off_t written_;
+    time_t lastRoll_;
+    time_t period_;     // the start of the current rollSeconds period
+};
@@ -1,8 +1,33 @@
-#include <iostream>
+#include <algorithm>
+#include <stdio.h>
 
 #include "Logger.h"
 #include "Timestamp.h"
 
+std::atomic_int Logger::logLevel_(INFO);
+
+static void writeStdout(const char *line, size_t len)
+{
+    ::fwrite(line, 1, len, stdout);
+}
+
+static void flushStdout()
+{
+    ::fflush(stdout);
+}
+
+Logger::Logger()
+    : output_(writeStdout),
+      flush_(flushStdout)
+{
+}
+
+void Logger::resetOutput()
+{
+    output_ = writeStdout;
+    flush_ = flushStdout;
+}
+
 // the singleton
 Logger& Logger::instance()
 {
@@ -10,33 +35,38 @@ Logger& Logger::instance()
 
     return Logger;
 }
-// set the level of log
-void Logger::setLogLevel(int level)
-{
-    logLevel_ = level;
-}
-// write log
-// the format [level] time : msg
-void Logger::log(std::string msg)
+
+const char* Logger::levelPrefix(int level)
 {
-    switch (logLevel_)
+    switch (level)
     {
     case INFO:
-        std::cout << "[INFO]";
-        break;
+        return "[INFO]";
     case ERROR:
-        std::cout << "[ERROR]";
-        break;
+        return "[ERROR]";
     case FATAL:
-        std::cout << "[FATAL]";
-        break;
+        return "[FATAL]";
     case DEBUG:
-        std::cout << "[DEBUG]";
-        break;
+        return "[DEBUG]";
     default:
-        break;
+        return "";
     }
+}
 
-    // print time and msg
-    std::cout << Timestamp::now().toString() << " : " << msg << std::endl;
-}
\ No newline at end of file
+// write log
+// the format [level] time : msg
+void Logger::log(int level, const char *msg)
+{
+    // the whole line goes out with one call, lines of threads don't interleave
+    char time[32];
+    Timestamp::now().format(time, sizeof time);
+    char line[1152];
+    int len = snprintf(line, sizeof line, "%s%s : %s\n", levelPrefix(level), time, msg);
+    output_(line, std::min(static_cast<size_t>(len), sizeof line - 1));
+
+    // the process exits right after a FATAL, don't lose what's buffered
+    if(level == FATAL)
+    {
+        flush_();
+    }
+}
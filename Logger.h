@@ -1,77 +1,95 @@
 #pragma once
 
-#include <string>
+#include <atomic>
+#include <functional>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
 
+#include "BinaryLogging.h"
 #include "noncopyable.h"
 
 
-// LOG_INFO("%s %d", arg1, arg2)
-#define LOG_INFO(logmsgFormat, ...) \
-    do \
-    {   \
-        Logger &logger = Logger::instance();    \
-        logger.setLogLevel(INFO);   \
-        char buf[1024] = {0,};  \
-        snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__);   \
-        logger.log(buf);    \
-    }while(0)
+// define the level of log, from the least severe: DEBUG INFO ERROR FATAL
+enum LogLevel
+{
+    DEBUG,  // debug
+    INFO,   // normal
+    ERROR,  // error
+    FATAL,  // core 
+};
+
+// the least level compiled in, the calls below it are removed entirely,
+// e.g. -DMYMUDUO_MIN_LOG_LEVEL=ERROR; DEBUG ones need MUDEBUG
+#ifndef MYMUDUO_MIN_LOG_LEVEL
+#ifdef MUDEBUG
+#define MYMUDUO_MIN_LOG_LEVEL DEBUG
+#else
+#define MYMUDUO_MIN_LOG_LEVEL INFO
+#endif
+#endif
 
-#define LOG_ERROR(logmsgFormat, ...) \
+// the level is checked before anything is formatted; while a
+// BinaryLogging runs the arguments are copied unformatted, unless one of
+// them has no binary form, that call is formatted as text as usual
+#define LOG_AT_LEVEL(level, logmsgFormat, ...) \
     do \
     {   \
-        Logger &logger = Logger::instance();    \
-        logger.setLogLevel(ERROR);   \
-        char buf[1024] = {0,};  \
-        snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__);  \
-        logger.log(buf);    \
+        if(level >= MYMUDUO_MIN_LOG_LEVEL && Logger::logLevel() <= level) \
+        {   \
+            static BinaryLogging::Site site = {logmsgFormat, __FILE__, __LINE__, level, {0}};   \
+            if(!BinaryLogging::active() || !BinaryLogging::log(&site, ##__VA_ARGS__))   \
+            {   \
+                char buf[1024];  \
+                snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__);   \
+                Logger::instance().log(level, buf);    \
+            }   \
+        }   \
     }while(0)
 
+// LOG_INFO("%s %d", arg1, arg2)
+#define LOG_INFO(logmsgFormat, ...) LOG_AT_LEVEL(INFO, logmsgFormat, ##__VA_ARGS__)
+
+#define LOG_ERROR(logmsgFormat, ...) LOG_AT_LEVEL(ERROR, logmsgFormat, ##__VA_ARGS__)
+
+// always written, whatever the levels
 #define LOG_FATAL(logmsgFormat, ...) \
     do \
     {   \
-        Logger &logger = Logger::instance();    \
-        logger.setLogLevel(FATAL);   \
-        char buf[1024] = {0,};  \
+        char buf[1024];  \
         snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__);  \
-        logger.log(buf);    \
+        Logger::instance().log(FATAL, buf);    \
         exit(-1);   \
-    }while(0);
-
-#ifdef MUDEBUG
-
-#define LOG_DEBUG(logmsgFormat, ...) \
-    do \
-    {   \2
-        Logger &logger = Logger::instance();    \
-        logger.setLogLevel(DEBUG);   \
-        char buf[1024] = {0,};  \
-        snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__);  \
-        logger.log(buf);    \
-    }while(0);
-
-#else 
-    #define LOG_DEBUG(logmsgFormat, ...)
-#endif
+    }while(0)
 
-// define the level of log: INFO ERROR FATAL DEBUG
-enum LogLevel
-{
-    INFO,   // normal
-    ERROR,  // error
-    FATAL,  // core 
-    DEBUG,  // debug
-};
+#define LOG_DEBUG(logmsgFormat, ...) LOG_AT_LEVEL(DEBUG, logmsgFormat, ##__VA_ARGS__)
 
 class Logger :   noncopyable
 {
 public:
     // the singleton
     static Logger& instance();
-    // set the level of log
-    void setLogLevel(int level);
+    // where the formatted lines go, stdout unless an AsyncLogging takes them
+    using OutputFunc = std::function<void (const char *line, size_t len)>;
+    using FlushFunc = std::function<void ()>;
+    // set before the other threads start logging
+    void setOutput(OutputFunc output) { output_ = std::move(output); }
+    void setFlush(FlushFunc flush) { flush_ = std::move(flush); }
+    // back to stdout, e.g. when the AsyncLogging they were bound to stops;
+    // no other thread may be logging meanwhile, as for setOutput
+    void resetOutput();
+    // the least level written, INFO at first; a relaxed load, the macros
+    // check it before formatting
+    static int logLevel() { return logLevel_.load(std::memory_order_relaxed); }
+    static void setLogLevel(int level) { logLevel_.store(level, std::memory_order_relaxed); }
+    // "[INFO]" and so on
+    static const char* levelPrefix(int level);
     // write log
-    void log(std::string msg);
+    void log(int level, const char *msg);
+    void flush() { flush_(); }
 private:
-    int logLevel_;
-    Logger(){}
+    static std::atomic_int logLevel_;
+    OutputFunc output_;
+    FlushFunc flush_;
+    Logger();
 };
\ No newline at end of file
@@ -0,0 +1,21 @@
+#include "MemoryBudget.h"
+#include "EventLoop.h"
+
+MemoryBudget::MemoryBudget(size_t limit, Policy policy, double stallSeconds)
+    : limit_(limit),
+      policy_(policy),
+      stallSeconds_(stallSeconds),
+      rejectedSends_(0),
+      evictedConnections_(0)
+{
+}
+
+size_t MemoryBudget::usage() const
+{
+    int64_t total = 0;
+    for(EventLoop *loop : loops_)
+    {
+        total += loop->bufferedBytes();
+    }
+    return total > 0 ? static_cast<size_t>(total) : 0;
+}
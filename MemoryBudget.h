@@ -0,0 +1,54 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+class EventLoop;
+
+// a cap on the bytes the connections keep in memory: their input and
+// output Buffers and queued payloads, not the files queued by sendFile
+// every loop counts the connections it runs (EventLoop::bufferedBytes),
+// usage() adds up the loops, nothing is shared on the send path
+class MemoryBudget : noncopyable
+{
+public:
+    // what is done once usage() goes over the limit
+    enum Policy
+    {
+        kRejectSends,   // a send that would go over is dropped whole
+        kShedLargest,   // each loop force-closes its largest connections down to its share
+        kCloseStalled   // force-close the connections that wrote nothing for stallSeconds
+    };
+
+    MemoryBudget(size_t limit, Policy policy, double stallSeconds);
+
+    // the loops to count, added before the connections use the budget
+    void addLoop(EventLoop *loop) { loops_.push_back(loop); }
+    size_t numLoops() const { return loops_.size(); }
+
+    size_t limit() const { return limit_; }
+    Policy policy() const { return policy_; }
+    double stallSeconds() const { return stallSeconds_; }
+
+    // the current usage, a relaxed sum, thread safe
+    size_t usage() const;
+    bool exceeded(size_t adding = 0) const { return usage() + adding > limit_; }
+
+    // the sends kRejectSends dropped, the connections the others closed
+    void addRejectedSend() { rejectedSends_.fetch_add(1, std::memory_order_relaxed); }
+    void addEvictedConnection() { evictedConnections_.fetch_add(1, std::memory_order_relaxed); }
+    int64_t rejectedSends() const { return rejectedSends_.load(std::memory_order_relaxed); }
+    int64_t evictedConnections() const { return evictedConnections_.load(std::memory_order_relaxed); }
+
+private:
+    const size_t limit_;
+    const Policy policy_;
+    const double stallSeconds_;
+    std::vector<EventLoop*> loops_;
+    std::atomic<int64_t> rejectedSends_;
+    std::atomic<int64_t> evictedConnections_;
+};
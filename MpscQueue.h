@@ -0,0 +1,78 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <utility>
+
+// multi-producer single-consumer queue (Dmitry Vyukov's node-based one)
+// push() is wait-free and may be called in any thread, it allocates one node
+// per value: a node free list was measured slower than malloc's thread cache,
+// the recycled nodes bounce between the consumer and the producers' caches
+// consume() must be called only in the consumer thread
+template <typename T>
+class MpscQueue : noncopyable
+{
+public:
+    MpscQueue()
+        : head_(new Node()),
+          tail_(head_.load(std::memory_order_relaxed))
+    {}
+
+    ~MpscQueue()
+    {
+        consume([](T&){});
+        delete tail_;
+    }
+
+    void push(T value)
+    {
+        Node *node = new Node(std::move(value));
+        Node *prev = head_.exchange(node, std::memory_order_acq_rel);
+        // between exchange and store the node is not reachable from tail_,
+        // consume() stops there and the producer must wake the consumer itself
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    // pop and run f on the values pushed before the call,
+    // the values f pushes are left for the next call
+    template <typename F>
+    size_t consume(F f)
+    {
+        Node *last = head_.load(std::memory_order_acquire);
+        size_t n = 0;
+        while(tail_ != last)
+        {
+            Node *next = tail_->next.load(std::memory_order_acquire);
+            if(next == nullptr)
+            {
+                break;
+            }
+            T value(std::move(next->value));
+            delete tail_;
+            tail_ = next;   // next is the stub now
+            f(value);
+            ++n;
+        }
+        return n;
+    }
+
+    bool empty() const
+    {
+        return tail_->next.load(std::memory_order_acquire) == nullptr;
+    }
+
+private:
+    struct Node
+    {
+        Node() : next(nullptr) {}
+        explicit Node(T v) : value(std::move(v)), next(nullptr) {}
+
+        T value;
+        std::atomic<Node*> next;
+    };
+
+    // producers and consumer write on different cache lines
+    alignas(64) std::atomic<Node*> head_;
+    alignas(64) Node *tail_;
+};
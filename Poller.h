@@ -5,7 +5,9 @@
 
 #include <vector>
 #include <unordered_map>
+#include <sys/types.h>
 
+class Buffer;
 class Channel;
 class EventLoop;
 
@@ -23,6 +25,25 @@ public:
     virtual void updateChannel(Channel* channel) = 0;
     virtual void removeChannel(Channel* channel) = 0;
 
+    // whether Channel::enableEdgeTriggered is honored
+    virtual bool supportsEdgeTriggered() const { return false; }
+
+    // completion mode, whether Channel::enableCompletion is honored: the
+    // poller receives, accepts and sends for such a channel itself, a read
+    // event means there is something to take, a write event that the bytes
+    // handed over are sent
+    virtual bool supportsCompletion() const { return false; }
+    // like Buffer::readFd: > 0 the bytes appended to buf, at most maxBytes,
+    // 0 the end of the stream, -1 with *saveErrno, EAGAIN when nothing is left
+    virtual ssize_t takeReceived(Channel* channel, Buffer* buf, size_t maxBytes, int* saveErrno);
+    // send the bytes of buf after those handed over before, buf is left empty
+    virtual void submitSend(Channel* channel, Buffer* buf);
+    // the bytes sent since the last call, -1 with *saveErrno, EAGAIN while
+    // a send is in flight
+    virtual ssize_t takeSent(Channel* channel, int* saveErrno);
+    // a connection accepted on a listening channel, -1 with *saveErrno
+    virtual int takeAccepted(Channel* channel, int* saveErrno);
+
     // judge channel whether in current Poller
     bool hasChannel(Channel* channel) const;
 
@@ -7,6 +7,7 @@
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <string.h>
+#include <linux/net_tstamp.h>
 
 Socket::~Socket()
 {
@@ -76,4 +77,26 @@ void Socket::setKeepAlive(bool on)
 {
     int optval = on ? 1 : 0;
     ::setsockopt(sockfd_, SOL_SOCKET, SO_KEEPALIVE, &optval, static_cast<socklen_t>(sizeof(optval)));
-}
\ No newline at end of file
+}
+
+bool Socket::setZeroCopy(bool on)
+{
+    int optval = on ? 1 : 0;
+    return ::setsockopt(sockfd_, SOL_SOCKET, SO_ZEROCOPY, &optval, static_cast<socklen_t>(sizeof(optval))) == 0;
+}
+
+bool Socket::setRxTimestamps(bool on)
+{
+    int flags = on ? SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE : 0;
+    return ::setsockopt(sockfd_, SOL_SOCKET, SO_TIMESTAMPING, &flags, static_cast<socklen_t>(sizeof(flags))) == 0;
+}
+
+void Socket::setIncomingCpu(int cpu)
+{
+    ::setsockopt(sockfd_, SOL_SOCKET, SO_INCOMING_CPU, &cpu, static_cast<socklen_t>(sizeof(cpu)));
+}
+
+void Socket::setDeferAccept(int seconds)
+{
+    ::setsockopt(sockfd_, IPPROTO_TCP, TCP_DEFER_ACCEPT, &seconds, static_cast<socklen_t>(sizeof(seconds)));
+}
@@ -23,6 +23,14 @@ public:
     void setReuseAddr(bool on);
     void setReusePort(bool on);
     void setKeepAlive(bool on);
+    // SO_ZEROCOPY, false if the kernel doesn't support it
+    bool setZeroCopy(bool on);
+    // SO_TIMESTAMPING software receive timestamps, see Buffer::readFd
+    bool setRxTimestamps(bool on);
+    // prefer this listening socket for the SYNs received on cpu
+    void setIncomingCpu(int cpu);
+    // TCP_DEFER_ACCEPT, accept only once data arrived, wait up to seconds
+    void setDeferAccept(int seconds);
 
 private:
     const int sockfd_;
@@ -3,8 +3,19 @@
 #include "Socket.h"
 #include "Channel.h"
 #include "EventLoop.h"
+#include "MemoryBudget.h"
 
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/errqueue.h>
 #include <netinet/in.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
 static EventLoop* CheckLoopNotNull(EventLoop *loop)
 {
@@ -15,48 +26,114 @@ static EventLoop* CheckLoopNotNull(EventLoop *loop)
     return loop;
 }
 
+// shared by the connections which have not been given callbacks yet
+static const ConnectionCallbacksPtr& emptyCallbacks()
+{
+    static ConnectionCallbacksPtr callbacks(new ConnectionCallbacks);
+    return callbacks;
+}
+
+const char TcpConnection::kDefaultSpoolDir[] = "/var/tmp";
+
+// how often a loop reads the notifications of the orphaned zero copy payloads
+constexpr double kZeroCopyReapSeconds = 0.01;
+
 TcpConnection::TcpConnection(EventLoop *loop,
             const std::string nameArg,
             int sockfd,
             const InetAddress& localAddr,
-            const InetAddress& peerAddr)
+            const InetAddress& peerAddr,
+            uint64_t id)
         : loop_(CheckLoopNotNull(loop)),
         name_(nameArg),
+        id_(id),
         state_(kConnecting),
         reading_(true),
-        socket_(new Socket(sockfd)),
-        channel_(new Channel(loop, sockfd)),
+        socket_(sockfd),
+        channel_(loop, sockfd),
         localAddr_(localAddr),
         peerAddr_(peerAddr),
-        highWaterMark_(64 * 1024 * 1024)
+        callbacks_(emptyCallbacks()),
+        highWaterMark_(64 * 1024 * 1024),
+        flowHighWaterMark_(0),
+        flowLowWaterMark_(0),
+        flowSourcePaused_(false),
+        inputHighWaterMark_(0),
+        inputLowWaterMark_(0),
+        inputPaused_(false),
+        edgeTriggered_(false),
+        ioBudget_(kDefaultIoBudget),
+        regionQueueBytes_(0),
+        fileQueueBytes_(0),
+        budget_(nullptr),
+        accountedBytes_(0),
+        zeroCopy_(false),
+        zeroCopyThreshold_(kDefaultZeroCopyThreshold),
+        zeroCopySeq_(0),
+        batchedFlush_(false),
+        flushPending_(false),
+        spool_(false),
+        spoolThreshold_(kDefaultSpoolThreshold),
+        spoolDir_(kDefaultSpoolDir),
+        spoolFd_(-1),
+        spoolEnd_(0),
+        spoolQueueBytes_(0),
+        rxTimestamps_(false),
+        completionIo_(false),
+        ringQueueBytes_(0)
 {
     // give channel the notion that the intersting occured
-    channel_->setReadCallback(
+    channel_.setReadCallback(
         std::bind(&TcpConnection::handleRead, this, std::placeholders::_1));
-    channel_->setWriteCallback(
+    channel_.setWriteCallback(
         std::bind(&TcpConnection::handleWrite, this));
-    channel_->setCloseCallback(
+    channel_.setCloseCallback(
         std::bind(&TcpConnection::handleClose, this));
-    channel_->setErrorCallback(
+    channel_.setErrorCallback(
         std::bind(&TcpConnection::handleError, this));
     LOG_INFO("TcpConnection::ctor[%s] at fd=%d", name_.c_str(), sockfd);
-    socket_->setKeepAlive(true);
+    socket_.setKeepAlive(true);
+    loop_->addConnections(1);
 }
 
 
+ConnectionCallbacks* TcpConnection::mutableCallbacks()
+{
+    if(callbacks_.use_count() > 1)
+    {
+        callbacks_.reset(new ConnectionCallbacks(*callbacks_));
+    }
+    return callbacks_.get();
+}
+
 TcpConnection::~TcpConnection()
 {
-    LOG_INFO("TcpConnection::dtor[%s] at fd=%d state=%d \n", name_.c_str(), channel_->fd(), state_.load());
+    loop_->addConnections(-1);
+    loop_->addBufferedBytes(-static_cast<int64_t>(accountedBytes_));
+    closeSpool();
+    LOG_INFO("TcpConnection::dtor[%s] at fd=%d state=%d \n", name_.c_str(), channel_.fd(), state_.load());
 }
 
 void TcpConnection::handleRead(Timestamp receiveTime)
 {
+    if(channel_.completion())
+    {
+        handleReadCompletion(receiveTime);
+        return;
+    }
+    if(channel_.edgeTriggered())
+    {
+        handleReadEdge(receiveTime);
+        return;
+    }
+
     int saveErrno = 0;
-    ssize_t n = inputBuffer_.readFd(channel_->fd(), &saveErrno);
+    ssize_t n = inputBuffer_.readFd(channel_.fd(), &saveErrno, rxTimestamps_);
 
     if(n > 0)
     {
-        messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+        deliverMessage(receiveTime);
+        updateBufferedBytes();
     }
     else if(n == 0)
     {
@@ -70,54 +147,261 @@ void TcpConnection::handleRead(Timestamp receiveTime)
     }
 }
 
+void TcpConnection::deliverMessage(Timestamp receiveTime)
+{
+    if(rxTimestamps_ && inputBuffer_.arrivalTime().valid())
+    {
+        loop_->rxLatency().add(Timestamp::now().microSecondsSinceEpoch()
+                               - inputBuffer_.arrivalTime().microSecondsSinceEpoch());
+    }
+    callbacks_->messageCallback(shared_from_this(), &inputBuffer_, receiveTime);
+    checkInputWaterMarks();
+}
+
+void TcpConnection::checkInputWaterMarks()
+{
+    if(inputHighWaterMark_ == 0)
+    {
+        return;
+    }
+    if(!inputPaused_ && reading_ && inputOverHighWaterMark())
+    {
+        stopReadInLoop();
+        inputPaused_ = true;
+    }
+    else if(inputPaused_ && inputBuffer_.readableBytes() <= inputLowWaterMark_)
+    {
+        startReadInLoop();
+    }
+}
+
 void TcpConnection::handleWrite()
 {
-    if(channel_->isWriting())
+    if(channel_.edgeTriggered())
+    {
+        handleWriteEdge();
+        return;
+    }
+
+    if(channel_.isWriting())
     {
         int saveErrno = 0;
-        ssize_t n = outputBuffer_.writeFd(channel_->fd(), &saveErrno);
-        if(n > 0)
+        ssize_t n = writeOutput(&saveErrno);
+        if(n >= 0)  // 0 only when a truncated file region was dropped
         {
-            outputBuffer_.retrieve(n);
-            if(outputBuffer_.readableBytes() == 0)
+            checkLowWaterMark();
+            updateBufferedBytes();
+            if(outputBytes() == 0)
             {
-                channel_->disableWriting();
-                if(writeCompleteCallback_)
-                {
-                    loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
-                }
-                if(state_ == KDisconnecting)
-                {
-                    shutdownInLoop();
-                }
+                writeCompleted();
             }
         }
-        else
+        else if(saveErrno != EAGAIN)    // a send of the ring still in flight
         {
             LOG_ERROR("TcpConnection::handleWrite\n");
         }
     }
     else
     {
-        LOG_ERROR("TcpConnection fd=%d is down, no more writing \n", channel_->fd());
+        LOG_ERROR("TcpConnection fd=%d is down, no more writing \n", channel_.fd());
+    }
+}
+// outputBuffer_ is drained
+void TcpConnection::writeCompleted()
+{
+    channel_.disableWriting();
+    if(callbacks_->writeCompleteCallback)
+    {
+        loop_->queueInLoop(std::bind(callbacks_->writeCompleteCallback, shared_from_this()));
+    }
+    if(state_ == KDisconnecting)
+    {
+        shutdownInLoop();
+    }
+}
+
+// no new edge comes until the socket is drained, so read until EAGAIN,
+// a stream that uses up ioBudget_ is continued after the other channels
+void TcpConnection::handleReadEdge(Timestamp receiveTime)
+{
+    if(state_ == kDisconnected || !reading_)
+    {
+        return; // closed or stopped before the continuation ran
+    }
+
+    size_t total = 0;
+    bool eof = false;
+    bool failed = false;
+    int saveErrno = 0;
+    while(total < ioBudget_ && !inputOverHighWaterMark())
+    {
+        ssize_t n = inputBuffer_.readFd(channel_.fd(), &saveErrno, rxTimestamps_);
+        if(n == 0)
+        {
+            eof = true;
+            break;
+        }
+        if(n < 0)
+        {
+            failed = true;
+            break;
+        }
+        total += n;
+    }
+
+    if(total > 0)
+    {
+        deliverMessage(receiveTime);
+        updateBufferedBytes();
+    }
+
+    if(eof)
+    {
+        handleClose();
+    }
+    else if(failed)
+    {
+        if(saveErrno != EAGAIN && saveErrno != EWOULDBLOCK)
+        {
+            errno = saveErrno;
+            LOG_ERROR("TcpConnection::handleRead\n");
+            handleError();
+        }
+    }
+    else if(state_ != kDisconnected && reading_)
+    {
+        if(inputOverHighWaterMark())
+        {
+            // resumed above the mark, or the callback left it there:
+            // pause again, the socket still holds the rest
+            stopReadInLoop();
+            inputPaused_ = true;
+        }
+        else
+        {
+            loop_->queueInLoop(std::bind(&TcpConnection::handleReadEdge,
+                                        shared_from_this(), receiveTime));
+        }
+    }
+}
+
+size_t TcpConnection::inputRoom() const
+{
+    size_t readable = inputBuffer_.readableBytes();
+    if(inputHighWaterMark_ == 0)
+    {
+        return SIZE_MAX;
+    }
+    return readable <= inputHighWaterMark_ ? inputHighWaterMark_ - readable + 1 : 1;
+}
+
+// completion mode: the ring has read already, take what it got
+void TcpConnection::handleReadCompletion(Timestamp receiveTime)
+{
+    if(state_ == kDisconnected || !reading_)
+    {
+        return;
+    }
+    int saveErrno = 0;
+    ssize_t n = loop_->takeReceived(&channel_, &inputBuffer_, inputRoom(), &saveErrno);
+    if(n > 0)
+    {
+        deliverMessage(receiveTime);
+        updateBufferedBytes();
+        if(state_ == kDisconnected || !reading_)
+        {
+            return; // an end of the stream behind the data waits for startRead
+        }
+        n = loop_->takeReceived(&channel_, &inputBuffer_, inputRoom(), &saveErrno);
+    }
+
+    if(n == 0)
+    {
+        handleClose();
+    }
+    else if(n < 0 && saveErrno != EAGAIN)
+    {
+        // the recv is not armed again, nothing else would close the connection
+        errno = saveErrno;
+        LOG_ERROR("TcpConnection::handleRead\n");
+        handleError();
+        handleClose();
+    }
+}
+
+void TcpConnection::handleWriteEdge()
+{
+    if(!channel_.isWriting() || state_ == kDisconnected)
+    {
+        return; // EPOLLOUT is always registered, nothing to write is normal
+    }
+
+    size_t total = 0;
+    while(outputBytes() > 0 && total < ioBudget_)
+    {
+        int saveErrno = 0;
+        ssize_t n = writeOutput(&saveErrno);
+        if(n < 0)
+        {
+            if(saveErrno != EAGAIN && saveErrno != EWOULDBLOCK)
+            {
+                LOG_ERROR("TcpConnection::handleWrite\n");
+            }
+            checkLowWaterMark();
+            updateBufferedBytes();
+            return; // the next EPOLLOUT edge brings us back
+        }
+        total += n;
+    }
+
+    checkLowWaterMark();
+    updateBufferedBytes();
+    if(outputBytes() == 0)
+    {
+        writeCompleted();
+    }
+    else
+    {
+        loop_->queueInLoop(std::bind(&TcpConnection::handleWriteEdge, shared_from_this()));
     }
 }
+
 void TcpConnection::handleClose()
 {
-    LOG_INFO("fd = %d state = %d \n", channel_->fd(), state_.load());
+    LOG_INFO("fd = %d state = %d \n", channel_.fd(), state_.load());
     setState(kDisconnected);
-    channel_->disableAll();
+    channel_.disableAll();
+    // nothing goes out any more, give the memory back now
+    outputBuffer_.retrieveAll();
+    regions_.clear();
+    regionQueueBytes_ = 0;
+    ringQueueBytes_ = 0;
+    fileQueueBytes_ = 0;
+    closeSpool();
+    updateBufferedBytes();
+    if(flowSourcePaused_)
+    {
+        // nothing more goes out here, don't leave the source stalled
+        flowSourcePaused_ = false;
+        TcpConnectionPtr source(flowSource_.lock());
+        if(source)
+        {
+            source->startRead();
+        }
+    }
 
     TcpConnectionPtr connPtr(shared_from_this());
-    connectionCallback_(connPtr);   // 执行连接关闭的回调
-    closeCallback_(connPtr);    // 关闭连接的回调
+    callbacks_->connectionCallback(connPtr);   // 执行连接关闭的回调
+    callbacks_->closeCallback(connPtr);    // 关闭连接的回调
 }
 void TcpConnection::handleError()
 {
+    // the MSG_ZEROCOPY notifications come as EPOLLERR too
+    bool zeroCopyDone = zeroCopy_ && handleZeroCopyCompletions();
     int optval;
     socklen_t optlen = static_cast<socklen_t>(sizeof optval);
     int err = 0;
-    if(getsockopt(channel_->fd(), SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
+    if(getsockopt(channel_.fd(), SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
     {
         err = errno;
     }
@@ -126,24 +410,210 @@ void TcpConnection::handleError()
         err = optval;
     }
 
+    if(zeroCopyDone && err == 0)
+    {
+        return;
+    }
     LOG_ERROR("TcpConnection::handleError name:%s - SO_ERROR:%d \n", name_.c_str(), optval);
 }
 
 // 提供给用户的接口
+void TcpConnection::send(const void *data, size_t len)
+{
+    if(state_ == kConnected)
+    {
+        if(loop_->isInLoopThread())
+        {
+            sendInLoop(data, len);
+        }
+        else
+        {
+            // the caller's bytes may be gone when the task runs
+            loop_->runInLoop(std::bind(&TcpConnection::sendStringInLoop, shared_from_this(),
+                                       std::string(static_cast<const char*>(data), len)));
+        }
+    }
+}
+
 void TcpConnection::send(const std::string& buf)
 {
     if(state_ == kConnected)
     {
         if(loop_->isInLoopThread())
         {
-            sendInLoop(buf.c_str(), buf.size());
+            sendInLoop(buf.data(), buf.size());
+        }
+        else
+        {
+            loop_->runInLoop(std::bind(&TcpConnection::sendStringInLoop,
+                                       shared_from_this(), buf));
+        }
+    }
+}
+
+void TcpConnection::send(std::string&& buf)
+{
+    if(state_ == kConnected)
+    {
+        if(loop_->isInLoopThread())
+        {
+            sendInLoop(buf.data(), buf.size());
+        }
+        else
+        {
+            // the task owns the string now, no copy
+            loop_->runInLoop(std::bind(&TcpConnection::sendStringInLoop,
+                                       shared_from_this(), std::move(buf)));
+        }
+    }
+}
+
+void TcpConnection::send(Buffer *buf)
+{
+    if(state_ == kConnected)
+    {
+        if(loop_->isInLoopThread())
+        {
+            sendBufferInLoop(buf);
+        }
+        else
+        {
+            std::shared_ptr<Buffer> moved = std::make_shared<Buffer>();
+            moved->swap(*buf);
+            void (TcpConnection::*fn)(const std::shared_ptr<Buffer>&) = &TcpConnection::sendBufferInLoop;
+            loop_->runInLoop(std::bind(fn, shared_from_this(), std::move(moved)));
+        }
+    }
+}
+
+void TcpConnection::sendBufferInLoop(const std::shared_ptr<Buffer>& buf)
+{
+    sendBufferInLoop(buf.get());
+}
+
+// like sendInLoop, but the rest is moved from buf chunk by chunk
+void TcpConnection::sendBufferInLoop(Buffer *buf)
+{
+    if(state_ == kDisconnected)
+    {
+        LOG_ERROR("disconnected, give up writing\n");
+        buf->retrieveAll();
+        return;
+    }
+
+    bool written = false;
+    if(canWriteDirectly())
+    {
+        int saveErrno = 0;
+        ssize_t n = buf->writeFd(channel_.fd(), &saveErrno);
+        if(n >= 0)
+        {
+            written = n > 0;
+            buf->retrieve(n);
+            if(buf->readableBytes() == 0)
+            {
+                buf->retrieveAll();
+                if(callbacks_->writeCompleteCallback)
+                {
+                    loop_->queueInLoop(std::bind(callbacks_->writeCompleteCallback,
+                                                shared_from_this()));
+                }
+                return;
+            }
+        }
+        else if(saveErrno != EWOULDBLOCK)
+        {
+            LOG_ERROR("TcpConnection::sendBufferInLoop err:%d\n", saveErrno);
+            buf->retrieveAll();
+            return;
+        }
+    }
+
+    if(!admitOutput(buf->readableBytes(), written))
+    {
+        buf->retrieveAll();
+        return;
+    }
+    appendOutput(buf);
+    startWriting();
+}
+
+void TcpConnection::send(const struct iovec *iov, int iovcnt)
+{
+    if(state_ == kConnected)
+    {
+        if(loop_->isInLoopThread())
+        {
+            sendIovInLoop(iov, iovcnt);
         }
         else
         {
-            loop_->runInLoop(std::bind(&TcpConnection::sendInLoop, this, buf.c_str(), buf.size()));
+            // gathered into one string owned by the task
+            std::string buf;
+            for(int i = 0; i < iovcnt; ++i)
+            {
+                buf.append(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+            }
+            loop_->runInLoop(std::bind(&TcpConnection::sendStringInLoop,
+                                       shared_from_this(), std::move(buf)));
+        }
+    }
+}
+
+// like sendInLoop, one writev for all the pieces
+void TcpConnection::sendIovInLoop(const struct iovec *iov, int iovcnt)
+{
+    if(state_ == kDisconnected)
+    {
+        LOG_ERROR("disconnected, give up writing\n");
+        return;
+    }
+
+    size_t total = 0;
+    for(int i = 0; i < iovcnt; ++i)
+    {
+        total += iov[i].iov_len;
+    }
+    size_t nwrote = 0;
+    if(canWriteDirectly())
+    {
+        ssize_t n = ::writev(channel_.fd(), iov, std::min(iovcnt, IOV_MAX));
+        if(n >= 0)
+        {
+            nwrote = n;
+            if(nwrote == total)
+            {
+                if(callbacks_->writeCompleteCallback)
+                {
+                    loop_->queueInLoop(std::bind(callbacks_->writeCompleteCallback,
+                                                shared_from_this()));
+                }
+                return;
+            }
+        }
+        else if(errno != EWOULDBLOCK)
+        {
+            LOG_ERROR("TcpConnection::sendIovInLoop err:%d\n", errno);
+            return;
+        }
+    }
 
+    if(!admitOutput(total - nwrote, nwrote > 0))
+    {
+        return;
+    }
+    for(int i = 0; i < iovcnt; ++i)
+    {
+        size_t len = iov[i].iov_len;
+        if(nwrote >= len)
+        {
+            nwrote -= len;
+            continue;
         }
+        appendOutput(static_cast<const char*>(iov[i].iov_base) + nwrote, len - nwrote);
+        nwrote = 0;
     }
+    startWriting();
 }
 
 void TcpConnection::sendInLoop(const void *data, size_t len)
@@ -159,17 +629,17 @@ void TcpConnection::sendInLoop(const void *data, size_t len)
     }
 
     // 表示channel_第一次开始写数据，而且缓冲区没有
-    if(!channel_->isWriting() && outputBuffer_.readableBytes() == 0)
+    if(canWriteDirectly())
     {
-        nwrote = write(channel_->fd(), data, len);
+        nwrote = write(channel_.fd(), data, len);
         if(nwrote >= 0)
         {
             remaining = len - nwrote;
-            if(remaining == 0 && writeCompleteCallback_)
+            if(remaining == 0 && callbacks_->writeCompleteCallback)
             {
                 // 表示一次性将数据全部发送到内核缓冲区
                 // 无须再设置 epollout 事件
-                loop_->queueInLoop(std::bind(writeCompleteCallback_,
+                loop_->queueInLoop(std::bind(callbacks_->writeCompleteCallback,
                                             shared_from_this()));
             }
         }
@@ -189,50 +659,904 @@ void TcpConnection::sendInLoop(const void *data, size_t len)
     // 内核缓冲区不够用，待发送数据仍有剩余
     // 注册 epollout 事件，注册 epollout事件
     // 剩余的数据通过 handleWrite中通过
-    if(!faultError && remaining > 0)
+    if(!faultError && remaining > 0 && admitOutput(remaining, nwrote > 0))
     {
-        size_t oldLen = outputBuffer_.readableBytes();
-        if(oldLen + remaining > highWaterMark_ && oldLen < highWaterMark_
-            && highWaterMarkCallback_)
-        {
-            loop_->queueInLoop(std::bind(highWaterMarkCallback_, shared_from_this(), oldLen + remaining));
-        }
-        outputBuffer_.append((char*)data + nwrote, remaining);
-        if(!channel_->isWriting())
-        {
-            channel_->enableWriting();
-        }
+        appendOutput(static_cast<const char*>(data) + nwrote, remaining);
+        startWriting();
     }
 }
 
-
-void TcpConnection::shutdownInLoop()
+void TcpConnection::sendFile(int fd, off_t offset, size_t length)
 {
-    if(!channel_->isWriting())
+    if(state_ == kConnected)
     {
-        socket_->shutdownWrite();
+        int dupfd = ::dup(fd);
+        if(dupfd < 0)
+        {
+            LOG_ERROR("TcpConnection::sendFile dup err:%d\n", errno);
+            return;
+        }
+        loop_->runInLoop(std::bind(&TcpConnection::sendFileInLoop, shared_from_this(),
+                                   dupfd, offset, length));
     }
 }
 
-void TcpConnection::shutdown()
+// like sendInLoop, sendfile right away when nothing is queued
+void TcpConnection::sendFileInLoop(int fd, off_t offset, size_t length)
 {
-    if(state_ == kConnected)
+    if(state_ == kDisconnected)
     {
-        setState(KDisconnecting);
-        loop_->runInLoop(std::bind(&TcpConnection::shutdownInLoop, this));
+        LOG_ERROR("disconnected, give up writing\n");
+        ::close(fd);
+        return;
     }
-}
+
+    if(canWriteDirectly())
+    {
+        ssize_t n = ::sendfile(channel_.fd(), fd, &offset, length);
+        if(n >= 0)
+        {
+            length -= n;
+        }
+        else if(errno != EWOULDBLOCK)
+        {
+            LOG_ERROR("TcpConnection::sendFileInLoop err:%d\n", errno);
+            ::close(fd);
+            return;
+        }
+        if(length == 0)
+        {
+            ::close(fd);
+            if(callbacks_->writeCompleteCallback)
+            {
+                loop_->queueInLoop(std::bind(callbacks_->writeCompleteCallback,
+                                            shared_from_this()));
+            }
+            return;
+        }
+    }
+
+    checkHighWaterMark(outputBytes(), length);
+    regions_.emplace_back(fd, offset, length);
+    regionQueueBytes_ += length;
+    fileQueueBytes_ += length;
+    startWriting();
+}
+
+void TcpConnection::send(const PayloadPtr& payload)
+{
+    if(state_ == kConnected && payload && !payload->empty())
+    {
+        if(loop_->isInLoopThread())
+        {
+            sendPayloadInLoop(payload);
+        }
+        else
+        {
+            loop_->runInLoop(std::bind(&TcpConnection::sendPayloadInLoop,
+                                       shared_from_this(), payload));
+        }
+    }
+}
+
+void TcpConnection::sendPayloadInLoop(const PayloadPtr& payload)
+{
+    size_t len = payload->size();
+    if(state_ == kDisconnected)
+    {
+        LOG_ERROR("disconnected, give up writing\n");
+        return;
+    }
+
+    size_t nwrote = 0;
+    if(canWriteDirectly())
+    {
+        int saveErrno = 0;
+        ssize_t n = writePayload(payload, 0, len, &saveErrno, 0);
+        if(n >= 0)
+        {
+            nwrote = n;
+            if(nwrote == len)
+            {
+                if(callbacks_->writeCompleteCallback)
+                {
+                    loop_->queueInLoop(std::bind(callbacks_->writeCompleteCallback,
+                                                shared_from_this()));
+                }
+                return;
+            }
+        }
+        else if(saveErrno != EWOULDBLOCK)
+        {
+            LOG_ERROR("TcpConnection::sendPayloadInLoop err:%d\n", saveErrno);
+            return;
+        }
+    }
+
+    if(!admitOutput(len - nwrote, nwrote > 0))
+    {
+        return;
+    }
+    regions_.emplace_back(payload, nwrote, len - nwrote);
+    regionQueueBytes_ += len - nwrote;
+    startWriting();
+}
+
+ssize_t TcpConnection::writePayload(const PayloadPtr& payload, size_t offset, size_t len,
+                                    int *saveErrno, int flags)
+{
+    if(zeroCopy_ && payload->size() >= zeroCopyThreshold_)
+    {
+        return sendZeroCopy(payload, offset, len, saveErrno, flags);
+    }
+    ssize_t n = ::send(channel_.fd(), payload->data() + offset, len, flags);
+    if(n < 0)
+    {
+        *saveErrno = errno;
+    }
+    return n;
+}
+
+ssize_t TcpConnection::sendZeroCopy(const PayloadPtr& payload, size_t offset, size_t len,
+                                    int *saveErrno, int flags)
+{
+    const char *data = payload->data() + offset;
+    ssize_t n = ::send(channel_.fd(), data, len, MSG_ZEROCOPY | flags);
+    if(n < 0 && errno == ENOBUFS)
+    {
+        // out of optmem for pinning pages, copy this time
+        n = ::send(channel_.fd(), data, len, flags);
+    }
+    else if(n > 0)
+    {
+        // every successful MSG_ZEROCOPY send takes the next number,
+        // the payload is pinned until that number is notified
+        uint32_t seq = zeroCopySeq_++;
+        if(!zeroCopyPending_.empty() && zeroCopyPending_.back().payload == payload)
+        {
+            zeroCopyPending_.back().lastSeq = seq;
+        }
+        else
+        {
+            zeroCopyPending_.push_back(ZeroCopyPending{seq, payload});
+        }
+    }
+    if(n < 0)
+    {
+        *saveErrno = errno;
+    }
+    return n;
+}
+
+bool TcpConnection::handleZeroCopyCompletions()
+{
+    return reapZeroCopy(channel_.fd(), &zeroCopyPending_);
+}
+
+bool TcpConnection::reapZeroCopy(int fd, std::deque<ZeroCopyPending> *pending)
+{
+    bool handled = false;
+    char control[128];
+    for(;;)
+    {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof msg);
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof control;
+        if(::recvmsg(fd, &msg, MSG_ERRQUEUE) < 0)
+        {
+            break;  // EAGAIN, the error queue is empty
+        }
+        for(struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm))
+        {
+            if(!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+                || (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)))
+            {
+                continue;
+            }
+            const struct sock_extended_err *serr =
+                reinterpret_cast<const struct sock_extended_err*>(CMSG_DATA(cm));
+            if(serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+            {
+                continue;
+            }
+            // sends [ee_info, ee_data] are done, TCP notifies them in order
+            uint32_t hi = serr->ee_data;
+            while(!pending->empty()
+                && static_cast<int32_t>(pending->front().lastSeq - hi) <= 0)
+            {
+                pending->pop_front();
+            }
+            handled = true;
+        }
+    }
+    return handled;
+}
+
+TcpConnection::ZeroCopyOrphans::~ZeroCopyOrphans()
+{
+    // the loop thread exits, the payloads still pinned must not be freed
+    reapZeroCopyOrphans(&orphans);
+    if(!orphans.empty())
+    {
+        SharedZeroCopyOrphans &shared = sharedZeroCopyOrphans();
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        for(ZeroCopyOrphan &orphan : orphans)
+        {
+            shared.orphans.push_back(std::move(orphan));
+        }
+    }
+}
+
+TcpConnection::ZeroCopyOrphans& TcpConnection::zeroCopyOrphans()
+{
+    static thread_local ZeroCopyOrphans orphans;
+    return orphans;
+}
+
+TcpConnection::SharedZeroCopyOrphans& TcpConnection::sharedZeroCopyOrphans()
+{
+    // never destroyed, the exit handlers would free pinned payloads too
+    static SharedZeroCopyOrphans *shared = new SharedZeroCopyOrphans;
+    return *shared;
+}
+
+void TcpConnection::reapZeroCopyOrphans(std::vector<ZeroCopyOrphan> *orphans)
+{
+    size_t kept = 0;
+    for(size_t i = 0; i < orphans->size(); ++i)
+    {
+        ZeroCopyOrphan &orphan = (*orphans)[i];
+        if(orphan.fd >= 0)
+        {
+            reapZeroCopy(orphan.fd, &orphan.pending);
+        }
+        if(orphan.pending.empty())
+        {
+            ::close(orphan.fd);
+        }
+        else
+        {
+            if(kept != i)
+            {
+                (*orphans)[kept] = std::move(orphan);
+            }
+            ++kept;
+        }
+    }
+    orphans->erase(orphans->begin() + kept, orphans->end());
+}
+
+// in the loop thread, the socket is about to be closed
+void TcpConnection::orphanZeroCopy()
+{
+    int fd = ::dup(socket_.fd());
+    if(fd < 0)
+    {
+        // no way to hear of them, freeing them could change bytes still
+        // being sent, they are kept until the process exits
+        LOG_ERROR("TcpConnection::orphanZeroCopy dup error:%d, %zu payloads kept\n",
+                  errno, zeroCopyPending_.size());
+        SharedZeroCopyOrphans &shared = sharedZeroCopyOrphans();
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        shared.orphans.push_back(ZeroCopyOrphan{-1, std::move(zeroCopyPending_)});
+        return;
+    }
+    // the FIN a close() would send, the dup keeps the socket open
+    ::shutdown(fd, SHUT_WR);
+
+    std::vector<ZeroCopyOrphan> &orphans = zeroCopyOrphans().orphans;
+    orphans.push_back(ZeroCopyOrphan{fd, std::move(zeroCopyPending_)});
+    if(orphans.size() == 1)
+    {
+        EventLoop *loop = loop_;
+        loop_->runAfter(kZeroCopyReapSeconds, [loop](){ reapZeroCopyOrphansInLoop(loop); });
+    }
+}
+
+void TcpConnection::reapZeroCopyOrphansInLoop(EventLoop *loop)
+{
+    std::vector<ZeroCopyOrphan> &orphans = zeroCopyOrphans().orphans;
+    reapZeroCopyOrphans(&orphans);
+    {
+        // those of the loop threads that are gone, if no other loop has them
+        SharedZeroCopyOrphans &shared = sharedZeroCopyOrphans();
+        std::unique_lock<std::mutex> lock(shared.mutex, std::try_to_lock);
+        if(lock.owns_lock())
+        {
+            reapZeroCopyOrphans(&shared.orphans);
+        }
+    }
+    if(!orphans.empty())
+    {
+        loop->runAfter(kZeroCopyReapSeconds, [loop](){ reapZeroCopyOrphansInLoop(loop); });
+    }
+}
+
+TcpConnection::OutputRegion::~OutputRegion()
+{
+    if(fd >= 0 && !spooled)
+    {
+        ::close(fd);
+    }
+}
+
+bool TcpConnection::admitOutput(size_t len, bool partlyWritten)
+{
+    // the rest of a partly written send must go, or the stream is torn
+    if(budget_ && budget_->policy() == MemoryBudget::kRejectSends
+        && !partlyWritten && budget_->exceeded(len))
+    {
+        budget_->addRejectedSend();
+        return false;
+    }
+    checkHighWaterMark(outputBytes(), len);
+    return true;
+}
+
+void TcpConnection::updateBufferedBytes()
+{
+    size_t bytes = inputBuffer_.readableBytes() + outputBytes() - fileQueueBytes_;
+    if(bytes != accountedBytes_)
+    {
+        loop_->addBufferedBytes(static_cast<int64_t>(bytes) - static_cast<int64_t>(accountedBytes_));
+        accountedBytes_ = bytes;
+    }
+}
+
+void TcpConnection::checkHighWaterMark(size_t oldLen, size_t addLen)
+{
+    if(oldLen == 0 && addLen > 0)
+    {
+        // the stall clock starts when something is left queued
+        writeProgressTime_ = loop_->pollReturnTime();
+    }
+    if(!flowSourcePaused_ && flowHighWaterMark_ > 0 && oldLen + addLen > flowHighWaterMark_)
+    {
+        TcpConnectionPtr source(flowSource_.lock());
+        if(source)
+        {
+            source->stopRead();
+            flowSourcePaused_ = true;
+        }
+    }
+    if(oldLen + addLen > highWaterMark_ && oldLen < highWaterMark_
+        && callbacks_->highWaterMarkCallback)
+    {
+        loop_->queueInLoop(std::bind(callbacks_->highWaterMarkCallback,
+                                     shared_from_this(), oldLen + addLen));
+    }
+}
+
+void TcpConnection::checkLowWaterMark()
+{
+    if(flowSourcePaused_ && outputBytes() <= flowLowWaterMark_)
+    {
+        flowSourcePaused_ = false;
+        TcpConnectionPtr source(flowSource_.lock());
+        if(source)
+        {
+            source->startRead();
+        }
+    }
+}
+
+void TcpConnection::setFlowControl(const TcpConnectionPtr& source,
+                                   size_t highWaterMark, size_t lowWaterMark)
+{
+    TcpConnectionPtr old(flowSource_.lock());
+    if(flowSourcePaused_ && old && old != source)
+    {
+        old->startRead();
+    }
+    flowSourcePaused_ = flowSourcePaused_ && old && old == source;
+    flowSource_ = source;
+    flowHighWaterMark_ = source ? highWaterMark : 0;
+    flowLowWaterMark_ = std::min(lowWaterMark, highWaterMark);
+    checkHighWaterMark(outputBytes(), 0);
+    checkLowWaterMark();
+}
+
+void TcpConnection::appendOutput(const char *data, size_t len)
+{
+    if(spool_ && memoryOutputBytes() + len > spoolThreshold_)
+    {
+        // up to the threshold stays in memory, the rest goes after it
+        size_t keep = std::min(len, spoolThreshold_ - std::min(spoolThreshold_, memoryOutputBytes()));
+        if(keep > 0)
+        {
+            spool_ = false;
+            appendOutput(data, keep);
+            spool_ = true;
+        }
+        size_t spooled = spoolOutput(data + keep, len - keep);
+        data += keep + spooled;
+        len -= keep + spooled;
+        if(len == 0)
+        {
+            return;
+        }
+    }
+    if(regions_.empty())
+    {
+        outputBuffer_.append(data, len);
+    }
+    else
+    {
+        regions_.back().trailer.append(data, len);
+        regionQueueBytes_ += len;
+    }
+}
+
+void TcpConnection::appendOutput(Buffer *buf)
+{
+    // the chunks aren't split, all of buf is spooled or none
+    if(spool_ && memoryOutputBytes() + buf->readableBytes() > spoolThreshold_)
+    {
+        spoolOutput(buf);
+        if(buf->readableBytes() == 0)
+        {
+            return;
+        }
+    }
+    if(regions_.empty())
+    {
+        outputBuffer_.append(buf);
+    }
+    else
+    {
+        regionQueueBytes_ += buf->readableBytes();
+        regions_.back().trailer.append(buf);
+    }
+}
+
+bool TcpConnection::openSpool()
+{
+    spoolFd_ = ::open(spoolDir_.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if(spoolFd_ < 0)
+    {
+        // no O_TMPFILE here, unlink a named one right away
+        std::string path = spoolDir_ + "/mymuduo-spool-XXXXXX";
+        spoolFd_ = ::mkstemp(&path[0]);
+        if(spoolFd_ >= 0)
+        {
+            ::unlink(path.c_str());
+        }
+    }
+    if(spoolFd_ < 0)
+    {
+        LOG_ERROR("TcpConnection::openSpool %s err:%d, keep the output in memory\n",
+                  spoolDir_.c_str(), errno);
+        spool_ = false;
+        return false;
+    }
+    spoolEnd_ = 0;
+    return true;
+}
+
+bool TcpConnection::readySpool()
+{
+    // a stream that never drains moves on to a new file now and then and
+    // the full one is closed once sent; punching holes behind it instead
+    // isn't safe, sendfile leaves the socket referencing the page cache and
+    // a punch zeroes the parts of a large folio it can't drop whole
+    if(spoolFd_ >= 0 && spoolEnd_ >= static_cast<off_t>(kSpoolFileBytes))
+    {
+        fullSpools_.push_back(spoolFd_);
+        spoolFd_ = -1;
+    }
+    return spoolFd_ >= 0 || openSpool();
+}
+
+size_t TcpConnection::spoolOutput(const char *data, size_t len)
+{
+    if(!readySpool())
+    {
+        return 0;
+    }
+    size_t written = 0;
+    while(written < len)
+    {
+        ssize_t n = ::pwrite(spoolFd_, data + written, len - written, spoolEnd_ + written);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            LOG_ERROR("TcpConnection::spoolOutput err:%d\n", errno);
+            break;
+        }
+        written += n;
+    }
+    queueSpooled(written);
+    return written;
+}
+
+size_t TcpConnection::spoolOutput(Buffer *buf)
+{
+    if(!readySpool())
+    {
+        return 0;
+    }
+    // writeFd writes at the file position, keep it at spoolEnd_
+    ::lseek(spoolFd_, spoolEnd_, SEEK_SET);
+    size_t written = 0;
+    while(buf->readableBytes() > 0)
+    {
+        int saveErrno = 0;
+        ssize_t n = buf->writeFd(spoolFd_, &saveErrno);
+        if(n <= 0)
+        {
+            if(n < 0 && saveErrno == EINTR)
+            {
+                continue;
+            }
+            LOG_ERROR("TcpConnection::spoolOutput err:%d\n", saveErrno);
+            break;
+        }
+        buf->retrieve(n);
+        written += n;
+    }
+    queueSpooled(written);
+    return written;
+}
+
+void TcpConnection::queueSpooled(size_t len)
+{
+    if(len == 0)
+    {
+        return;
+    }
+    // right after the spooled region at the tail, grow it
+    OutputRegion *tail = regions_.empty() ? nullptr : &regions_.back();
+    if(tail && tail->spooled && tail->trailer.readableBytes() == 0
+        && tail->offset + static_cast<off_t>(tail->remaining) == spoolEnd_)
+    {
+        tail->remaining += len;
+    }
+    else
+    {
+        regions_.emplace_back(spoolFd_, spoolEnd_, len, true);
+    }
+    spoolEnd_ += len;
+    regionQueueBytes_ += len;
+    fileQueueBytes_ += len;
+    spoolQueueBytes_ += len;
+}
+
+void TcpConnection::releaseSpool(int fd)
+{
+    if(fd != spoolFd_)
+    {
+        // the full files are sent in order, fd is the first one
+        for(const OutputRegion& region : regions_)
+        {
+            if(region.spooled && region.fd == fd)
+            {
+                return;
+            }
+        }
+        ::close(fd);
+        fullSpools_.pop_front();
+    }
+    else if(spoolQueueBytes_ == 0)
+    {
+        // all sent, start over at the beginning of an empty file
+        if(::ftruncate(spoolFd_, 0) < 0)
+        {
+            LOG_ERROR("TcpConnection::releaseSpool ftruncate err:%d\n", errno);
+        }
+        spoolEnd_ = 0;
+    }
+}
+
+void TcpConnection::closeSpool()
+{
+    if(spoolFd_ >= 0)
+    {
+        ::close(spoolFd_);
+        spoolFd_ = -1;
+    }
+    for(int fd : fullSpools_)
+    {
+        ::close(fd);
+    }
+    fullSpools_.clear();
+    spoolQueueBytes_ = 0;
+}
+
+ssize_t TcpConnection::writeOutput(int *saveErrno)
+{
+    if(channel_.completion())
+    {
+        // the ring sends the memory output, the write event says what it took
+        ssize_t n = 0;
+        if(ringQueueBytes_ > 0)
+        {
+            n = loop_->takeSent(&channel_, saveErrno);
+            if(n < 0)
+            {
+                if(*saveErrno != EAGAIN)
+                {
+                    ringQueueBytes_ = 0;    // the ring dropped the rest
+                }
+                return n;
+            }
+            ringQueueBytes_ -= n;
+            writeProgressTime_ = loop_->pollReturnTime();
+        }
+        submitOutput();
+        if(ringQueueBytes_ > 0 || regions_.empty())
+        {
+            return n;
+        }
+        // the memory before the regions is out, they are written here
+    }
+
+    // batched, tell TCP more follows so a small head isn't pushed alone
+    int flags = 0;
+    if(outputBuffer_.readableBytes() > 0 || regions_.empty())
+    {
+        if(batchedFlush_ && !regions_.empty())
+        {
+            flags = MSG_MORE;
+        }
+        ssize_t n = outputBuffer_.writeFd(channel_.fd(), saveErrno, flags);
+        if(n > 0)
+        {
+            outputBuffer_.retrieve(n);
+            writeProgressTime_ = loop_->pollReturnTime();
+        }
+        return n;
+    }
+
+    OutputRegion &region = regions_.front();
+    ssize_t n = 0;
+    if(region.payload)
+    {
+        if(batchedFlush_ && (region.trailer.readableBytes() > 0 || regions_.size() > 1))
+        {
+            flags = MSG_MORE;
+        }
+        n = writePayload(region.payload, region.offset, region.remaining, saveErrno, flags);
+        if(n < 0)
+        {
+            return n;
+        }
+        region.offset += n;
+        region.remaining -= n;
+        regionQueueBytes_ -= n;
+    }
+    else if(region.remaining > 0)
+    {
+        n = ::sendfile(channel_.fd(), region.fd, &region.offset, region.remaining);
+        if(n < 0)
+        {
+            *saveErrno = errno;
+            return n;
+        }
+        // a file shorter than asked skips the rest of the region
+        size_t done = n > 0 ? static_cast<size_t>(n) : region.remaining;
+        if(n == 0)
+        {
+            LOG_ERROR("TcpConnection::writeOutput file fd=%d ends early\n", region.fd);
+        }
+        region.remaining -= done;
+        regionQueueBytes_ -= done;
+        fileQueueBytes_ -= done;
+        if(region.spooled)
+        {
+            spoolQueueBytes_ -= done;
+        }
+    }
+    if(n > 0)
+    {
+        writeProgressTime_ = loop_->pollReturnTime();
+    }
+
+    if(region.remaining == 0)
+    {
+        // the data sent after the file comes next
+        regionQueueBytes_ -= region.trailer.readableBytes();
+        outputBuffer_.swap(region.trailer);
+        int fd = region.spooled ? region.fd : -1;
+        regions_.pop_front();
+        if(fd >= 0)
+        {
+            releaseSpool(fd);
+        }
+        if(n == 0 && outputBytes() > 0)
+        {
+            return writeOutput(saveErrno);
+        }
+    }
+    return n;
+}
+
+
+void TcpConnection::submitOutput()
+{
+    size_t len = outputBuffer_.readableBytes();
+    if(len > 0)
+    {
+        ringQueueBytes_ += len;
+        loop_->submitSend(&channel_, &outputBuffer_);
+    }
+}
+
+void TcpConnection::startWriting()
+{
+    updateBufferedBytes();
+    if(batchedFlush_)
+    {
+        if(!flushPending_ && !channel_.isWriting())
+        {
+            // after every event and pending functor of this iteration,
+            // sends queued by the functors leave in the same flush
+            flushPending_ = true;
+            loop_->queueAfterFunctors(std::bind(&TcpConnection::flushOutput, shared_from_this()));
+        }
+    }
+    else if(!channel_.isWriting())
+    {
+        if(channel_.completion() && ringQueueBytes_ == 0)
+        {
+            // handed over before the write interest, so the poller
+            // doesn't poll for an EPOLLOUT meanwhile
+            submitOutput();
+        }
+        channel_.enableWriting();
+    }
+}
+
+void TcpConnection::flushOutput()
+{
+    flushPending_ = false;
+    if(state_ == kDisconnected || channel_.isWriting())
+    {
+        return;
+    }
+    while(outputBytes() > 0)
+    {
+        int saveErrno = 0;
+        if(writeOutput(&saveErrno) < 0)
+        {
+            if(saveErrno != EWOULDBLOCK)
+            {
+                LOG_ERROR("TcpConnection::flushOutput err:%d\n", saveErrno);
+                return;
+            }
+            break;
+        }
+    }
+    checkLowWaterMark();
+    updateBufferedBytes();
+    if(outputBytes() == 0)
+    {
+        writeCompleted();
+    }
+    else
+    {
+        channel_.enableWriting();
+    }
+}
+
+void TcpConnection::shutdownInLoop()
+{
+    if(!channel_.isWriting() && !flushPending_)
+    {
+        socket_.shutdownWrite();
+    }
+}
+
+void TcpConnection::forceClose()
+{
+    if(state_ == kConnected || state_ == KDisconnecting)
+    {
+        setState(KDisconnecting);
+        loop_->queueInLoop(std::bind(&TcpConnection::forceCloseInLoop, shared_from_this()));
+    }
+}
+
+void TcpConnection::forceCloseInLoop()
+{
+    if(state_ == kConnected || state_ == KDisconnecting)
+    {
+        handleClose();
+    }
+}
+
+void TcpConnection::startRead()
+{
+    loop_->runInLoop(std::bind(&TcpConnection::startReadInLoop, shared_from_this()));
+}
+
+void TcpConnection::startReadInLoop()
+{
+    inputPaused_ = false;
+    if(!reading_ || !channel_.isReading())
+    {
+        reading_ = true;
+        if(state_ == kConnected || state_ == KDisconnecting)
+        {
+            // edge-triggered: the epoll_ctl reports data that arrived meanwhile
+            channel_.enableReading();
+        }
+    }
+}
+
+void TcpConnection::stopRead()
+{
+    loop_->runInLoop(std::bind(&TcpConnection::stopReadInLoop, shared_from_this()));
+}
+
+void TcpConnection::stopReadInLoop()
+{
+    inputPaused_ = false;
+    if(reading_ || channel_.isReading())
+    {
+        reading_ = false;
+        channel_.disableReading();
+    }
+}
+
+void TcpConnection::shutdown()
+{
+    if(state_ == kConnected)
+    {
+        setState(KDisconnecting);
+        loop_->runInLoop(std::bind(&TcpConnection::shutdownInLoop, this));
+    }
+}
 
 
 void TcpConnection::connectEstablished()
 {
     setState(kConnected);
     // channel_上捆绑TcpConnection,防止后者被销毁
-    channel_->tie(shared_from_this());
-    channel_->enableReading();
+    channel_.tie(shared_from_this());
+    if(completionIo_)
+    {
+        if(loop_->supportsCompletion())
+        {
+            channel_.enableCompletion();
+        }
+        else
+        {
+            LOG_ERROR("TcpConnection::connectEstablished no completion mode in this poller\n");
+            completionIo_ = false;
+        }
+    }
+    if(edgeTriggered_ && loop_->supportsEdgeTriggered() && !completionIo_)
+    {
+        channel_.enableEdgeTriggered();
+    }
+    if(completionIo_ && (zeroCopy_ || rxTimestamps_))
+    {
+        // their notifications come on the error queue and in cmsgs,
+        // which the ring's sends and recvs don't read
+        LOG_ERROR("TcpConnection::connectEstablished zero copy and rx timestamps are off in completion mode\n");
+        zeroCopy_ = false;
+        rxTimestamps_ = false;
+    }
+    if(zeroCopy_ && !socket_.setZeroCopy(true))
+    {
+        LOG_ERROR("TcpConnection::connectEstablished SO_ZEROCOPY unsupported, copy instead\n");
+        zeroCopy_ = false;
+    }
+    if(rxTimestamps_ && !socket_.setRxTimestamps(true))
+    {
+        LOG_ERROR("TcpConnection::connectEstablished SO_TIMESTAMPING unsupported\n");
+        rxTimestamps_ = false;
+    }
+    if(reading_)
+    {
+        channel_.enableReading();
+    }
 
     // 新连接建立，执行回调
-    connectionCallback_(shared_from_this());
+    callbacks_->connectionCallback(shared_from_this());
 }
 
 void TcpConnection::connectDestroyed()
@@ -240,9 +1564,18 @@ void TcpConnection::connectDestroyed()
     if(state_ == kConnected)
     {
         setState(kDisconnected);
-        channel_->disableAll();
+        channel_.disableAll();
+
+        callbacks_->connectionCallback(shared_from_this());
+    }
+    channel_.remove();
 
-        connectionCallback_(shared_from_this());
+    if(!zeroCopyPending_.empty())
+    {
+        handleZeroCopyCompletions();
+    }
+    if(!zeroCopyPending_.empty())
+    {
+        orphanZeroCopy();
     }
-    channel_->remove();
 }
\ No newline at end of file
@@ -2,18 +2,23 @@
 
 #include "Buffer.h"
 #include "Callbacks.h"
+#include "Channel.h"
 #include "InetAddress.h"
 #include "noncopyable.h"
+#include "Socket.h"
 #include "Timestamp.h"
 
 #include <atomic>
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <string>
-#include <string>
+#include <sys/types.h>
+#include <vector>
 
-class Channel;
 class EventLoop;
-class Socket;
+class MemoryBudget;
+struct iovec;
 
 class TcpConnection : noncopyable,
                 public std::enable_shared_from_this<TcpConnection>
@@ -23,11 +28,14 @@ public:
                 const std::string nameArg,
                 int sockfd,
                 const InetAddress& localAddr,
-                const InetAddress& peerAddr);
+                const InetAddress& peerAddr,
+                uint64_t id = 0);
     ~TcpConnection();
 
     EventLoop *getLoop() const { return loop_; }
     const std::string& name() const { return name_; }
+    // unique in its TcpServer
+    uint64_t id() const { return id_; }
     const InetAddress& localAddress() const { return localAddr_; }
     const InetAddress& peerAddress() const { return peerAddr_; }
 
@@ -39,51 +47,327 @@ public:
     void connectDestroyed();
 
     // 发送数据/关闭连接(用户接口)
+    // from another thread the bytes are copied into the queued task, the
+    // rvalue, Buffer and payload overloads hand them over without a copy
+    void send(const void *data, size_t len);
     void send(const std::string& buf);
+    void send(std::string&& buf);
+    // send all of buf and leave it empty, its chunks are moved, not copied
+    void send(Buffer *buf);
+    // the pieces go out with one writev, e.g. a header and a body
+    void send(const struct iovec *iov, int iovcnt);
+    // send [offset, offset + length) of the file with sendfile(2),
+    // queued in order with send(), fd is dup()ed so the caller may close it
+    void sendFile(int fd, off_t offset, size_t length);
+    // the payload is referenced, not copied, until the kernel is done with
+    // it, with zero copy on it is sent by MSG_ZEROCOPY if large enough
+    void send(const PayloadPtr& payload);
     void shutdown();
+    // close now, whatever is still queued is dropped
+    void forceClose();
+    void setTcpNoDelay(bool on) { socket_.setTcpNoDelay(on); }
+
+    // stop/resume reading the socket, the peer is held back by TCP
+    // flow control meanwhile; thread safe
+    void startRead();
+    void stopRead();
+    bool isReading() const { return reading_; }
+
+    // flow control, e.g. a proxy forwarding source to this connection:
+    // source stops reading while more than highWaterMark bytes wait in our
+    // output and reads again once it drains to lowWaterMark,
+    // a proxy sets it both ways; call in our loop, nullptr turns it off
+    void setFlowControl(const TcpConnectionPtr& source,
+                        size_t highWaterMark, size_t lowWaterMark);
+
+    // the input side: reading stops while the message callback leaves more
+    // than highWaterMark bytes in the input buffer and resumes once it is
+    // consumed to lowWaterMark, so a slow consumer doesn't grow it without
+    // bound; highWaterMark must exceed the largest message, 0 turns it off;
+    // call before connectEstablished
+    void setInputWaterMarks(size_t highWaterMark, size_t lowWaterMark)
+    { inputHighWaterMark_ = highWaterMark; inputLowWaterMark_ = std::min(lowWaterMark, highWaterMark); }
+    // in the loop, after consuming input outside the message callback
+    void inputConsumed() { checkInputWaterMarks(); }
+
+    // the bytes queued and not written to the socket yet
+    size_t outputBytes() const
+    { return outputBuffer_.readableBytes() + regionQueueBytes_ + ringQueueBytes_; }
+    // the bytes counted against the memory budget, the input and output
+    // in memory as of the last event handled, in the loop
+    size_t bufferedBytes() const { return accountedBytes_; }
+    // when the output last went from empty to queued, or last made progress
+    Timestamp lastWriteProgress() const { return writeProgressTime_; }
+
+    // with kRejectSends a send that would go over the budget is dropped,
+    // unless part of it is written already; call before connectEstablished
+    void setMemoryBudget(MemoryBudget *budget) { budget_ = budget; }
+
+    // share the callbacks with other connections, the setters below
+    // copy them first when they are shared
+    void setCallbacks(const ConnectionCallbacksPtr& callbacks)
+    { callbacks_ = callbacks; }
 
     void setConnectionCallback(const ConnectionCallback& cb)
-    { connectionCallback_ = cb; }
+    { mutableCallbacks()->connectionCallback = cb; }
     void setMessageCallback(const MessageCallback& cb)
-    { messageCallback_ = cb; }
+    { mutableCallbacks()->messageCallback = cb; }
     void setWriteCompleteCallback(const WriteCompleteCallback& cb)
-    { writeCompleteCallback_ = cb; }
+    { mutableCallbacks()->writeCompleteCallback = cb; }
     void setCloseCallback(const CloseCallback& cb)
-    { closeCallback_ = cb; }
+    { mutableCallbacks()->closeCallback = cb; }
     void setHighWaterMarkCallback(const HighWaterMarkCallback& cb, size_t highWaterMark)
-    { highWaterMarkCallback_ = cb; highWaterMark_ = highWaterMark; }
+    { mutableCallbacks()->highWaterMarkCallback = cb; highWaterMark_ = highWaterMark; }
+
+    // edge-triggered: read/write until EAGAIN, but no more than ioBudget
+    // bytes per loop iteration, the rest is continued in the next one
+    // call before connectEstablished, ignored if the Poller can't do it
+    void setEdgeTriggered(bool on, size_t ioBudget = kDefaultIoBudget)
+    { edgeTriggered_ = on; ioBudget_ = ioBudget; }
+
+    static const size_t kDefaultIoBudget = 1024 * 1024;
+
+    // MSG_ZEROCOPY for the payloads of at least threshold bytes, smaller
+    // ones are cheaper to copy than to pin, call before connectEstablished;
+    // only send(PayloadPtr) can go zero copy, the other sends copy into
+    // the output buffer as usual
+    void setZeroCopy(bool on, size_t threshold = kDefaultZeroCopyThreshold)
+    { zeroCopy_ = on; zeroCopyThreshold_ = threshold; }
+    // payloads the kernel has not released yet
+    size_t zeroCopyPending() const { return zeroCopyPending_.size(); }
+
+    static const size_t kDefaultZeroCopyThreshold = 32 * 1024;
+
+    // spooling: once more than threshold bytes of output wait in memory,
+    // the rest goes to an unlinked temp file in dir and is sent from there
+    // with sendfile, so a slow reader of a huge response costs disk, not
+    // memory; dir should not be a tmpfs; call before connectEstablished
+    void setSpooling(bool on, size_t threshold = kDefaultSpoolThreshold,
+                     const std::string& dir = kDefaultSpoolDir)
+    { spool_ = on; spoolThreshold_ = threshold; spoolDir_ = dir; }
+    // the queued bytes that are in the spool file
+    size_t spooledBytes() const { return spoolQueueBytes_; }
+
+    static const size_t kDefaultSpoolThreshold = 1024 * 1024;
+    static const char kDefaultSpoolDir[];
+
+    // kernel receive timestamps: the reads take the software RX time of
+    // the socket (SO_TIMESTAMPING), the input Buffer's arrivalTime(), and
+    // the delay from it to each message callback goes to the loop's
+    // rxLatency() histogram; call before connectEstablished
+    void setRxTimestamps(bool on) { rxTimestamps_ = on; }
+
+    // batched: sends during a loop iteration only queue the data, it is
+    // flushed once at the end of the iteration, one writev for all the
+    // replies to a pipelined batch, MSG_MORE when a file or payload follows
+    void setBatchedFlush(bool on) { batchedFlush_ = on; }
+
+    // completion mode, when the loop's poller has it (io_uring): the ring
+    // receives into its registered buffers and sends the output, the
+    // handlers make no read or write syscall; files and payloads are still
+    // written on EPOLLOUT, zero copy and rx timestamps are turned off;
+    // call before connectEstablished
+    void setCompletionIo(bool on) { completionIo_ = on; }
 
 private:
     enum StateE {kDisconnected, kConnecting, kConnected, KDisconnecting};
     void setState(StateE state) { state_ = state; }
     void handleRead(Timestamp receiveTime);
     void handleWrite();
+    void handleReadEdge(Timestamp receiveTime);
+    void handleWriteEdge();
+    void handleReadCompletion(Timestamp receiveTime);
+    // completion mode: hand the output before the regions to the ring
+    void submitOutput();
+    void writeCompleted();
     void handleClose();
     void handleError();
 
+    ConnectionCallbacks* mutableCallbacks();
+
     void sendInLoop(const void *data, size_t len);
+    void sendStringInLoop(const std::string& buf) { sendInLoop(buf.data(), buf.size()); }
+    void sendBufferInLoop(const std::shared_ptr<Buffer>& buf);
+    void sendBufferInLoop(Buffer *buf);
+    void sendFileInLoop(int fd, off_t offset, size_t length);
+    void sendPayloadInLoop(const PayloadPtr& payload);
+    void sendIovInLoop(const struct iovec *iov, int iovcnt);
+    ssize_t sendZeroCopy(const PayloadPtr& payload, size_t offset, size_t len,
+                         int *saveErrno, int flags);
+    // MSG_ZEROCOPY for a large payload when on, send() otherwise
+    ssize_t writePayload(const PayloadPtr& payload, size_t offset, size_t len,
+                         int *saveErrno, int flags);
+    // release the payloads the error queue reports done, false if none
+    bool handleZeroCopyCompletions();
     void shutdownInLoop();
+    void forceCloseInLoop();
+    void startReadInLoop();
+    void stopReadInLoop();
+    // resume the flow control source once the output is drained enough
+    void checkLowWaterMark();
+    // pause or resume reading by what is left in the input buffer
+    void checkInputWaterMarks();
+    bool inputOverHighWaterMark() const
+    { return inputHighWaterMark_ > 0 && inputBuffer_.readableBytes() > inputHighWaterMark_; }
+    // completion mode takes no more than goes over the high mark, the rest
+    // stays with the poller until reading resumes
+    size_t inputRoom() const;
+
+    // write the head of the output queue, memory, a file or a payload
+    ssize_t writeOutput(int *saveErrno);
+    // queue data after what is queued now
+    void appendOutput(const char *data, size_t len);
+    void appendOutput(Buffer *buf);
+    // the bytes of the output queue in memory
+    size_t memoryOutputBytes() const { return outputBytes() - fileQueueBytes_; }
+    // write to the end of the spool file and queue it, return the bytes
+    // spooled, the caller keeps the rest in memory when it falls short
+    size_t spoolOutput(const char *data, size_t len);
+    size_t spoolOutput(Buffer *buf);
+    bool openSpool();
+    // the spool file to write to, a new one once the current is full
+    bool readySpool();
+    void queueSpooled(size_t len);
+    // a spooled region on fd is sent, close fd if it is a full file
+    // nothing is queued from anymore, truncate the current one once drained
+    void releaseSpool(int fd);
+    void closeSpool();
+
+    // start a new spool file once this much is written to one
+    static const size_t kSpoolFileBytes = 4 * 1024 * 1024;
+    void checkHighWaterMark(size_t oldLen, size_t addLen);
+    // the message callback, after the wire-to-handler delay is counted
+    void deliverMessage(Timestamp receiveTime);
+    // the budget check and checkHighWaterMark before len more bytes are
+    // queued, false if the send is rejected
+    bool admitOutput(size_t len, bool partlyWritten);
+    // bring the loop's count up to date with the buffers
+    void updateBufferedBytes();
+    // nothing queued, a send may write the socket right away
+    bool canWriteDirectly() const
+    { return !batchedFlush_ && !channel_.completion() && !channel_.isWriting() && outputBytes() == 0; }
+    // wait for EPOLLOUT, or the flush at the end of the iteration when batched
+    void startWriting();
+    void flushOutput();
 
 
     EventLoop *loop_;   // subloop
     const std::string name_;
+    const uint64_t id_;
     std::atomic_int state_;
     bool reading_;
 
     // Acceptor => mainLoop, TcpConnection => subLoop
-    std::unique_ptr<Socket> socket_;
-    std::unique_ptr<Channel> channel_;
+    // kept inline, not two more heap objects per connection
+    Socket socket_;
+    Channel channel_;
 
     const InetAddress localAddr_;
     const InetAddress peerAddr_;
  
-    ConnectionCallback connectionCallback_;
-    MessageCallback messageCallback_;
-    WriteCompleteCallback writeCompleteCallback_;
-    CloseCallback closeCallback_;
-    HighWaterMarkCallback highWaterMarkCallback_;
+    ConnectionCallbacksPtr callbacks_;
     size_t highWaterMark_;
 
+    // see setFlowControl, weak so two paired connections don't keep
+    // each other alive
+    std::weak_ptr<TcpConnection> flowSource_;
+    size_t flowHighWaterMark_;
+    size_t flowLowWaterMark_;
+    bool flowSourcePaused_;
+
+    // see setInputWaterMarks, paused is cleared by startRead/stopRead,
+    // then the caller decides
+    size_t inputHighWaterMark_;
+    size_t inputLowWaterMark_;
+    bool inputPaused_;
+
+    bool edgeTriggered_;
+    size_t ioBudget_;
+
     Buffer inputBuffer_;
     Buffer outputBuffer_;
+
+    // a file or payload waiting in the output queue,
+    // and the data sent after it
+    struct OutputRegion : noncopyable
+    {
+        OutputRegion(int fdArg, off_t offsetArg, size_t length, bool spooledArg = false)
+            : fd(fdArg), spooled(spooledArg), offset(offsetArg), remaining(length)
+        {}
+        OutputRegion(const PayloadPtr& payloadArg, off_t offsetArg, size_t length)
+            : fd(-1), spooled(false), payload(payloadArg), offset(offsetArg), remaining(length)
+        {}
+        ~OutputRegion();
+
+        int fd;     // owned, the dup() of the user's fd, -1 for a payload
+        bool spooled;   // fd is the spool file, owned by the connection
+        PayloadPtr payload;
+        off_t offset;
+        size_t remaining;
+        Buffer trailer;
+    };
+    // outputBuffer_ goes first, then the regions in order
+    std::deque<OutputRegion> regions_;
+    size_t regionQueueBytes_;   // the regions and their trailers
+    size_t fileQueueBytes_;     // the part of them sendfile reads from files
+
+    MemoryBudget *budget_;
+    size_t accountedBytes_;     // added to the loop's bufferedBytes
+    Timestamp writeProgressTime_;
+
+    // a payload pinned until the notification of its last zero copy send
+    struct ZeroCopyPending
+    {
+        uint32_t lastSeq;
+        PayloadPtr payload;
+    };
+    bool zeroCopy_;
+    size_t zeroCopyThreshold_;
+    uint32_t zeroCopySeq_;      // the kernel numbers the MSG_ZEROCOPY sends from 0
+    std::deque<ZeroCopyPending> zeroCopyPending_;
+
+    // drain the error queue of fd, release the payloads notified done
+    static bool reapZeroCopy(int fd, std::deque<ZeroCopyPending> *pending);
+    // payloads still pinned when the connection is destroyed stay with the
+    // loop thread, together with a dup of the socket to read their
+    // notifications, until the kernel releases them
+    struct ZeroCopyOrphan
+    {
+        int fd;     // -1 when the dup failed, then kept for good
+        std::deque<ZeroCopyPending> pending;
+    };
+    // those of a loop thread, handed to the process-wide ones when it exits
+    struct ZeroCopyOrphans
+    {
+        ~ZeroCopyOrphans();
+        std::vector<ZeroCopyOrphan> orphans;
+    };
+    // outlive every thread, reaped by the loops that reap their own
+    struct SharedZeroCopyOrphans
+    {
+        std::mutex mutex;
+        std::vector<ZeroCopyOrphan> orphans;
+    };
+    static ZeroCopyOrphans& zeroCopyOrphans();
+    static SharedZeroCopyOrphans& sharedZeroCopyOrphans();
+    // reap them, close the sockets of the released ones and drop them
+    static void reapZeroCopyOrphans(std::vector<ZeroCopyOrphan> *orphans);
+    void orphanZeroCopy();
+    static void reapZeroCopyOrphansInLoop(EventLoop *loop);
+
+    bool batchedFlush_;
+    bool flushPending_;
+
+    bool spool_;
+    size_t spoolThreshold_;
+    std::string spoolDir_;
+    int spoolFd_;           // the unlinked spool file, opened on first use
+    std::deque<int> fullSpools_;    // older spool files, still being sent
+    off_t spoolEnd_;        // where the next spooled bytes are written
+    size_t spoolQueueBytes_;
+
+    bool rxTimestamps_;
+
+    bool completionIo_;
+    size_t ringQueueBytes_;     // handed to the ring, not reported sent yet
 };
\ No newline at end of file
@@ -2,8 +2,18 @@
 #include "TcpConnection.h"
 #include "Logger.h"
  
+#include <algorithm>
+#include <chrono>
+#include <errno.h>
 #include <functional>
+#include <future>
+#include <new>
+#include <stdlib.h>
 #include <strings.h>
+#include <unistd.h>
+
+const double TcpServer::kDefaultStallSeconds = 5.0;
+const double TcpServer::kBudgetCheckInterval = 0.1;
 
 static EventLoop* CheckLoopNotNull(EventLoop *loop)
 {
@@ -21,17 +31,48 @@ TcpServer::TcpServer(EventLoop* loop,
             : loop_(CheckLoopNotNull(loop)),
               ipPort_(listenAddr.toIpPort()),
               name_(nameArg),
-              acceptor_(new Acceptor(loop, listenAddr, option == kReusePort)),
+              listenAddr_(listenAddr),
+              option_(option),
+              acceptor_(),
               threadPool_(new EventLoopThreadPool(loop, nameArg)),
               connectionCallback_(),
               messageCallback_(),
-              nextConnId_(1),
-              started_(0)
+              started_(0),
+              edgeTriggered_(false),
+              ioBudget_(TcpConnection::kDefaultIoBudget),
+              zeroCopy_(false),
+              zeroCopyThreshold_(TcpConnection::kDefaultZeroCopyThreshold),
+              batchedFlush_(false),
+              spool_(false),
+              spoolThreshold_(TcpConnection::kDefaultSpoolThreshold),
+              spoolDir_(TcpConnection::kDefaultSpoolDir),
+              rxTimestamps_(false),
+              completionIo_(false),
+              inputHighWaterMark_(0),
+              inputLowWaterMark_(0),
+              incomingCpu_(false),
+              maxAccepts_(Acceptor::kDefaultMaxAccepts),
+              deferAcceptSeconds_(0),
+              budgetBytes_(0),
+              budgetPolicy_(MemoryBudget::kRejectSends),
+              stallSeconds_(kDefaultStallSeconds),
+              nextConnId_(1)
+{
+    // the per loop options bind their sockets in start(), once the loops are known
+    if(option_ == kNoReusePort || option_ == kReusePort)
+    {
+        acceptor_.reset(newMainAcceptor());
+    }
+}
+
+Acceptor* TcpServer::newMainAcceptor()
 {
+    Acceptor *acceptor = new Acceptor(loop_, listenAddr_, option_ == kReusePort
+                                                       || option_ == kReusePortPerLoop);
     // while new user connecting, do it
-    acceptor_->setNewConnectionCallback(std::bind(&TcpServer::newConnection, this,
-                                        std::placeholders::_1, std::placeholders::_2));
-    
+    acceptor->setNewConnectionCallback(std::bind(&TcpServer::newConnection, this,
+                                       std::placeholders::_1, std::placeholders::_2));
+    return acceptor;
 }
 
 void TcpServer::setThreadNum(int numThreads)
@@ -46,19 +87,214 @@ void TcpServer::start()
     {
         // 启动底层的线程池
         threadPool_->start(threadInitCallback_);
-        loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
+        for(EventLoop *ioLoop : threadPool_->getAllLoops())
+        {
+            loopContexts_.emplace_back(new LoopContext(this, ioLoop));
+            contextOfLoop_[ioLoop] = loopContexts_.back().get();
+        }
+        if(budgetBytes_ > 0)
+        {
+            memoryBudget_.reset(new MemoryBudget(budgetBytes_, budgetPolicy_, stallSeconds_));
+            for(auto& context : loopContexts_)
+            {
+                memoryBudget_->addLoop(context->loop);
+            }
+            if(budgetPolicy_ != MemoryBudget::kRejectSends)
+            {
+                for(auto& context : loopContexts_)
+                {
+                    // every loop arms its own timer, TimerId is kept in the loop
+                    LoopContext *raw = context.get();
+                    raw->loop->runInLoop([this, raw]()
+                    {
+                        raw->budgetTimer = raw->loop->runEvery(kBudgetCheckInterval,
+                                    std::bind(&TcpServer::enforceBudget, this, raw));
+                    });
+                }
+            }
+        }
+        callbacks_ = std::make_shared<ConnectionCallbacks>();
+        callbacks_->connectionCallback = connectionCallback_;
+        callbacks_->messageCallback = messageCallback_;
+        callbacks_->writeCompleteCallback = writeCompleteCallback_;
+        // 设置了如何关闭连接的回调
+        callbacks_->closeCallback = std::bind(&TcpServer::removeConnection, this,
+                                              std::placeholders::_1);
+        if((option_ == kReusePortPerLoop || option_ == kSharedListenerPerLoop)
+            && threadPool_->getAllLoops().front() != loop_)
+        {
+            startLoopAcceptors();
+        }
+        else
+        {
+            if(!acceptor_)
+            {
+                // a per loop option without sub loops
+                acceptor_.reset(newMainAcceptor());
+            }
+            configureAcceptor(acceptor_.get());
+            loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
+        }
     }
 
 }
 
+void TcpServer::configureAcceptor(Acceptor *acceptor)
+{
+    acceptor->setMaxAcceptsPerWakeup(maxAccepts_);
+    acceptor->setCompletion(completionIo_);
+    if(deferAcceptSeconds_ > 0)
+    {
+        acceptor->setDeferAccept(deferAcceptSeconds_);
+    }
+}
+
+void TcpServer::startLoopAcceptors()
+{
+    std::vector<EventLoop*> loops = threadPool_->getAllLoops();
+    for(size_t i = 0; i < loops.size(); ++i)
+    {
+        EventLoop *ioLoop = loops[i];
+        Acceptor *acceptor;
+        if(option_ == kReusePortPerLoop)
+        {
+            // the kernel hashes the connections over the sockets
+            acceptor = new Acceptor(ioLoop, listenAddr_, true);
+            if(incomingCpu_ && threadPool_->cpuOf(i) >= 0)
+            {
+                acceptor->setIncomingCpu(threadPool_->cpuOf(i));
+            }
+        }
+        else if(i == 0)
+        {
+            // the first loop binds the socket the others dup
+            acceptor = new Acceptor(ioLoop, listenAddr_, false);
+            acceptor->setExclusive();
+        }
+        else
+        {
+            int listenfd = ::dup(loopAcceptors_.front()->fd());
+            if(listenfd < 0)
+            {
+                LOG_FATAL("%s:%s:%d dup listen socket err:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
+            }
+            acceptor = new Acceptor(ioLoop, listenfd);
+            acceptor->setExclusive();
+        }
+        configureAcceptor(acceptor);
+        acceptor->setNewConnectionCallback(std::bind(&TcpServer::newConnectionIn, this, ioLoop,
+                                        std::placeholders::_1, std::placeholders::_2));
+        loopAcceptors_.emplace_back(acceptor);
+        ioLoop->runInLoop(std::bind(&Acceptor::listen, acceptor));
+    }
+}
+
 // 有一个新的客户端的连接，acceptor会执行这个回调操作
 void TcpServer::newConnection(int sockfd, const InetAddress& peerAddr)
 {
-    // 轮询算法选择subLoop接管新连接
-    EventLoop *ioLoop = threadPool_->getNextLoop();
+    // 按策略选择subLoop接管新连接, 默认轮询
+    EventLoop *ioLoop = nullptr;
+    if(incomingCpu_)
+    {
+        int cpu = -1;
+        socklen_t len = static_cast<socklen_t>(sizeof cpu);
+        if(::getsockopt(sockfd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) == 0 && cpu >= 0)
+        {
+            ioLoop = threadPool_->getLoopForCpu(cpu);
+        }
+    }
+    if(ioLoop == nullptr)
+    {
+        size_t hashCode = loopKeyCallback_ ? loopKeyCallback_(peerAddr)
+                                           : peerAddr.getSockAddr()->sin_addr.s_addr;
+        ioLoop = threadPool_->getNextLoop(hashCode);
+    }
+    newConnectionIn(ioLoop, sockfd, peerAddr);
+}
+
+void TcpServer::newConnectionIn(EventLoop *ioLoop, int sockfd, const InetAddress& peerAddr)
+{
+    if(ioLoop->isInLoopThread())
+    {
+        establishConnection(ioLoop, sockfd, *peerAddr.getSockAddr());
+        return;
+    }
+    LoopContext *context = contextOfLoop_.find(ioLoop)->second;
+    // counted until the loop establishes or closes it
+    ioLoop->addPendingConnections(1);
+    context->accepted.push(AcceptedSocket{sockfd, *peerAddr.getSockAddr()});
+    // one task takes a whole burst of accepted sockets
+    if(!context->drainScheduled.exchange(true))
+    {
+        std::weak_ptr<LoopContext> weakContext(context->shared_from_this());
+        ioLoop->queueInLoop(std::bind(&TcpServer::drainAccepted, weakContext));
+    }
+}
+
+void TcpServer::drainAccepted(const std::weak_ptr<LoopContext>& weakContext)
+{
+    std::shared_ptr<LoopContext> context(weakContext.lock());
+    if(!context)
+    {
+        return;     // its destructor closed the sockets
+    }
+    // cleared first, a push missed by consume() schedules another drain
+    context->drainScheduled = false;
+    LoopContext *raw = context.get();
+    context->accepted.consume([raw](AcceptedSocket &accepted)
+    {
+        if(raw->closed)
+        {
+            ::close(accepted.sockfd);
+        }
+        else
+        {
+            raw->server->establishConnection(raw->loop, accepted.sockfd, accepted.peerAddr);
+        }
+        // after the connection counts it, the load never dips in between
+        raw->loop->addPendingConnections(-1);
+    });
+}
+
+TcpServer::LoopContext::~LoopContext()
+{
+    accepted.consume([](AcceptedSocket &accepted) { ::close(accepted.sockfd); });
+}
+
+void* TcpServer::LoopContext::operator new(size_t size)
+{
+    void *p = nullptr;
+    if(::posix_memalign(&p, alignof(LoopContext), size) != 0)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void TcpServer::LoopContext::operator delete(void *p)
+{
+    ::free(p);
+}
+
+void TcpServer::establishConnection(EventLoop *ioLoop, int sockfd, const struct sockaddr_in& peer)
+{
+    InetAddress peerAddr(peer);
+    LoopContext *context = contextOfLoop_.find(ioLoop)->second;
+    uint32_t serial = nextConnId_++;
+    uint32_t slot;
+    if(context->freeSlots.empty())
+    {
+        slot = static_cast<uint32_t>(context->connections.size());
+        context->connections.emplace_back();
+    }
+    else
+    {
+        slot = context->freeSlots.back();
+        context->freeSlots.pop_back();
+    }
+    uint64_t id = static_cast<uint64_t>(serial) << 32 | slot;
     char buf[64];
-    snprintf(buf, sizeof(buf), "-%s#%d", ipPort_.c_str(), nextConnId_);
-    ++nextConnId_;
+    snprintf(buf, sizeof(buf), "-%s#%u", ipPort_.c_str(), serial);
     std::string connName = name_ + buf;
 
     LOG_INFO("TcpServer::newConnection [%s] - new connection [%s] from %s \n",
@@ -79,45 +315,219 @@ void TcpServer::newConnection(int sockfd, const InetAddress& peerAddr)
                                             connName,
                                             sockfd,
                                             localAddr,
-                                            peerAddr));
-    connections_[connName] = conn;
+                                            peerAddr,
+                                            id));
+    context->connections[slot] = conn;
     // 下面的回调都是用户设置给TcpServer -> TcpConnection -> channel
-    conn->setConnectionCallback(connectionCallback_);
-    conn->setMessageCallback(messageCallback_)                               ;
-    conn->setWriteCompleteCallback(writeCompleteCallback_);
+    // 所有连接共享同一份回调
+    conn->setCallbacks(callbacks_);
+    conn->setEdgeTriggered(edgeTriggered_, ioBudget_);
+    conn->setZeroCopy(zeroCopy_, zeroCopyThreshold_);
+    conn->setBatchedFlush(batchedFlush_);
+    conn->setSpooling(spool_, spoolThreshold_, spoolDir_);
+    conn->setRxTimestamps(rxTimestamps_);
+    conn->setCompletionIo(completionIo_);
+    conn->setInputWaterMarks(inputHighWaterMark_, inputLowWaterMark_);
+    conn->setMemoryBudget(memoryBudget_.get());
+    conn->connectEstablished();
+}
 
-    // 设置了如何关闭连接的回调
-    conn->setCloseCallback(std::bind(&TcpServer::removeConnection, this,
-                            std::placeholders::_1));
-    ioLoop->runInLoop(std::bind(&TcpConnection::connectEstablished, conn));
+void TcpServer::removeConnection(const TcpConnectionPtr& conn)
+{
+    // closed in its own loop, so the slot is freed right here
+    LOG_INFO("TcpServer::removeConnection [%s] - connection %s", 
+                        name_.c_str(), conn->name().c_str());
+    EventLoop *ioLoop = conn->getLoop();
+    LoopContext *context = contextOfLoop_.find(ioLoop)->second;
+    uint32_t slot = static_cast<uint32_t>(conn->id());
+    // destroyConnections may have emptied the slab already
+    if(slot < context->connections.size() && context->connections[slot] == conn)
+    {
+        context->connections[slot].reset();
+        context->freeSlots.push_back(slot);
+    }
+
+    ioLoop->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+}
 
+void TcpServer::forEachConnection(const ConnectionVisitor& visitor)
+{
+    for(auto& context : loopContexts_)
+    {
+        std::weak_ptr<LoopContext> weakContext(context);
+        context->loop->runInLoop(std::bind(&TcpServer::visitLoop, weakContext, visitor));
+    }
+}
 
+void TcpServer::visitLoop(const std::weak_ptr<LoopContext>& weakContext,
+                          const ConnectionVisitor& visitor)
+{
+    std::shared_ptr<LoopContext> context(weakContext.lock());
+    if(!context)
+    {
+        return;
+    }
+    // by index, the visitor may close connections and free their slots
+    for(size_t i = 0; i < context->connections.size(); ++i)
+    {
+        if(context->connections[i])
+        {
+            visitor(context->connections[i]);
+        }
+    }
 }
 
+void TcpServer::broadcast(const std::string& message)
+{
+    PayloadPtr payload = std::make_shared<const std::string>(message);
+    forEachConnection([payload](const TcpConnectionPtr& conn) { conn->send(payload); });
+}
 
-void TcpServer::removeConnection(const TcpConnectionPtr& conn)
+void TcpServer::shutdownAll()
 {
-    loop_->runInLoop(std::bind(&TcpServer::removeConntionInLoop, this, conn));
+    forEachConnection([](const TcpConnectionPtr& conn) { conn->shutdown(); });
 }
-void TcpServer::removeConntionInLoop(const TcpConnectionPtr& conn)
+
+size_t TcpServer::bufferedBytes() const
 {
-    LOG_INFO("TcpServer::removeConntionInLoop [%s] - connection %s", 
-                        name_.c_str(), conn->name().c_str());
-    size_t n = connections_.erase(conn->name());
+    int64_t total = 0;
+    for(auto& context : loopContexts_)
+    {
+        total += context->loop->bufferedBytes();
+    }
+    return total > 0 ? static_cast<size_t>(total) : 0;
+}
 
-    EventLoop *ioLoop = conn->getLoop();
-    ioLoop->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+void TcpServer::rxLatency(LatencyHistogram *out) const
+{
+    for(auto& context : loopContexts_)
+    {
+        out->merge(context->loop->rxLatency());
+    }
+}
+
+void TcpServer::enforceBudget(LoopContext *context)
+{
+    if(!memoryBudget_->exceeded())
+    {
+        return;
+    }
+    std::vector<TcpConnectionPtr> victims;
+    if(memoryBudget_->policy() == MemoryBudget::kShedLargest)
+    {
+        // every loop sheds down to its share, no loop looks at another's
+        int64_t share = static_cast<int64_t>(memoryBudget_->limit() / memoryBudget_->numLoops());
+        int64_t excess = context->loop->bufferedBytes() - share;
+        std::vector<TcpConnectionPtr> candidates;
+        for(auto& conn : context->connections)
+        {
+            if(conn && !conn->disconnected() && conn->bufferedBytes() > 0)
+            {
+                candidates.push_back(conn);
+            }
+        }
+        std::sort(candidates.begin(), candidates.end(),
+                  [](const TcpConnectionPtr& lhs, const TcpConnectionPtr& rhs)
+                  { return lhs->bufferedBytes() > rhs->bufferedBytes(); });
+        for(size_t i = 0; i < candidates.size() && excess > 0; ++i)
+        {
+            excess -= static_cast<int64_t>(candidates[i]->bufferedBytes());
+            victims.push_back(candidates[i]);
+        }
+    }
+    else
+    {
+        Timestamp deadline = addTime(Timestamp::now(), -memoryBudget_->stallSeconds());
+        for(auto& conn : context->connections)
+        {
+            if(conn && !conn->disconnected() && conn->outputBytes() > 0
+                && conn->lastWriteProgress() < deadline)
+            {
+                victims.push_back(conn);
+            }
+        }
+    }
+    for(auto& conn : victims)
+    {
+        LOG_ERROR("TcpServer::enforceBudget [%s] - close %s, %lu bytes buffered \n",
+                  name_.c_str(), conn->name().c_str(),
+                  static_cast<unsigned long>(conn->bufferedBytes()));
+        memoryBudget_->addEvictedConnection();
+        conn->forceClose();
+    }
+}
+
+void TcpServer::destroyConnections(LoopContext *context)
+{
+    // the drains queued after this close what they find
+    context->closed = true;
+    EventLoop *loop = context->loop;
+    context->accepted.consume([loop](AcceptedSocket &accepted)
+    {
+        loop->addPendingConnections(-1);
+        ::close(accepted.sockfd);
+    });
+    std::vector<TcpConnectionPtr> connections;
+    connections.swap(context->connections);
+    context->freeSlots.clear();
+    for(auto& conn : connections)
+    {
+        if(conn)
+        {
+            conn->connectDestroyed();
+        }
+    }
 }
 
 TcpServer::~TcpServer()
 {
     LOG_INFO("TcpServer::~TcpServer [%s] destructing", name_.c_str());
-    for(auto& item : connections_)
+    for(auto& acceptor : loopAcceptors_)
+    {
+        // its Channel is only touched in its loop
+        Acceptor *raw = acceptor.release();
+        runInLoopAndWait(raw->getLoop(), [raw]() { delete raw; });
+    }
+    // every loop destroys its own connections, wait for them since the
+    // contexts go away with the server; a loop that has quit is done here
+    for(auto& context : loopContexts_)
+    {
+        LoopContext *raw = context.get();
+        runInLoopAndWait(raw->loop, [raw]()
+        {
+            raw->loop->cancel(raw->budgetTimer);
+            destroyConnections(raw);
+        });
+    }
+}
+
+void TcpServer::runInLoopAndWait(EventLoop *loop, const std::function<void()>& f)
+{
+    // not !looping(): the loop may not have entered loop() yet, it runs f then
+    if(loop->isInLoopThread() || loop->exited())
+    {
+        f();
+        return;
+    }
+    // whoever claims it runs f: the loop, or this thread if the loop
+    // stops before it gets there
+    std::shared_ptr<std::atomic_bool> claimed = std::make_shared<std::atomic_bool>(false);
+    std::shared_ptr<std::promise<void>> done = std::make_shared<std::promise<void>>();
+    std::future<void> finished = done->get_future();
+    loop->runInLoop([f, claimed, done]()
+    {
+        if(!claimed->exchange(true))
+        {
+            f();
+            done->set_value();
+        }
+    });
+    while(finished.wait_for(std::chrono::milliseconds(10)) != std::future_status::ready)
     {
-        // 栈上对象可自动释放
-        TcpConnectionPtr conn(item.second);
-        item.second.reset();
-        conn->getLoop()->runInLoop(
-            std::bind(&TcpConnection::connectDestroyed, conn));
+        if(loop->exited() && !claimed->exchange(true))
+        {
+            f();
+            return;
+        }
     }
 }
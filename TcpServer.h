@@ -11,22 +11,36 @@
 #include "EventLoopThreadPool.h"
 #include "Callbacks.h"
 #include "TcpConnection.h"
+#include "MpscQueue.h"
+#include "MemoryBudget.h"
+#include "TimerId.h"
 
 #include <functional>
 #include <string>
 #include <memory>
 #include <atomic>
 #include <unordered_map>
+#include <vector>
 
 class TcpServer : noncopyable
 {
 public:
     using ThreadInitCallback = std::function<void(EventLoop*)>;
-
+    using ConnectionVisitor = std::function<void(const TcpConnectionPtr&)>;
+    // the key of kConsistentHash, connections with the same key share a loop
+    using LoopKeyCallback = std::function<size_t(const InetAddress& peerAddr)>;
+
+    // kReusePortPerLoop and kSharedListenerPerLoop accept on every sub loop
+    // and keep the connection there, no handoff from the main loop:
+    // one SO_REUSEPORT socket per loop, the kernel picks the loop, or
+    // one socket every loop waits on with EPOLLEXCLUSIVE
+    // without sub loops they accept on the main loop like kReusePort
     enum Option
     {
         kNoReusePort,
-        kReusePort
+        kReusePort,
+        kReusePortPerLoop,
+        kSharedListenerPerLoop
     };
 
     TcpServer(EventLoop* loop,
@@ -37,6 +51,8 @@ public:
 
     void setThreadInitCallback(const ThreadInitCallback& cb)
     { threadInitCallback_ = cb; }
+    // call before start(): start() copies the three callbacks into the
+    // set every connection shares, later calls don't reach it
     void setConnectionCallback(const ConnectionCallback& cb)
     { connectionCallback_ = cb; }
     void setMessageCallback(const MessageCallback& cb)
@@ -45,33 +61,180 @@ public:
     { writeCompleteCallback_ = cb; }
 
     void setThreadNum(int numThreads);
+    // how a sub loop is picked for a new connection, round-robin by default
+    // kConsistentHash hashes the peer ip, or the key of the callback
+    void setLoopStrategy(EventLoopThreadPool::Strategy strategy)
+    { threadPool_->setStrategy(strategy); }
+    void setLoopKeyCallback(const LoopKeyCallback& cb)
+    { loopKeyCallback_ = cb; }
+
+    // pin the sub loops, see EventLoopThreadPool::setCpuList
+    void setCpuList(const std::vector<int>& cpus)
+    { threadPool_->setCpuList(cpus); }
+    // serve a connection on the loop pinned to the cpu its packets arrive
+    // on: SO_INCOMING_CPU of the per loop SO_REUSEPORT sockets, otherwise
+    // the accepted socket's SO_INCOMING_CPU picks the loop
+    void setIncomingCpu(bool on) { incomingCpu_ = on; }
+
+    // call before start(), see Acceptor
+    void setMaxAcceptsPerWakeup(int maxAccepts) { maxAccepts_ = maxAccepts; }
+    // TCP_DEFER_ACCEPT, 0 turns it off
+    void setDeferAccept(int seconds) { deferAcceptSeconds_ = seconds; }
+
+    // the connections use edge-triggered epoll, see TcpConnection::setEdgeTriggered
+    void setEdgeTriggered(bool on, size_t ioBudget = TcpConnection::kDefaultIoBudget)
+    { edgeTriggered_ = on; ioBudget_ = ioBudget; }
+    // large payloads go by MSG_ZEROCOPY, see TcpConnection::setZeroCopy;
+    // only send(PayloadPtr) and broadcast are covered, the other sends copy
+    void setZeroCopy(bool on, size_t threshold = TcpConnection::kDefaultZeroCopyThreshold)
+    { zeroCopy_ = on; zeroCopyThreshold_ = threshold; }
+    // flush at the end of the loop iteration, see TcpConnection::setBatchedFlush
+    void setBatchedFlush(bool on) { batchedFlush_ = on; }
+    // large queued output goes to a temp file, see TcpConnection::setSpooling
+    void setSpooling(bool on, size_t threshold = TcpConnection::kDefaultSpoolThreshold,
+                     const std::string& dir = TcpConnection::kDefaultSpoolDir)
+    { spool_ = on; spoolThreshold_ = threshold; spoolDir_ = dir; }
+    // kernel receive timestamps, see TcpConnection::setRxTimestamps
+    void setRxTimestamps(bool on) { rxTimestamps_ = on; }
+    // the poller does the socket I/O where it can, see
+    // TcpConnection::setCompletionIo, the acceptors accept with it too
+    void setCompletionIo(bool on) { completionIo_ = on; }
+    // stop reading a connection whose input piles up, see
+    // TcpConnection::setInputWaterMarks
+    void setInputWaterMarks(size_t highWaterMark, size_t lowWaterMark)
+    { inputHighWaterMark_ = highWaterMark; inputLowWaterMark_ = lowWaterMark; }
+
+    // cap the bytes all connections keep in memory, see MemoryBudget,
+    // kShedLargest and kCloseStalled are checked by every loop each
+    // kBudgetCheckInterval seconds; call before start()
+    void setMemoryBudget(size_t bytes, MemoryBudget::Policy policy,
+                         double stallSeconds = kDefaultStallSeconds)
+    { budgetBytes_ = bytes; budgetPolicy_ = policy; stallSeconds_ = stallSeconds; }
+    // nullptr without a budget
+    const MemoryBudget* memoryBudget() const { return memoryBudget_.get(); }
+    // what the loops of the server hold in connection buffers, a metric
+    size_t bufferedBytes() const;
+    // the rxLatency() of the loops of the server added into out
+    void rxLatency(LatencyHistogram *out) const;
+
+    static const double kDefaultStallSeconds;
+    static const double kBudgetCheckInterval;
 
     // 开启服务器监听
     void start();
 
+    // fan out to the loops, each visits its own connections in its thread,
+    // so the visitor runs concurrently in the sub loops; call after start()
+    void forEachConnection(const ConnectionVisitor& visitor);
+    // every connection sends message, one copy shared by all of them
+    void broadcast(const std::string& message);
+    // half-close every connection
+    void shutdownAll();
 
 private:
+    // an accepted socket on its way to the loop that takes it
+    struct AcceptedSocket
+    {
+        int sockfd;
+        struct sockaddr_in peerAddr;
+    };
+    // what a loop owns: the accepted sockets queued for it, drained by one
+    // task per batch, and its connections, only touched in the loop
+    //
+    // the tasks queued on the loop hold it by weak_ptr, the server may
+    // be gone when they run
+    struct LoopContext : noncopyable, std::enable_shared_from_this<LoopContext>
+    {
+        LoopContext(TcpServer *serverArg, EventLoop *loopArg)
+            : server(serverArg), loop(loopArg), drainScheduled(false), closed(false)
+        {}
+        ~LoopContext();
+
+        // MpscQueue is over-aligned, C++11 operator new ignores that
+        static void* operator new(size_t size);
+        static void operator delete(void *p);
+
+        TcpServer *server;
+        EventLoop *loop;
+        MpscQueue<AcceptedSocket> accepted;
+        std::atomic_bool drainScheduled;
+        // set in the loop by ~TcpServer, then the server is not touched
+        bool closed;
+        // slab indexed by the low 32 bits of the connection id,
+        // freed slots are reused first
+        std::vector<TcpConnectionPtr> connections;
+        std::vector<uint32_t> freeSlots;
+        TimerId budgetTimer;
+    };
+
     void newConnection(int sockfd, const InetAddress& peerAddr);
+    // ioLoop takes the connection, called in the accepting loop, only the
+    // fd and the address cross threads, the rest is done in ioLoop
+    void newConnectionIn(EventLoop *ioLoop, int sockfd, const InetAddress& peerAddr);
+    static void drainAccepted(const std::weak_ptr<LoopContext>& weakContext);
+    // in ioLoop: name, allocate, register and establish the connection
+    void establishConnection(EventLoop *ioLoop, int sockfd, const struct sockaddr_in& peerAddr);
+    void startLoopAcceptors();
+    Acceptor* newMainAcceptor();
+    void configureAcceptor(Acceptor *acceptor);
+    // in the connection's loop, which is where it is registered
     void removeConnection(const TcpConnectionPtr& conn);
-    void removeConntionInLoop(const TcpConnectionPtr& conn);
-
-    using ConnectionMap = std::unordered_map<std::string, TcpConnectionPtr>;
+    static void visitLoop(const std::weak_ptr<LoopContext>& weakContext,
+                          const ConnectionVisitor& visitor);
+    static void destroyConnections(LoopContext *context);
+    // run f in loop and wait for it, inline once the loop has exited,
+    // so the destructor can't hang on a loop that has quit
+    static void runInLoopAndWait(EventLoop *loop, const std::function<void()>& f);
+    // in the loop of context, applies the policy of memoryBudget_
+    void enforceBudget(LoopContext *context);
 
     EventLoop *loop_;
     const std::string ipPort_;
     const std::string name_;
+    const InetAddress listenAddr_;
+    const Option option_;
     // 运行在 maninLoop,用于监听新连接
+    // null with the per loop options once sub loops accept
     std::unique_ptr<Acceptor> acceptor_;
+    // the Acceptors of the sub loops, destroyed in their loops
+    std::vector<std::unique_ptr<Acceptor>> loopAcceptors_;
+    // one per loop of the pool, built by start()
+    std::vector<std::shared_ptr<LoopContext>> loopContexts_;
+    std::unordered_map<EventLoop*, LoopContext*> contextOfLoop_;
 
     std::shared_ptr<EventLoopThreadPool> threadPool_;
 
     ConnectionCallback connectionCallback_;
     MessageCallback messageCallback_;
     WriteCompleteCallback writeCompleteCallback_;
+    // the callbacks above shared by every new connection,
+    // built by start(), set them before
+    ConnectionCallbacksPtr callbacks_;
 
     ThreadInitCallback threadInitCallback_;
+    LoopKeyCallback loopKeyCallback_;
     std::atomic_int started_;
 
-    int nextConnId_;
-    ConnectionMap connections_; // save  all connections
+    bool edgeTriggered_;
+    size_t ioBudget_;
+    bool zeroCopy_;
+    size_t zeroCopyThreshold_;
+    bool batchedFlush_;
+    bool spool_;
+    size_t spoolThreshold_;
+    std::string spoolDir_;
+    bool rxTimestamps_;
+    bool completionIo_;
+    size_t inputHighWaterMark_;
+    size_t inputLowWaterMark_;
+    bool incomingCpu_;
+    int maxAccepts_;
+    int deferAcceptSeconds_;
+    size_t budgetBytes_;
+    MemoryBudget::Policy budgetPolicy_;
+    double stallSeconds_;
+    std::unique_ptr<MemoryBudget> memoryBudget_;
+
+    // the high 32 bits of the connection ids, the slot is the low ones
+    std::atomic<uint32_t> nextConnId_;
 };
\ No newline at end of file
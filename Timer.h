@@ -0,0 +1,38 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+
+#include <atomic>
+#include <stdint.h>
+
+// Timer is a node of the TimerQueue slab, the expiration time is
+// kept in the heap entry, so a node only keeps what the heap don't need
+class Timer : noncopyable
+{
+public:
+    Timer()
+        : interval_(0),
+          sequence_(0),
+          state_(kFree),
+          nextFree_(nullptr)
+    {}
+
+    bool repeat() const { return interval_ > 0; }
+    int64_t sequence() const { return sequence_; }
+
+    static int64_t numCreated() { return s_numCreated_; }
+
+private:
+    friend class TimerQueue;
+
+    enum State {kFree, kPending, kQueued, kRunning, kCanceled};
+
+    TimerCallback callback_;
+    int64_t interval_;  // microseconds, 0 means run once
+    std::atomic<int64_t> sequence_;
+    State state_;
+    Timer *nextFree_;   // link of the free list
+
+    static std::atomic<int64_t> s_numCreated_;
+};
@@ -0,0 +1,249 @@
+#include "TimerQueue.h"
+#include "Timer.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <string.h>
+
+std::atomic<int64_t> Timer::s_numCreated_(0);
+
+// the nodes of Timer slab growed every time
+constexpr size_t kTimerChunkSize = 4096;
+// don't bother to compact a small heap
+constexpr size_t kCompactThreshold = 1024;
+
+static int createTimerfd()
+{
+    int timerfd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if(timerfd < 0)
+    {
+        LOG_FATAL("timerfd_create error:%d\n", errno);
+    }
+    return timerfd;
+}
+
+TimerQueue::TimerQueue(EventLoop *loop)
+    : loop_(loop),
+      timerfd_(createTimerfd()),
+      timerfdChannel_(loop, timerfd_),
+      canceledInHeap_(0),
+      freeList_(nullptr)
+{
+    timerfdChannel_.setReadCallback(std::bind(&TimerQueue::handleRead, this));
+    timerfdChannel_.enableReading();
+}
+
+TimerQueue::~TimerQueue()
+{
+    timerfdChannel_.disableAll();
+    timerfdChannel_.remove();
+    ::close(timerfd_);
+}
+
+TimerId TimerQueue::addTimer(TimerCallback cb, Timestamp when, double interval)
+{
+    Timer *timer = allocTimer();
+    timer->callback_ = std::move(cb);
+    timer->interval_ = static_cast<int64_t>(interval * Timestamp::kMicroSecondsPerSecond);
+    TimerId timerId(timer, timer->sequence_);
+
+    if(loop_->isInLoopThread())
+    {
+        addTimerInLoop(timer, when.microSecondsSinceEpoch());
+    }
+    else
+    {
+        loop_->queueInLoop(std::bind(&TimerQueue::addTimerInLoop, this,
+                                     timer, when.microSecondsSinceEpoch()));
+    }
+    return timerId;
+}
+
+void TimerQueue::cancel(TimerId timerId)
+{
+    loop_->runInLoop(std::bind(&TimerQueue::cancelInLoop, this, timerId));
+}
+
+void TimerQueue::addTimerInLoop(Timer *timer, int64_t expiration)
+{
+    // canceled before it reached the loop
+    if(timer->state_ == Timer::kCanceled)
+    {
+        freeTimer(timer);
+        return;
+    }
+    timer->state_ = Timer::kQueued;
+    if(insert(timer, expiration))
+    {
+        resetTimerfd(expiration);
+    }
+}
+
+// O(1), the heap entry is dropped when it comes to the top or on compaction
+void TimerQueue::cancelInLoop(TimerId timerId)
+{
+    Timer *timer = timerId.timer_;
+    if(timer == nullptr || timer->sequence_ != timerId.sequence_)
+    {
+        return; // had expired or been canceled, the node may be reused
+    }
+
+    switch(timer->state_)
+    {
+    case Timer::kPending:
+        timer->state_ = Timer::kCanceled;
+        timer->callback_ = TimerCallback();
+        break;
+    case Timer::kQueued:
+        timer->state_ = Timer::kCanceled;
+        timer->callback_ = TimerCallback();
+        ++canceledInHeap_;
+        compact();
+        break;
+    case Timer::kRunning:
+        // cancel itself in the callback, handleRead frees it after running
+        timer->state_ = Timer::kCanceled;
+        break;
+    default:
+        break;
+    }
+}
+
+void TimerQueue::handleRead()
+{
+    uint64_t howmany = 0;
+    ssize_t n = ::read(timerfd_, &howmany, sizeof(howmany));
+    if(n != sizeof(howmany))
+    {
+        LOG_ERROR("TimerQueue::handleRead() reads %ld bytes instead of 8\n", n);
+    }
+
+    const int64_t now = Timestamp::monotonic().microSecondsSinceEpoch();
+    while(!heap_.empty() && heap_.front().expiration <= now)
+    {
+        std::pop_heap(heap_.begin(), heap_.end(), EntryLater());
+        Timer *timer = heap_.back().timer;
+        heap_.pop_back();
+        if(timer->state_ == Timer::kCanceled)
+        {
+            --canceledInHeap_;
+            freeTimer(timer);
+        }
+        else
+        {
+            timer->state_ = Timer::kRunning;
+            expired_.push_back(timer);
+        }
+    }
+
+    // a callback may cancel the timers behind it in expired_
+    for(Timer *timer : expired_)
+    {
+        if(timer->state_ == Timer::kRunning)
+        {
+            timer->callback_();
+        }
+    }
+
+    for(Timer *timer : expired_)
+    {
+        if(timer->state_ == Timer::kRunning && timer->repeat())
+        {
+            timer->state_ = Timer::kQueued;
+            insert(timer, now + timer->interval_);
+        }
+        else
+        {
+            freeTimer(timer);
+        }
+    }
+    expired_.clear();
+
+    if(!heap_.empty())
+    {
+        resetTimerfd(heap_.front().expiration);
+    }
+}
+
+bool TimerQueue::insert(Timer *timer, int64_t expiration)
+{
+    heap_.push_back(Entry{expiration, timer});
+    std::push_heap(heap_.begin(), heap_.end(), EntryLater());
+    return heap_.front().timer == timer;
+}
+
+void TimerQueue::compact()
+{
+    if(canceledInHeap_ < kCompactThreshold || canceledInHeap_ * 2 < heap_.size())
+    {
+        return;
+    }
+
+    auto last = std::remove_if(heap_.begin(), heap_.end(),
+        [this](const Entry &entry)
+        {
+            if(entry.timer->state_ == Timer::kCanceled)
+            {
+                freeTimer(entry.timer);
+                return true;
+            }
+            return false;
+        });
+    heap_.erase(last, heap_.end());
+    std::make_heap(heap_.begin(), heap_.end(), EntryLater());
+    canceledInHeap_ = 0;
+}
+
+void TimerQueue::resetTimerfd(int64_t expiration)
+{
+    int64_t microseconds = expiration - Timestamp::monotonic().microSecondsSinceEpoch();
+    if(microseconds < 100)
+    {
+        microseconds = 100;
+    }
+
+    struct itimerspec newValue;
+    memset(&newValue, 0, sizeof(newValue));
+    newValue.it_value.tv_sec = static_cast<time_t>(microseconds / Timestamp::kMicroSecondsPerSecond);
+    newValue.it_value.tv_nsec = static_cast<long>((microseconds % Timestamp::kMicroSecondsPerSecond) * 1000);
+    if(::timerfd_settime(timerfd_, 0, &newValue, NULL) < 0)
+    {
+        LOG_ERROR("timerfd_settime error:%d\n", errno);
+    }
+}
+
+// may be called in any thread by addTimer
+Timer* TimerQueue::allocTimer()
+{
+    std::unique_lock<std::mutex> lock(poolMutex_);
+    if(freeList_ == nullptr)
+    {
+        Timer *chunk = new Timer[kTimerChunkSize];
+        chunks_.push_back(std::unique_ptr<Timer[]>(chunk));
+        for(size_t i = 0; i < kTimerChunkSize; ++i)
+        {
+            chunk[i].nextFree_ = freeList_;
+            freeList_ = &chunk[i];
+        }
+    }
+    Timer *timer = freeList_;
+    freeList_ = timer->nextFree_;
+    timer->nextFree_ = nullptr;
+    timer->state_ = Timer::kPending;
+    timer->sequence_ = ++Timer::s_numCreated_;
+    return timer;
+}
+
+void TimerQueue::freeTimer(Timer *timer)
+{
+    // release what the callback holds out of the lock
+    timer->callback_ = TimerCallback();
+    std::unique_lock<std::mutex> lock(poolMutex_);
+    timer->sequence_ = 0;
+    timer->state_ = Timer::kFree;
+    timer->nextFree_ = freeList_;
+    freeList_ = timer;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "Channel.h"
+#include "Timestamp.h"
+#include "TimerId.h"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class EventLoop;
+class Timer;
+
+// the timers of one loop, driven by a timerfd registered in the Poller
+// the timers are ordered in a binary min-heap of (expiration, Timer*),
+// cancel only marks the Timer, the heap drops it when it is popped
+// the expirations are on Timestamp::monotonic(), like the timerfd, so
+// setting the wall clock doesn't fire or hold back the timers
+class TimerQueue : noncopyable
+{
+public:
+    explicit TimerQueue(EventLoop *loop);
+    ~TimerQueue();
+
+    // thread safe, when is on Timestamp::monotonic(), interval > 0 means repeat
+    TimerId addTimer(TimerCallback cb, Timestamp when, double interval);
+    // thread safe
+    void cancel(TimerId timerId);
+
+    // the timers still waiting to expire, must be called in the loop thread
+    size_t size() const { return heap_.size() - canceledInHeap_; }
+
+private:
+    struct Entry
+    {
+        int64_t expiration;
+        Timer *timer;
+    };
+    // std::*_heap is a max-heap, so the later one is the "less" one
+    struct EntryLater
+    {
+        bool operator()(const Entry &lhs, const Entry &rhs) const
+        { return lhs.expiration > rhs.expiration; }
+    };
+
+    void addTimerInLoop(Timer *timer, int64_t expiration);
+    void cancelInLoop(TimerId timerId);
+    // timerfd readable, run the expired timers
+    void handleRead();
+
+    // return true when the timer become the earliest one
+    bool insert(Timer *timer, int64_t expiration);
+    // drop the canceled timers when they take up half of the heap
+    void compact();
+    void resetTimerfd(int64_t expiration);
+
+    Timer* allocTimer();
+    void freeTimer(Timer *timer);
+
+    EventLoop *loop_;
+    const int timerfd_;
+    Channel timerfdChannel_;
+
+    std::vector<Entry> heap_;
+    size_t canceledInHeap_;
+    std::vector<Timer*> expired_;
+
+    // Timer slab, the nodes never move, so TimerId can keep the address
+    std::mutex poolMutex_;
+    Timer *freeList_;
+    std::vector<std::unique_ptr<Timer[]>> chunks_;
+};
@@ -1,6 +1,8 @@
 #include "Timestamp.h"
 
-#include <sys/time.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
 
 Timestamp::Timestamp() : microSecondsSinceEpoch_(0){
 
@@ -10,20 +12,56 @@ Timestamp::Timestamp(int64_t microSecondsSinceEpochArg)
 
 }
 
+// both clocks are read through the vDSO, no system call
+static int64_t microsecondsOf(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * Timestamp::kMicroSecondsPerSecond + ts.tv_nsec / 1000;
+}
+
 Timestamp Timestamp::now(){
-    return Timestamp(time(NULL));
+    return Timestamp(microsecondsOf(CLOCK_REALTIME));
+}
+
+Timestamp Timestamp::monotonic(){
+    return Timestamp(microsecondsOf(CLOCK_MONOTONIC));
 }
 
 std::string Timestamp::toString() const{
-    char buf[128] = {0,};
-    tm *tm_time = localtime(&microSecondsSinceEpoch_);
-    snprintf(buf, 128, "%4d/%02d/%02d %02d:%02d:%02d", 
-        tm_time->tm_year + 1900, 
-        tm_time->tm_mon + 1,
-        tm_time->tm_mday,
-        tm_time->tm_hour,
-        tm_time->tm_min,
-        tm_time->tm_sec);
-    
-    return buf;
+    char buf[32];
+    size_t len = format(buf, sizeof buf);
+    return std::string(buf, len);
+}
+
+size_t Timestamp::format(char *buf, size_t size) const{
+    // every log line formats the time, localtime_r takes a lock and
+    // reads the zone, do it once a second per thread
+    static thread_local time_t t_cachedSeconds = -1;
+    static thread_local char t_cached[32];
+    static thread_local size_t t_cachedLen = 0;
+
+    time_t seconds = secondsSinceEpoch();
+    if(seconds != t_cachedSeconds)
+    {
+        struct tm tm_time;
+        localtime_r(&seconds, &tm_time);
+        int len = snprintf(t_cached, sizeof t_cached, "%4d/%02d/%02d %02d:%02d:%02d", 
+            tm_time.tm_year + 1900, 
+            tm_time.tm_mon + 1,
+            tm_time.tm_mday,
+            tm_time.tm_hour,
+            tm_time.tm_min,
+            tm_time.tm_sec);
+        t_cachedLen = static_cast<size_t>(len);
+        t_cachedSeconds = seconds;
+    }
+    if(size == 0)
+    {
+        return 0;
+    }
+    size_t len = t_cachedLen < size ? t_cachedLen : size - 1;
+    memcpy(buf, t_cached, len);
+    buf[len] = '\0';
+    return len;
 }
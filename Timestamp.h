@@ -8,9 +8,49 @@ class Timestamp{
 public:
     Timestamp();
     explicit Timestamp(int64_t microSecondsSinceEpochArg);
+    // CLOCK_REALTIME, microseconds since the epoch
     static Timestamp now();
+    // CLOCK_MONOTONIC, for intervals only: never steps back, but counts
+    // from an unspecified start, so toString() means nothing on it
+    static Timestamp monotonic();
+    static Timestamp invalid() { return Timestamp(); }
 
+    // "2026/10/18 06:55:41", local time
     std::string toString() const;
+    // the same into buf without allocating, returns its length; the date
+    // part is cached per thread and only made again when the second changes
+    size_t format(char *buf, size_t size) const;
+
+    bool valid() const { return microSecondsSinceEpoch_ > 0; }
+    int64_t microSecondsSinceEpoch() const { return microSecondsSinceEpoch_; }
+    time_t secondsSinceEpoch() const
+    { return static_cast<time_t>(microSecondsSinceEpoch_ / kMicroSecondsPerSecond); }
+
+    static const int kMicroSecondsPerSecond = 1000 * 1000;
 private:
     int64_t microSecondsSinceEpoch_;
-};
\ No newline at end of file
+};
+
+inline bool operator<(Timestamp lhs, Timestamp rhs)
+{
+    return lhs.microSecondsSinceEpoch() < rhs.microSecondsSinceEpoch();
+}
+
+inline bool operator==(Timestamp lhs, Timestamp rhs)
+{
+    return lhs.microSecondsSinceEpoch() == rhs.microSecondsSinceEpoch();
+}
+
+// high - low in seconds
+inline double timeDifference(Timestamp high, Timestamp low)
+{
+    int64_t diff = high.microSecondsSinceEpoch() - low.microSecondsSinceEpoch();
+    return static_cast<double>(diff) / Timestamp::kMicroSecondsPerSecond;
+}
+
+// the time after adding seconds
+inline Timestamp addTime(Timestamp timestamp, double seconds)
+{
+    int64_t delta = static_cast<int64_t>(seconds * Timestamp::kMicroSecondsPerSecond);
+    return Timestamp(timestamp.microSecondsSinceEpoch() + delta);
+}
@@ -0,0 +1,141 @@
+#include <mymuduo/TcpServer.h>
+#include <mymuduo/Timestamp.h>
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// new connections per second: accept on the main loop and hand off,
+// SO_REUSEPORT socket per sub loop, shared socket with EPOLLEXCLUSIVE
+// usage: accept_bench base|reuseport|shared [threads] [clients] [seconds] [pin]
+//   every client connects and resets the connection, repeatedly
+//   pin: main loop on cpu 0, sub loops on the next cpus; also reports the
+//   cpu time the main loop thread spends per accepted connection
+
+static std::atomic<bool> g_stop(false);
+static std::atomic<int64_t> g_accepted(0);
+static const uint16_t kPort = 9988;
+
+static void client()
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    struct linger reset = { 1, 0 };   // RST on close, no TIME_WAIT piling up
+    while(!g_stop)
+    {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        ::setsockopt(fd, SOL_SOCKET, SO_LINGER, &reset, sizeof reset);
+        ::connect(fd, (struct sockaddr*)&addr, sizeof(addr));
+        ::close(fd);
+    }
+}
+
+static double threadCpuSeconds()
+{
+    struct rusage usage;
+    ::getrusage(RUSAGE_THREAD, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+         + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc < 2)
+    {
+        printf("usage: %s base|reuseport|shared [threads] [clients] [seconds] [pin]\n", argv[0]);
+        return 1;
+    }
+    TcpServer::Option option = TcpServer::kNoReusePort;
+    if(strcmp(argv[1], "reuseport") == 0)
+    {
+        option = TcpServer::kReusePortPerLoop;
+    }
+    else if(strcmp(argv[1], "shared") == 0)
+    {
+        option = TcpServer::kSharedListenerPerLoop;
+    }
+    int threads = argc > 2 ? atoi(argv[2]) : 4;
+    int clients = argc > 3 ? atoi(argv[3]) : 8;
+    double seconds = argc > 4 ? atof(argv[4]) : 5.0;
+    bool pin = argc > 5 && strcmp(argv[5], "pin") == 0;
+    int ncpu = static_cast<int>(::sysconf(_SC_NPROCESSORS_ONLN));
+    if(pin)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(0, &set);
+        ::pthread_setaffinity_np(::pthread_self(), sizeof set, &set);
+    }
+
+    EventLoop loop;
+    InetAddress addr(kPort, "127.0.0.1");
+    TcpServer server(&loop, addr, "AcceptBench", option);
+    server.setConnectionCallback([](const TcpConnectionPtr &conn)
+    {
+        if(conn->connected())
+        {
+            ++g_accepted;
+        }
+    });
+    server.setMessageCallback([](const TcpConnectionPtr&, Buffer *buf, Timestamp)
+    {
+        buf->retrieveAll();
+    });
+    server.setThreadNum(threads);
+    if(pin)
+    {
+        std::vector<int> cpus;
+        for(int i = 0; i < threads; ++i)
+        {
+            cpus.push_back(ncpu > 1 ? 1 + i % (ncpu - 1) : 0);
+        }
+        server.setCpuList(cpus);
+    }
+    server.start();
+
+    std::vector<std::thread> clientThreads;
+    int64_t start = 0;
+    double startCpu = 0;
+    loop.runAfter(0.1, [&]()
+    {
+        start = g_accepted;
+        startCpu = threadCpuSeconds();
+        for(int i = 0; i < clients; ++i)
+        {
+            clientThreads.emplace_back(client);
+        }
+    });
+    int64_t accepted = 0;
+    double mainCpu = 0;
+    loop.runAfter(0.1 + seconds, [&]()
+    {
+        accepted = g_accepted - start;
+        mainCpu = threadCpuSeconds() - startCpu;
+        g_stop = true;
+        loop.quit();
+    });
+    loop.loop();
+    for(auto &t : clientThreads)
+    {
+        t.join();
+    }
+
+    printf("%s threads=%d clients=%d%s: %.0f connections/s, main loop %.2f us/conn\n",
+            argv[1], threads, clients, pin ? " pinned" : "", accepted / seconds,
+            accepted > 0 ? mainCpu * 1e6 / accepted : 0.0);
+    return 0;
+}
@@ -0,0 +1,163 @@
+#include <mymuduo/TcpServer.h>
+#include <mymuduo/Timestamp.h>
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <future>
+#include <netinet/in.h>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// heap allocations per message of every send() overload
+// usage: alloc_bench [messages] [bytes]
+//   inloop: send from the loop thread of the connection
+//   cross:  send from another thread, the loop runs the queued tasks
+// what the caller needs to build the message counts too: the string&&
+// case makes a new string each time, the payload is built once and shared
+
+static std::atomic<int64_t> g_allocs(0);
+
+void* operator new(size_t size)
+{
+    ++g_allocs;
+    void *p = malloc(size);
+    if(p == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+static std::atomic<bool> g_stop(false);
+static const uint16_t kPort = 9986;
+
+static void client()
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    if(::connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+    {
+        ::close(fd);
+        return;
+    }
+    char buf[65536];
+    while(!g_stop && ::read(fd, buf, sizeof buf) > 0)
+    {
+    }
+    ::close(fd);
+}
+
+enum Mode { kCstr, kString, kRvalue, kBuffer, kPayload };
+static const char *kModeNames[] = { "const void*", "const string&", "string&&", "Buffer*", "PayloadPtr" };
+
+static void sendMessages(const TcpConnectionPtr &conn, Mode mode, int messages,
+                         const std::string &message, const PayloadPtr &payload)
+{
+    for(int i = 0; i < messages; ++i)
+    {
+        switch(mode)
+        {
+        case kCstr:
+            conn->send(message.data(), message.size());
+            break;
+        case kString:
+            conn->send(message);
+            break;
+        case kRvalue:
+            conn->send(std::string(message));
+            break;
+        case kBuffer:
+        {
+            Buffer buf;
+            buf.append(message.data(), message.size());
+            conn->send(&buf);
+            break;
+        }
+        case kPayload:
+            conn->send(payload);
+            break;
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int messages = argc > 1 ? atoi(argv[1]) : 20000;
+    size_t bytes = argc > 2 ? atoi(argv[2]) : 1024;
+    std::string message(bytes, 'm');
+    PayloadPtr payload = std::make_shared<const std::string>(message);
+
+    EventLoop loop;
+    InetAddress addr(kPort, "127.0.0.1");
+    TcpServer server(&loop, addr, "AllocBench");
+    std::promise<TcpConnectionPtr> connected;
+    server.setConnectionCallback([&](const TcpConnectionPtr &conn)
+    {
+        if(conn->connected())
+        {
+            connected.set_value(conn);
+        }
+    });
+    server.setMessageCallback([](const TcpConnectionPtr&, Buffer *buf, Timestamp)
+    {
+        buf->retrieveAll();
+    });
+    server.setThreadNum(1);
+    server.start();
+    std::thread loopThread([&]() { loop.loop(); });
+
+    std::thread reader(client);
+    TcpConnectionPtr conn = connected.get_future().get();
+    EventLoop *ioLoop = conn->getLoop();
+
+    for(int m = kCstr; m <= kPayload; ++m)
+    {
+        Mode mode = static_cast<Mode>(m);
+
+        // in the loop thread, counted inside one task
+        std::promise<int64_t> inLoop;
+        ioLoop->runInLoop([&]()
+        {
+            int64_t start = g_allocs;
+            sendMessages(conn, mode, messages, message, payload);
+            inLoop.set_value(g_allocs - start);
+        });
+        int64_t inLoopAllocs = inLoop.get_future().get();
+
+        // from this thread, until the loop has run every send task
+        std::promise<void> done;
+        std::future<void> doneFuture = done.get_future();
+        int64_t start = g_allocs;
+        sendMessages(conn, mode, messages, message, payload);
+        ioLoop->runInLoop([&]() { done.set_value(); });
+        doneFuture.get();
+        int64_t crossAllocs = g_allocs - start;
+
+        printf("%-15s bytes=%zu: inloop %.2f allocs/msg, cross %.2f allocs/msg\n",
+                kModeNames[m], bytes, double(inLoopAllocs) / messages,
+                double(crossAllocs) / messages);
+    }
+
+    g_stop = true;
+    ioLoop->runInLoop([&]() { conn->shutdown(); });
+    reader.join();
+    loop.runInLoop([&]() { loop.quit(); });
+    loopThread.join();
+    return 0;
+}
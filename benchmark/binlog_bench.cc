@@ -0,0 +1,69 @@
+#include <mymuduo/AsyncLogging.h>
+#include <mymuduo/BinaryLogging.h>
+#include <mymuduo/Logger.h>
+#include <mymuduo/Timestamp.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+// nanoseconds per LOG_INFO call with a trace point like the poller's, as
+// text to an output doing nothing, as text to AsyncLogging and as a binary
+// record to BinaryLogging; the logs go to /tmp/binlog_bench.*, decode the
+// .blog one with tools/logdecoder
+// usage: binlog_bench [threads] [messages per thread]
+
+static void tracePoints(int messages)
+{
+    for(int i = 0; i < messages; ++i)
+    {
+        LOG_INFO("func=%s => fd=%d events=%d index=%d\n", __FUNCTION__, i & 1023, 1, i);
+    }
+}
+
+static double run(const char *name, int threads, int messages)
+{
+    Timestamp start = Timestamp::now();
+    std::vector<std::thread> writers;
+    for(int i = 0; i < threads; ++i)
+    {
+        writers.emplace_back(tracePoints, messages);
+    }
+    for(auto& t : writers)
+    {
+        t.join();
+    }
+    double nanos = (Timestamp::now().microSecondsSinceEpoch() - start.microSecondsSinceEpoch())
+                 * 1e3 / (static_cast<double>(threads) * messages);
+    printf("%-12s %8.1f ns/call\n", name, nanos);
+    return nanos;
+}
+
+int main(int argc, char *argv[])
+{
+    int threads = argc > 1 ? atoi(argv[1]) : 1;
+    int messages = argc > 2 ? atoi(argv[2]) : 1000000;
+
+    Logger::instance().setOutput([](const char*, size_t) {});
+    run("text, null", threads, messages);
+
+    {
+        AsyncLogging text("/tmp/binlog_bench");
+        text.start();
+        Logger::instance().setOutput([&text](const char *line, size_t len) { text.append(line, len); });
+        run("text, async", threads, messages);
+        text.stop();
+        printf("%12s %lld dropped\n", "", static_cast<long long>(text.droppedMessages()));
+        Logger::instance().setOutput([](const char*, size_t) {});
+    }
+
+    {
+        BinaryLogging binary("/tmp/binlog_bench", 16 * 1024 * 1024);
+        binary.start();
+        run("binary", threads, messages);
+        binary.stop();
+        printf("%12s %lld dropped\n", "", static_cast<long long>(binary.droppedMessages()));
+    }
+    return 0;
+}
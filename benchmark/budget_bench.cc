@@ -0,0 +1,147 @@
+#include <mymuduo/TcpServer.h>
+#include <mymuduo/Timestamp.h>
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// a server pushes 64 KB to every client each 10 ms, some clients never read
+// none:   no budget, the stalled clients' output grows without bound
+// reject|shed|stall: a 32 MB MemoryBudget with that policy
+// usage: budget_bench none|reject|shed|stall [stalled] [healthy] [seconds]
+
+static const uint16_t kPort = 9996;
+static const size_t kBudget = 32 * 1024 * 1024;
+
+static std::atomic<bool> g_stop(false);
+static std::atomic<int64_t> g_received(0);
+
+static int dial()
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    int rcvbuf = 64 * 1024;
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof rcvbuf);
+    ::connect(fd, (struct sockaddr*)&addr, sizeof(addr));
+    return fd;
+}
+
+static void stalledClient()
+{
+    int fd = dial();
+    while(!g_stop)
+    {
+        ::usleep(10 * 1000);
+    }
+    ::close(fd);
+}
+
+static void healthyClient()
+{
+    int fd = dial();
+    struct timeval timeout = { 0, 100 * 1000 };   // to notice g_stop
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+    std::vector<char> buf(64 * 1024);
+    while(!g_stop)
+    {
+        ssize_t n = ::read(fd, buf.data(), buf.size());
+        if(n > 0)
+        {
+            g_received += n;
+        }
+        else if(n == 0 || errno != EAGAIN)
+        {
+            break;
+        }
+    }
+    ::close(fd);
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc < 2)
+    {
+        printf("usage: %s none|reject|shed|stall [stalled] [healthy] [seconds]\n", argv[0]);
+        return 1;
+    }
+    int stalled = argc > 2 ? atoi(argv[2]) : 8;
+    int healthy = argc > 3 ? atoi(argv[3]) : 4;
+    double seconds = argc > 4 ? atof(argv[4]) : 3.0;
+
+    EventLoop loop;
+    InetAddress addr(kPort, "127.0.0.1");
+    TcpServer server(&loop, addr, "BudgetBench");
+    if(strcmp(argv[1], "reject") == 0)
+    {
+        server.setMemoryBudget(kBudget, MemoryBudget::kRejectSends);
+    }
+    else if(strcmp(argv[1], "shed") == 0)
+    {
+        server.setMemoryBudget(kBudget, MemoryBudget::kShedLargest);
+    }
+    else if(strcmp(argv[1], "stall") == 0)
+    {
+        server.setMemoryBudget(kBudget, MemoryBudget::kCloseStalled, 0.5);
+    }
+    server.setConnectionCallback([](const TcpConnectionPtr&) {});
+    server.setMessageCallback([](const TcpConnectionPtr&, Buffer *buf, Timestamp)
+    {
+        buf->retrieveAll();
+    });
+    server.setThreadNum(2);
+    server.start();
+
+    std::vector<std::thread> clients;
+    for(int i = 0; i < stalled; ++i)
+    {
+        clients.emplace_back(stalledClient);
+    }
+    for(int i = 0; i < healthy; ++i)
+    {
+        clients.emplace_back(healthyClient);
+    }
+
+    const std::string chunk(64 * 1024, 'x');
+    size_t peak = 0;
+    loop.runEvery(0.01, [&]()
+    {
+        server.forEachConnection([&chunk](const TcpConnectionPtr &conn) { conn->send(chunk); });
+        peak = std::max(peak, server.bufferedBytes());
+    });
+    loop.runAfter(seconds, [&]()
+    {
+        g_stop = true;
+        loop.quit();
+    });
+    loop.loop();
+    for(auto &t : clients)
+    {
+        t.join();
+    }
+
+    struct rusage usage;
+    ::getrusage(RUSAGE_SELF, &usage);
+    const MemoryBudget *budget = server.memoryBudget();
+    printf("budget %s: peak buffered %.1f MB, max rss %.1f MB, healthy %.1f MB/s, "
+           "rejected sends %lld, evicted %lld\n",
+            argv[1], peak / (1024.0 * 1024), usage.ru_maxrss / 1024.0,
+            g_received / seconds / (1024 * 1024),
+            budget ? static_cast<long long>(budget->rejectedSends()) : 0LL,
+            budget ? static_cast<long long>(budget->evictedConnections()) : 0LL);
+    return 0;
+}
@@ -0,0 +1,99 @@
+#include <mymuduo/Buffer.h>
+#include <mymuduo/BufferPool.h>
+#include <mymuduo/Timestamp.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+// queue a message into a Buffer the way sendInLoop does (in 4 KB pieces)
+// and drain it into a socketpair with writeFd, like handleWrite
+// reports the throughput and the resident memory for 1 KB, 64 KB, 16 MB
+// usage: buffer_bench [totalMB] [huge]
+
+static long residentKB()
+{
+    long pages = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if(fp != nullptr)
+    {
+        if(fscanf(fp, "%*s %ld", &pages) != 1)
+        {
+            pages = 0;
+        }
+        fclose(fp);
+    }
+    return pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static void runMessage(size_t messageSize, size_t totalBytes)
+{
+    int fds[2];
+    if(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+    {
+        perror("socketpair");
+        return;
+    }
+    std::thread reader([&]()
+    {
+        char buf[256 * 1024];
+        while(::read(fds[1], buf, sizeof(buf)) > 0)
+        {
+        }
+    });
+
+    std::string piece(4096, 'x');
+    Buffer buffer;
+    long peakKB = residentKB();
+    size_t iterations = std::max(totalBytes / messageSize, static_cast<size_t>(1));
+    Timestamp start = Timestamp::now();
+    for(size_t i = 0; i < iterations; ++i)
+    {
+        for(size_t left = messageSize; left > 0; )
+        {
+            size_t n = std::min(left, piece.size());
+            buffer.append(piece.data(), n);
+            left -= n;
+        }
+        if(i % 256 == 0)
+        {
+            peakKB = std::max(peakKB, residentKB());
+        }
+        while(buffer.readableBytes() > 0)
+        {
+            int saveErrno = 0;
+            ssize_t n = buffer.writeFd(fds[0], &saveErrno);
+            if(n <= 0)
+            {
+                break;
+            }
+            buffer.retrieve(n);
+        }
+    }
+    Timestamp end = Timestamp::now();
+    BufferPool &pool = BufferPool::threadPool();
+    ::shutdown(fds[0], SHUT_WR);
+    reader.join();
+    ::close(fds[0]);
+    ::close(fds[1]);
+
+    double seconds = static_cast<double>(end.microSecondsSinceEpoch()
+                    - start.microSecondsSinceEpoch()) / Timestamp::kMicroSecondsPerSecond;
+    printf("%10zu bytes: %10.1f MB/s  peak rss %8ld KB  pool hits %ld misses %ld\n",
+            messageSize, iterations * messageSize / seconds / 1024 / 1024, peakKB,
+            static_cast<long>(pool.hits()), static_cast<long>(pool.misses()));
+}
+
+int main(int argc, char *argv[])
+{
+    size_t totalBytes = static_cast<size_t>(argc > 1 ? atoi(argv[1]) : 1024) * 1024 * 1024;
+    BufferPool::setHugePages(argc > 2 && strcmp(argv[2], "huge") == 0);
+    runMessage(1024, totalBytes);
+    runMessage(64 * 1024, totalBytes);
+    runMessage(16 * 1024 * 1024, totalBytes);
+    return 0;
+}
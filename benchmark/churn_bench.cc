@@ -0,0 +1,141 @@
+#include <mymuduo/TcpServer.h>
+#include <mymuduo/Timestamp.h>
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// connection churn: every client connects, sends a message, reads the echo
+// and resets the connection, repeatedly; reports full cycles per second
+// and the server's cpu time per cycle, the clients run in a child process
+// usage: churn_bench [threads] [clients] [seconds] [message bytes]
+
+static std::atomic<bool> g_stop(false);
+static std::atomic<int64_t> g_cycles(0);
+static const uint16_t kPort = 9993;
+
+static void client(size_t messageBytes)
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    struct linger reset = { 1, 0 };   // RST on close, no TIME_WAIT piling up
+    int one = 1;
+    std::vector<char> message(messageBytes, 'x');
+    std::vector<char> echo(messageBytes);
+    while(!g_stop)
+    {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        ::setsockopt(fd, SOL_SOCKET, SO_LINGER, &reset, sizeof reset);
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+        if(::connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0
+            && ::write(fd, message.data(), message.size()) == static_cast<ssize_t>(message.size()))
+        {
+            size_t got = 0;
+            while(got < echo.size())
+            {
+                ssize_t n = ::read(fd, echo.data() + got, echo.size() - got);
+                if(n <= 0)
+                {
+                    break;
+                }
+                got += n;
+            }
+            if(got == echo.size())
+            {
+                ++g_cycles;
+            }
+        }
+        ::close(fd);
+    }
+}
+
+static double processCpuSeconds()
+{
+    struct rusage usage;
+    ::getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+         + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// the child: clients from 0.2s on for seconds, then the cycle count to fd
+static void runClients(int fd, int clients, double seconds, size_t messageBytes)
+{
+    ::usleep(200 * 1000);
+    std::vector<std::thread> clientThreads;
+    for(int i = 0; i < clients; ++i)
+    {
+        clientThreads.emplace_back(client, messageBytes);
+    }
+    ::usleep(static_cast<useconds_t>(seconds * 1e6));
+    int64_t cycles = g_cycles;
+    g_stop = true;
+    for(auto &t : clientThreads)
+    {
+        t.join();
+    }
+    ::write(fd, &cycles, sizeof cycles);
+}
+
+int main(int argc, char *argv[])
+{
+    int threads = argc > 1 ? atoi(argv[1]) : 4;
+    int clients = argc > 2 ? atoi(argv[2]) : 8;
+    double seconds = argc > 3 ? atof(argv[3]) : 5.0;
+    size_t messageBytes = argc > 4 ? atoi(argv[4]) : 64;
+
+    int fds[2];
+    if(::pipe(fds) < 0)
+    {
+        perror("pipe");
+        return 1;
+    }
+    pid_t pid = ::fork();
+    if(pid == 0)
+    {
+        runClients(fds[1], clients, seconds, messageBytes);
+        _exit(0);
+    }
+
+    EventLoop loop;
+    InetAddress addr(kPort, "127.0.0.1");
+    TcpServer server(&loop, addr, "ChurnBench");
+    server.setConnectionCallback([](const TcpConnectionPtr&) {});
+    server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+    {
+        conn->send(buf);
+    });
+    server.setThreadNum(threads);
+    server.start();
+
+    double startCpu = 0;
+    double serverCpu = 0;
+    loop.runAfter(0.2, [&]() { startCpu = processCpuSeconds(); });
+    loop.runAfter(0.2 + seconds, [&]()
+    {
+        serverCpu = processCpuSeconds() - startCpu;
+        loop.quit();
+    });
+    loop.loop();
+    int64_t cycles = 0;
+    ::read(fds[0], &cycles, sizeof cycles);
+    ::waitpid(pid, nullptr, 0);
+
+    printf("churn threads=%d clients=%d message=%zu: %.0f connect/echo/close per second, "
+           "server %.2f us/cycle\n",
+            threads, clients, messageBytes, cycles / seconds,
+            cycles > 0 ? serverCpu * 1e6 / cycles : 0.0);
+    return 0;
+}
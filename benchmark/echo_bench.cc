@@ -0,0 +1,118 @@
+#include <mymuduo/TcpServer.h>
+#include <mymuduo/Timestamp.h>
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// ping-pong echo over loopback, the server and the clients in one process
+// usage: echo_bench [clients] [messageSize] [seconds] [serverThreads] [completion]
+// run it again with MUDUO_USE_URING=1 to compare the io_uring Poller,
+// completion=1 has the ring do the socket I/O, see TcpServer::setCompletionIo
+
+static std::atomic<bool> g_stop(false);
+static std::atomic<int64_t> g_messages(0);
+
+static void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+{
+    conn->send(buf->retrieveAllAsString());
+}
+
+static void runClient(uint16_t port, size_t messageSize)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    if(::connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+    {
+        perror("connect");
+        ::close(fd);
+        return;
+    }
+    int one = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    std::string message(messageSize, 'x');
+    std::vector<char> reply(messageSize);
+    int64_t count = 0;
+    while(!g_stop)
+    {
+        if(::write(fd, message.data(), message.size()) != static_cast<ssize_t>(message.size()))
+        {
+            break;
+        }
+        size_t got = 0;
+        while(got < messageSize)
+        {
+            ssize_t n = ::read(fd, reply.data() + got, messageSize - got);
+            if(n <= 0)
+            {
+                break;
+            }
+            got += n;
+        }
+        if(got < messageSize)
+        {
+            break;
+        }
+        ++count;
+    }
+    g_messages += count;
+    ::close(fd);
+}
+
+int main(int argc, char *argv[])
+{
+    int clients = argc > 1 ? atoi(argv[1]) : 16;
+    size_t messageSize = argc > 2 ? atoi(argv[2]) : 64;
+    double seconds = argc > 3 ? atof(argv[3]) : 5.0;
+    int serverThreads = argc > 4 ? atoi(argv[4]) : 1;
+    bool completion = argc > 5 && atoi(argv[5]) != 0;
+    const uint16_t port = 9981;
+
+    EventLoop loop;
+    InetAddress addr(port, "127.0.0.1");
+    TcpServer server(&loop, addr, "EchoBench");
+    server.setConnectionCallback([](const TcpConnectionPtr&){});
+    server.setMessageCallback(onMessage);
+    server.setThreadNum(serverThreads);
+    server.setCompletionIo(completion);
+    server.start();
+
+    std::vector<std::thread> threads;
+    loop.runAfter(0.1, [&]()
+    {
+        for(int i = 0; i < clients; ++i)
+        {
+            threads.emplace_back(runClient, port, messageSize);
+        }
+    });
+    loop.runAfter(0.1 + seconds, [&]()
+    {
+        g_stop = true;
+        loop.quit();
+    });
+    loop.loop();
+    for(auto &t : threads)
+    {
+        t.join();
+    }
+
+    printf("poller=%s clients=%d size=%zu: %.0f msgs/s\n",
+            !::getenv("MUDUO_USE_URING") ? "epoll"
+                : completion ? "io_uring completion" : "io_uring",
+            clients, messageSize, g_messages / seconds);
+    return 0;
+}
@@ -0,0 +1,147 @@
+#include <mymuduo/TcpServer.h>
+#include <mymuduo/Timestamp.h>
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// level-triggered vs edge-triggered epoll
+// usage: et_bench bulk|small lt|et [clients] [seconds]
+//   bulk:  every client streams 64 KB writes, the server discards them
+//   small: every client connects, echoes 64 bytes once and closes, repeatedly
+
+static std::atomic<bool> g_stop(false);
+static std::atomic<int64_t> g_bytes(0);
+static std::atomic<int64_t> g_connections(0);
+static const uint16_t kPort = 9982;
+
+static int connectServer()
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    if(::connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void bulkClient()
+{
+    int fd = connectServer();
+    std::string chunk(64 * 1024, 'x');
+    while(fd >= 0 && !g_stop)
+    {
+        if(::write(fd, chunk.data(), chunk.size()) <= 0)
+        {
+            break;
+        }
+    }
+    ::close(fd);
+}
+
+static void smallClient()
+{
+    char buf[64] = {0,};
+    while(!g_stop)
+    {
+        int fd = connectServer();
+        if(fd < 0)
+        {
+            continue;
+        }
+        size_t got = 0;
+        if(::write(fd, buf, sizeof(buf)) == sizeof(buf))
+        {
+            ssize_t n;
+            while(got < sizeof(buf) && (n = ::read(fd, buf + got, sizeof(buf) - got)) > 0)
+            {
+                got += n;
+            }
+        }
+        ::close(fd);
+        if(got == sizeof(buf))
+        {
+            ++g_connections;
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc < 3)
+    {
+        printf("usage: %s bulk|small lt|et [clients] [seconds]\n", argv[0]);
+        return 1;
+    }
+    bool bulk = strcmp(argv[1], "bulk") == 0;
+    bool edgeTriggered = strcmp(argv[2], "et") == 0;
+    int clients = argc > 3 ? atoi(argv[3]) : (bulk ? 4 : 32);
+    double seconds = argc > 4 ? atof(argv[4]) : 5.0;
+
+    EventLoop loop;
+    InetAddress addr(kPort, "127.0.0.1");
+    TcpServer server(&loop, addr, "EtBench");
+    server.setConnectionCallback([](const TcpConnectionPtr&){});
+    if(bulk)
+    {
+        server.setMessageCallback([](const TcpConnectionPtr&, Buffer *buf, Timestamp)
+        {
+            g_bytes += buf->readableBytes();
+            buf->retrieveAll();
+        });
+    }
+    else
+    {
+        server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+        {
+            conn->send(buf->retrieveAllAsString());
+        });
+    }
+    server.setEdgeTriggered(edgeTriggered);
+    server.start();
+
+    std::vector<std::thread> threads;
+    loop.runAfter(0.1, [&]()
+    {
+        for(int i = 0; i < clients; ++i)
+        {
+            threads.emplace_back(bulk ? bulkClient : smallClient);
+        }
+    });
+    loop.runAfter(0.1 + seconds, [&]()
+    {
+        g_stop = true;
+        loop.quit();
+    });
+    loop.loop();
+    for(auto &t : threads)
+    {
+        t.detach(); // bulk writers may block on a full socket
+    }
+
+    if(bulk)
+    {
+        printf("bulk %s clients=%d: %.1f MB/s\n", edgeTriggered ? "et" : "lt",
+                clients, g_bytes / seconds / 1024 / 1024);
+    }
+    else
+    {
+        printf("small %s clients=%d: %.0f connections/s\n", edgeTriggered ? "et" : "lt",
+                clients, g_connections / seconds);
+    }
+    return 0;
+}
@@ -0,0 +1,153 @@
+#include <mymuduo/TcpServer.h>
+#include <mymuduo/Timestamp.h>
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// open many idle loopback connections and report the server memory
+// each of them costs, the client sockets hold no user memory
+// usage: idle_bench [connections] [serverThreads]
+// 1M connections need ulimit -n above 2M and fs.nr_open raised to match
+
+#ifndef IP_BIND_ADDRESS_NO_PORT
+#define IP_BIND_ADDRESS_NO_PORT 24
+#endif
+
+static const uint16_t kPort = 9983;
+static std::atomic<int> g_connected(0);
+
+static long residentKB()
+{
+    long pages = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if(fp != nullptr)
+    {
+        if(fscanf(fp, "%*s %ld", &pages) != 1)
+        {
+            pages = 0;
+        }
+        fclose(fp);
+    }
+    return pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// 50000 connections per source address, the ephemeral ports run out after that
+static int connectOne(int i)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if(fd < 0)
+    {
+        return -1;
+    }
+    int one = 1;
+    ::setsockopt(fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &one, sizeof(one));
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(0x7f000002 + i / 50000);
+    ::bind(fd, (struct sockaddr*)&local, sizeof(local));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    if(::connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char *argv[])
+{
+    int connections = argc > 1 ? atoi(argv[1]) : 100000;
+    int serverThreads = argc > 2 ? atoi(argv[2]) : 4;
+
+    // both ends of every connection live in this process
+    struct rlimit rl;
+    ::getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = rl.rlim_max;
+    ::setrlimit(RLIMIT_NOFILE, &rl);
+    int maxConnections = static_cast<int>((rl.rlim_cur - 64) / 2);
+    if(connections > maxConnections)
+    {
+        printf("RLIMIT_NOFILE %ld allows %d connections only\n",
+                static_cast<long>(rl.rlim_cur), maxConnections);
+        connections = maxConnections;
+    }
+
+    EventLoop loop;
+    InetAddress addr(kPort, "127.0.0.1");
+    TcpServer server(&loop, addr, "IdleBench");
+    server.setConnectionCallback([](const TcpConnectionPtr &conn)
+    {
+        if(conn->connected())
+        {
+            ++g_connected;
+        }
+    });
+    server.setMessageCallback([](const TcpConnectionPtr&, Buffer *buf, Timestamp)
+    {
+        buf->retrieveAll();
+    });
+    server.setThreadNum(serverThreads);
+    server.start();
+
+    std::vector<int> clientFds;
+    clientFds.reserve(connections);
+    long baseKB = 0;
+    Timestamp start;
+    std::thread client;
+    loop.runAfter(0.1, [&]()
+    {
+        baseKB = residentKB();
+        start = Timestamp::now();
+        client = std::thread([&]()
+        {
+            for(int i = 0; i < connections; ++i)
+            {
+                int fd = connectOne(i);
+                if(fd < 0)
+                {
+                    perror("connect");
+                    connections = i;
+                    break;
+                }
+                clientFds.push_back(fd);
+            }
+        });
+    });
+    loop.runEvery(0.1, [&]()
+    {
+        if(g_connected > 0 && g_connected == connections)
+        {
+            loop.quit();
+        }
+    });
+    loop.loop();
+    client.join();
+
+    long usedKB = residentKB() - baseKB;
+    double seconds = static_cast<double>(Timestamp::now().microSecondsSinceEpoch()
+                    - start.microSecondsSinceEpoch()) / Timestamp::kMicroSecondsPerSecond;
+    printf("%d idle connections in %.1f s, server rss +%ld KB, %.0f bytes per connection\n",
+            connections, seconds, usedKB, usedKB * 1024.0 / connections);
+    printf("sizeof(TcpConnection) = %zu\n", sizeof(TcpConnection));
+
+    for(int fd : clientFds)
+    {
+        ::close(fd);
+    }
+    return 0;
+}
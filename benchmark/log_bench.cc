@@ -0,0 +1,147 @@
+#include <mymuduo/AsyncLogging.h>
+#include <mymuduo/Logger.h>
+#include <mymuduo/TcpServer.h>
+#include <mymuduo/Timestamp.h>
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// the cost of logging: threads writing LOG_INFO as fast as they can, then
+// the round trip of a ping-pong echo while the library logs every poll and
+// send; sync writes stdout (redirect it to a file), async goes through
+// AsyncLogging to /tmp/log_bench.*.log; results are printed to stderr
+// usage: log_bench sync|async [threads] [messages per thread] [round trips]
+
+static const uint16_t kPort = 9999;
+
+static double seconds(Timestamp start)
+{
+    return (Timestamp::now().microSecondsSinceEpoch() - start.microSecondsSinceEpoch()) / 1e6;
+}
+
+static void writer(int messages)
+{
+    for(int i = 0; i < messages; ++i)
+    {
+        LOG_INFO("log_bench message %d from a writer thread, some payload %s", i, "abcdefghijklmnopqrstuvwxyz");
+    }
+}
+
+static void pingPong(int rounds)
+{
+    std::atomic<EventLoop*> serverLoop(nullptr);
+    std::thread server([&serverLoop]()
+    {
+        EventLoop loop;
+        TcpServer server(&loop, InetAddress(kPort, "127.0.0.1"), "LogBench");
+        server.setConnectionCallback([](const TcpConnectionPtr&) {});
+        server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+        {
+            conn->send(buf->retrieveAllAsString());
+        });
+        server.start();
+        serverLoop = &loop;
+        loop.loop();
+    });
+    while(serverLoop == nullptr)
+    {
+        ::usleep(1000);
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+    ::connect(fd, (struct sockaddr*)&addr, sizeof(addr));
+
+    char message[64];
+    memset(message, 'p', sizeof message);
+    std::vector<int64_t> rtts;
+    rtts.reserve(rounds);
+    for(int i = 0; i < rounds; ++i)
+    {
+        Timestamp start = Timestamp::now();
+        ::write(fd, message, sizeof message);
+        size_t got = 0;
+        char reply[64];
+        while(got < sizeof reply)
+        {
+            ssize_t n = ::read(fd, reply + got, sizeof reply - got);
+            if(n <= 0)
+            {
+                break;
+            }
+            got += n;
+        }
+        rtts.push_back(Timestamp::now().microSecondsSinceEpoch() - start.microSecondsSinceEpoch());
+    }
+    ::close(fd);
+
+    std::sort(rtts.begin(), rtts.end());
+    double sum = 0;
+    for(int64_t rtt : rtts)
+    {
+        sum += rtt;
+    }
+    fprintf(stderr, "ping-pong %d round trips: avg %.1f us p99 %lld us\n",
+            rounds, sum / rounds, static_cast<long long>(rtts[rounds * 99 / 100]));
+
+    serverLoop.load()->quit();
+    server.join();
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc < 2)
+    {
+        fprintf(stderr, "usage: %s sync|async [threads] [messages per thread] [round trips]\n", argv[0]);
+        return 1;
+    }
+    bool async = strcmp(argv[1], "async") == 0;
+    int threads = argc > 2 ? atoi(argv[2]) : 4;
+    int messages = argc > 3 ? atoi(argv[3]) : 250000;
+    int rounds = argc > 4 ? atoi(argv[4]) : 20000;
+
+    AsyncLogging log("/tmp/log_bench");
+    if(async)
+    {
+        log.start();
+        Logger::instance().setOutput([&log](const char *line, size_t len) { log.append(line, len); });
+        Logger::instance().setFlush([&log]() { log.flush(); });
+    }
+
+    Timestamp start = Timestamp::now();
+    std::vector<std::thread> writers;
+    for(int i = 0; i < threads; ++i)
+    {
+        writers.emplace_back(writer, messages);
+    }
+    for(auto& t : writers)
+    {
+        t.join();
+    }
+    Logger::instance().flush();
+    double elapsed = seconds(start);
+    fprintf(stderr, "%s %d threads: %d messages in %.3f s, %.0f msgs/s, %lld dropped\n",
+            argv[1], threads, threads * messages, elapsed, threads * messages / elapsed,
+            static_cast<long long>(log.droppedMessages()));
+
+    pingPong(rounds);
+    Logger::instance().flush();
+    return 0;
+}
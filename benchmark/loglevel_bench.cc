@@ -0,0 +1,119 @@
+#include <mymuduo/Logger.h>
+#include <mymuduo/TcpServer.h>
+#include <mymuduo/Timestamp.h>
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// the cost of a LOG_INFO below the level against one that is written to
+// a sink doing nothing, then ping-pong echo throughput with the library's
+// INFO logs on or off; the logs go to stdout (redirect it), results to stderr
+// usage: loglevel_bench info|error [seconds]
+
+static const uint16_t kPort = 10000;
+
+static double nanosPerCall(int64_t calls, Timestamp start)
+{
+    return (Timestamp::now().microSecondsSinceEpoch() - start.microSecondsSinceEpoch()) * 1e3 / calls;
+}
+
+static std::atomic<bool> g_stop(false);
+static std::atomic<int64_t> g_messages(0);
+
+static void runClient()
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    ::connect(fd, (struct sockaddr*)&addr, sizeof(addr));
+    int one = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    // the server stops echoing when its loop quits, don't wait for it
+    struct timeval timeout = {1, 0};
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+
+    char message[256];
+    memset(message, 'x', sizeof message);
+    while(!g_stop)
+    {
+        if(::write(fd, message, sizeof message) != sizeof message)
+        {
+            break;
+        }
+        size_t got = 0;
+        char reply[256];
+        while(got < sizeof reply)
+        {
+            ssize_t n = ::read(fd, reply + got, sizeof reply - got);
+            if(n <= 0)
+            {
+                ::close(fd);
+                return;
+            }
+            got += n;
+        }
+        ++g_messages;
+    }
+    ::close(fd);
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc < 2)
+    {
+        fprintf(stderr, "usage: %s info|error [seconds]\n", argv[0]);
+        return 1;
+    }
+    int level = strcmp(argv[1], "info") == 0 ? INFO : ERROR;
+    int seconds = argc > 2 ? atoi(argv[2]) : 5;
+
+    const int64_t calls = 10 * 1000 * 1000;
+    Logger::setLogLevel(ERROR);
+    Timestamp start = Timestamp::now();
+    for(int64_t i = 0; i < calls; ++i)
+    {
+        LOG_INFO("loglevel_bench disabled %lld %s", static_cast<long long>(i), "payload");
+    }
+    fprintf(stderr, "disabled LOG_INFO: %.2f ns/call\n", nanosPerCall(calls, start));
+
+    Logger::setLogLevel(INFO);
+    Logger::instance().setOutput([](const char*, size_t) {});
+    const int64_t written = calls / 10;
+    start = Timestamp::now();
+    for(int64_t i = 0; i < written; ++i)
+    {
+        LOG_INFO("loglevel_bench written %lld %s", static_cast<long long>(i), "payload");
+    }
+    fprintf(stderr, "written LOG_INFO, null output: %.1f ns/call\n", nanosPerCall(written, start));
+    Logger::instance().setOutput([](const char *line, size_t len) { ::fwrite(line, 1, len, stdout); });
+
+    Logger::setLogLevel(level);
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(kPort, "127.0.0.1"), "LogLevelBench");
+    server.setConnectionCallback([](const TcpConnectionPtr&) {});
+    server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+    {
+        conn->send(buf->retrieveAllAsString());
+    });
+    server.start();
+    std::thread client(runClient);
+    loop.runAfter(seconds, [&loop]() { g_stop = true; loop.quit(); });
+    loop.loop();
+    client.join();
+    fprintf(stderr, "echo with %s logs: %.0f round trips/s\n",
+            argv[1], static_cast<double>(g_messages) / seconds);
+    return 0;
+}
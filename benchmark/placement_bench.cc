@@ -0,0 +1,166 @@
+#include <mymuduo/TcpServer.h>
+#include <mymuduo/Timestamp.h>
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <linux/perf_event.h>
+#include <mutex>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// cpu placement of the sub loops: cross-core migrations and echo p99
+// usage: placement_bench none|pin|incoming [threads] [clients] [seconds]
+//   pin:      one sub loop per physical core
+//   incoming: pinned, and connections go to the loop on the cpu
+//             that receives their packets (SO_INCOMING_CPU)
+// the migrations are the PERF_COUNT_SW_CPU_MIGRATIONS of the loop threads
+
+static std::atomic<bool> g_stop(false);
+static const uint16_t kPort = 9990;
+
+static std::mutex g_mutex;
+static std::vector<int> g_counters;
+static std::vector<int64_t> g_latencies;
+
+static int openMigrationCounter()
+{
+    struct perf_event_attr attr;
+    for(int excludeKernel = 0; excludeKernel < 2; ++excludeKernel)
+    {
+        memset(&attr, 0, sizeof attr);
+        attr.type = PERF_TYPE_SOFTWARE;
+        attr.size = sizeof attr;
+        attr.config = PERF_COUNT_SW_CPU_MIGRATIONS;
+        attr.exclude_kernel = excludeKernel;
+        attr.exclude_hv = 1;
+        int fd = static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        if(fd >= 0)
+        {
+            return fd;
+        }
+    }
+    return -1;
+}
+
+static void client()
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    if(::connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+    {
+        ::close(fd);
+        return;
+    }
+    std::vector<int64_t> latencies;
+    char buf[64] = {0,};
+    while(!g_stop)
+    {
+        Timestamp start = Timestamp::now();
+        if(::write(fd, buf, sizeof buf) != sizeof buf)
+        {
+            break;
+        }
+        size_t got = 0;
+        ssize_t n;
+        while(got < sizeof buf && (n = ::read(fd, buf + got, sizeof buf - got)) > 0)
+        {
+            got += n;
+        }
+        if(got < sizeof buf)
+        {
+            break;
+        }
+        latencies.push_back(Timestamp::now().microSecondsSinceEpoch()
+                            - start.microSecondsSinceEpoch());
+    }
+    ::close(fd);
+    std::lock_guard<std::mutex> lock(g_mutex);
+    g_latencies.insert(g_latencies.end(), latencies.begin(), latencies.end());
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc < 2)
+    {
+        printf("usage: %s none|pin|incoming [threads] [clients] [seconds]\n", argv[0]);
+        return 1;
+    }
+    bool pin = strcmp(argv[1], "none") != 0;
+    bool incoming = strcmp(argv[1], "incoming") == 0;
+    std::vector<int> cores = EventLoopThreadPool::physicalCoreCpus();
+    int threads = argc > 2 ? atoi(argv[2]) : static_cast<int>(cores.size());
+    int clients = argc > 3 ? atoi(argv[3]) : 2 * threads;
+    double seconds = argc > 4 ? atof(argv[4]) : 5.0;
+
+    EventLoop loop;
+    InetAddress addr(kPort, "127.0.0.1");
+    TcpServer server(&loop, addr, "PlacementBench");
+    server.setConnectionCallback([](const TcpConnectionPtr&){});
+    server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+    {
+        conn->send(buf);
+    });
+    server.setThreadInitCallback([](EventLoop*)
+    {
+        int fd = openMigrationCounter();
+        std::lock_guard<std::mutex> lock(g_mutex);
+        g_counters.push_back(fd);
+    });
+    server.setThreadNum(threads);
+    if(pin)
+    {
+        server.setCpuList(cores);
+    }
+    server.setIncomingCpu(incoming);
+    server.start();
+
+    std::vector<std::thread> clientThreads;
+    loop.runAfter(0.1, [&]()
+    {
+        for(int i = 0; i < clients; ++i)
+        {
+            clientThreads.emplace_back(client);
+        }
+    });
+    loop.runAfter(0.1 + seconds, [&]()
+    {
+        g_stop = true;
+        loop.quit();
+    });
+    loop.loop();
+    for(auto &t : clientThreads)
+    {
+        t.join();
+    }
+
+    int64_t migrations = 0;
+    bool counted = false;
+    for(int fd : g_counters)
+    {
+        uint64_t value = 0;
+        if(fd >= 0 && ::read(fd, &value, sizeof value) == sizeof value)
+        {
+            migrations += value;
+            counted = true;
+        }
+    }
+    std::sort(g_latencies.begin(), g_latencies.end());
+    size_t n = g_latencies.size();
+    printf("%s threads=%d clients=%d cores=%zu: migrations %s%ld, %zu echoes, p50 %ld us, p99 %ld us\n",
+            argv[1], threads, clients, cores.size(), counted ? "" : "n/a ", migrations, n,
+            n ? g_latencies[n / 2] : 0, n ? g_latencies[n * 99 / 100] : 0);
+    return 0;
+}
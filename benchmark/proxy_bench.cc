@@ -0,0 +1,181 @@
+#include <mymuduo/TcpServer.h>
+#include <mymuduo/Timestamp.h>
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <mutex>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// a proxy between a fast producer and a slow consumer, both connect to
+// the proxy, the first one is the producer and the data goes one way
+// off: the proxy queues whatever the producer sends
+// on:  setFlowControl pauses reading the producer at the high-water mark
+// usage: proxy_bench on|off [seconds] [consumer MB/s]
+
+static const uint16_t kPort = 9995;
+static const size_t kHighWaterMark = 4 * 1024 * 1024;
+static const size_t kLowWaterMark = 1 * 1024 * 1024;
+static const int64_t kProducerLimit = 1024LL * 1024 * 1024;
+
+static std::atomic<bool> g_stop(false);
+static std::atomic<bool> g_paired(false);
+static std::atomic<int64_t> g_consumed(0);
+static std::atomic<size_t> g_peakQueued(0);
+static std::atomic<int> g_producerFd(-1);
+static std::atomic<int> g_consumerFd(-1);
+
+static std::mutex g_mutex;
+static TcpConnectionPtr g_producer;
+static TcpConnectionPtr g_consumer;
+
+static int dial()
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    ::connect(fd, (struct sockaddr*)&addr, sizeof(addr));
+    return fd;
+}
+
+static void producer()
+{
+    int fd = dial();
+    g_producerFd = fd;
+    while(!g_paired && !g_stop)
+    {
+        ::usleep(1000);
+    }
+    std::vector<char> chunk(64 * 1024, 'x');
+    int64_t sent = 0;
+    while(!g_stop && sent < kProducerLimit)
+    {
+        ssize_t n = ::write(fd, chunk.data(), chunk.size());
+        if(n <= 0)
+        {
+            break;
+        }
+        sent += n;
+    }
+}
+
+static void consumer(double bytesPerSecond)
+{
+    ::usleep(50 * 1000);    // after the producer
+    int fd = dial();
+    g_consumerFd = fd;
+    std::vector<char> chunk(64 * 1024);
+    Timestamp start = Timestamp::now();
+    while(!g_stop)
+    {
+        ssize_t n = ::read(fd, chunk.data(), chunk.size());
+        if(n <= 0)
+        {
+            break;
+        }
+        g_consumed += n;
+        // keep to the rate
+        double ahead = g_consumed / bytesPerSecond
+                     - (Timestamp::now().microSecondsSinceEpoch() - start.microSecondsSinceEpoch()) / 1e6;
+        if(ahead > 0)
+        {
+            ::usleep(static_cast<useconds_t>(ahead * 1e6));
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc < 2)
+    {
+        printf("usage: %s on|off [seconds] [consumer MB/s]\n", argv[0]);
+        return 1;
+    }
+    bool flowControl = strcmp(argv[1], "on") == 0;
+    double seconds = argc > 2 ? atof(argv[2]) : 3.0;
+    double rate = (argc > 3 ? atof(argv[3]) : 32.0) * 1024 * 1024;
+
+    EventLoop loop;
+    InetAddress addr(kPort, "127.0.0.1");
+    TcpServer server(&loop, addr, "ProxyBench");
+    server.setConnectionCallback([flowControl](const TcpConnectionPtr &conn)
+    {
+        if(!conn->connected())
+        {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(g_mutex);
+        if(!g_producer)
+        {
+            g_producer = conn;
+            return;
+        }
+        g_consumer = conn;
+        // in the consumer's loop, the producer may be on another one
+        if(flowControl)
+        {
+            conn->setFlowControl(g_producer, kHighWaterMark, kLowWaterMark);
+        }
+        TcpConnectionPtr consumerConn(conn);
+        conn->getLoop()->runEvery(0.005, [consumerConn]()
+        {
+            size_t queued = consumerConn->outputBytes();
+            if(queued > g_peakQueued)
+            {
+                g_peakQueued = queued;
+            }
+        });
+        g_paired = true;
+    });
+    server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+    {
+        TcpConnectionPtr consumerConn;
+        {
+            std::lock_guard<std::mutex> lock(g_mutex);
+            consumerConn = g_consumer;
+        }
+        if(conn != consumerConn && consumerConn)
+        {
+            consumerConn->send(buf);
+        }
+        buf->retrieveAll();
+    });
+    server.setThreadNum(2);
+    server.start();
+
+    std::thread producerThread(producer);
+    std::thread consumerThread(consumer, rate);
+    loop.runAfter(seconds, [&]()
+    {
+        g_stop = true;
+        loop.quit();
+    });
+    loop.loop();
+    // wake the clients blocked in read/write
+    ::shutdown(g_producerFd, SHUT_RDWR);
+    ::shutdown(g_consumerFd, SHUT_RDWR);
+    producerThread.join();
+    consumerThread.join();
+
+    struct rusage usage;
+    ::getrusage(RUSAGE_SELF, &usage);
+    printf("flow control %s: consumed %.1f MB/s, peak queued %.1f MB, max rss %.1f MB\n",
+            argv[1], g_consumed / seconds / (1024 * 1024),
+            g_peakQueued / (1024.0 * 1024), usage.ru_maxrss / 1024.0);
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        g_producer.reset();
+        g_consumer.reset();
+    }
+    return 0;
+}
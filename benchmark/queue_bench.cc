@@ -0,0 +1,66 @@
+#include <mymuduo/EventLoop.h>
+#include <mymuduo/EventLoopThread.h>
+#include <mymuduo/Timestamp.h>
+
+#include <atomic>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+// cross-thread queueInLoop throughput with 1..N producer threads
+// usage: queue_bench [maxProducers] [postsPerProducer]
+
+int main(int argc, char *argv[])
+{
+    int maxProducers = argc > 1 ? atoi(argv[1]) : 8;
+    int postsPerProducer = argc > 2 ? atoi(argv[2]) : 200000;
+
+    EventLoopThread loopThread;
+    EventLoop *loop = loopThread.startLoop();
+
+    printf("%10s %14s %18s\n", "producers", "posts/s", "eventfd writes/post");
+    for(int producers = 1; producers <= maxProducers; producers *= 2)
+    {
+        const int64_t total = static_cast<int64_t>(producers) * postsPerProducer;
+        int64_t done = 0;   // only touched in the loop thread
+        std::atomic<bool> finished(false);
+        int64_t wakeupsBefore = loop->wakeupCount();
+
+        Timestamp start = Timestamp::now();
+        std::vector<std::thread> threads;
+        for(int i = 0; i < producers; ++i)
+        {
+            threads.emplace_back([&]()
+            {
+                for(int j = 0; j < postsPerProducer; ++j)
+                {
+                    loop->queueInLoop([&]()
+                    {
+                        if(++done == total)
+                        {
+                            finished = true;
+                        }
+                    });
+                }
+            });
+        }
+        for(auto &t : threads)
+        {
+            t.join();
+        }
+        while(!finished)
+        {
+            usleep(100);
+        }
+        Timestamp end = Timestamp::now();
+
+        double seconds = static_cast<double>(end.microSecondsSinceEpoch()
+                        - start.microSecondsSinceEpoch()) / Timestamp::kMicroSecondsPerSecond;
+        int64_t wakeups = loop->wakeupCount() - wakeupsBefore;
+        printf("%10d %14.0f %18.4f\n", producers, total / seconds,
+                static_cast<double>(wakeups) / total);
+    }
+    return 0;
+}
@@ -0,0 +1,123 @@
+#include <mymuduo/LatencyHistogram.h>
+#include <mymuduo/Logger.h>
+#include <mymuduo/TcpServer.h>
+#include <mymuduo/Timestamp.h>
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// ping-pong echo with the kernel receive timestamps on or off: the cost of
+// the recvmsg and the clock read, and with on, the wire-to-handler delay
+// the loops saw; INFO logs are off
+// usage: rxts_bench on|off [clients] [seconds] [serverThreads]
+
+static const uint16_t kPort = 10002;
+
+static std::atomic<bool> g_stop(false);
+static std::atomic<int64_t> g_messages(0);
+
+static void runClient()
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    ::connect(fd, (struct sockaddr*)&addr, sizeof(addr));
+    int one = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    // the server stops echoing when its loop quits, don't wait for it
+    struct timeval timeout = {1, 0};
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+
+    char message[128];
+    memset(message, 'x', sizeof message);
+    while(!g_stop)
+    {
+        if(::write(fd, message, sizeof message) != sizeof message)
+        {
+            break;
+        }
+        size_t got = 0;
+        char reply[128];
+        while(got < sizeof reply)
+        {
+            ssize_t n = ::read(fd, reply + got, sizeof reply - got);
+            if(n <= 0)
+            {
+                ::close(fd);
+                return;
+            }
+            got += n;
+        }
+        ++g_messages;
+    }
+    ::close(fd);
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc < 2)
+    {
+        fprintf(stderr, "usage: %s on|off [clients] [seconds] [serverThreads]\n", argv[0]);
+        return 1;
+    }
+    bool on = strcmp(argv[1], "on") == 0;
+    int clients = argc > 2 ? atoi(argv[2]) : 4;
+    int seconds = argc > 3 ? atoi(argv[3]) : 5;
+    int threads = argc > 4 ? atoi(argv[4]) : 0;
+
+    Logger::setLogLevel(ERROR);
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(kPort, "127.0.0.1"), "RxtsBench");
+    server.setRxTimestamps(on);
+    server.setThreadNum(threads);
+    server.setConnectionCallback([](const TcpConnectionPtr&) {});
+    server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+    {
+        conn->send(buf->retrieveAllAsString());
+    });
+    server.start();
+
+    std::vector<std::thread> workers;
+    for(int i = 0; i < clients; ++i)
+    {
+        workers.emplace_back(runClient);
+    }
+    loop.runAfter(seconds, [&loop]() { g_stop = true; loop.quit(); });
+    loop.loop();
+    for(auto& t : workers)
+    {
+        t.join();
+    }
+
+    printf("rx timestamps %s, %d clients, %d threads: %.0f round trips/s\n",
+           argv[1], clients, threads, static_cast<double>(g_messages) / seconds);
+    LatencyHistogram latency;
+    server.rxLatency(&latency);
+    if(on)
+    {
+        printf("wire to handler: %s\n", latency.toString().c_str());
+        for(int i = 0; i < LatencyHistogram::kBuckets; ++i)
+        {
+            if(latency.bucket(i) > 0)
+            {
+                printf("  <= %6lld us: %lld\n", static_cast<long long>(LatencyHistogram::bucketLimit(i)),
+                       static_cast<long long>(latency.bucket(i)));
+            }
+        }
+    }
+    return 0;
+}
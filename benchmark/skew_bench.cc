@@ -0,0 +1,173 @@
+#include <mymuduo/TcpServer.h>
+#include <mymuduo/Timestamp.h>
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <mutex>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// tail latency of short requests when a few connections are heavy
+// usage: skew_bench rr|conns|lag|hash [threads] [heavy] [light] [seconds]
+//   heavy connections are opened first and stay, every request of
+//   them burns 2 ms of the loop; light clients connect, send one
+//   request, wait for the reply and close, their latency is reported
+//   every client has its own source address 127.0.0.x for hash
+
+static std::atomic<bool> g_stop(false);
+static const uint16_t kPort = 9989;
+static const int64_t kHeavyMicroSeconds = 2000;
+
+static int connectFrom(int client)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(0x7f000000 | (10 + client));
+    ::bind(fd, (struct sockaddr*)&local, sizeof(local));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    struct linger reset = { 1, 0 };
+    ::setsockopt(fd, SOL_SOCKET, SO_LINGER, &reset, sizeof reset);
+    if(::connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void heavyClient(int client)
+{
+    int fd = connectFrom(client);
+    char c = 'H';
+    while(fd >= 0 && !g_stop && ::write(fd, &c, 1) == 1 && ::read(fd, &c, 1) == 1)
+    {
+        c = 'H';
+    }
+    ::close(fd);
+}
+
+static std::mutex g_mutex;
+static std::vector<int64_t> g_latencies;
+
+static void lightClient(int client)
+{
+    std::vector<int64_t> latencies;
+    while(!g_stop)
+    {
+        Timestamp start = Timestamp::now();
+        int fd = connectFrom(client);
+        if(fd < 0)
+        {
+            continue;
+        }
+        char c = 'L';
+        if(::write(fd, &c, 1) == 1 && ::read(fd, &c, 1) == 1)
+        {
+            latencies.push_back(Timestamp::now().microSecondsSinceEpoch()
+                                - start.microSecondsSinceEpoch());
+        }
+        ::close(fd);
+    }
+    std::lock_guard<std::mutex> lock(g_mutex);
+    g_latencies.insert(g_latencies.end(), latencies.begin(), latencies.end());
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc < 2)
+    {
+        printf("usage: %s rr|conns|lag|hash [threads] [heavy] [light] [seconds]\n", argv[0]);
+        return 1;
+    }
+    EventLoopThreadPool::Strategy strategy = EventLoopThreadPool::kRoundRobin;
+    if(strcmp(argv[1], "conns") == 0)
+    {
+        strategy = EventLoopThreadPool::kLeastConnections;
+    }
+    else if(strcmp(argv[1], "lag") == 0)
+    {
+        strategy = EventLoopThreadPool::kLeastLag;
+    }
+    else if(strcmp(argv[1], "hash") == 0)
+    {
+        strategy = EventLoopThreadPool::kConsistentHash;
+    }
+    int threads = argc > 2 ? atoi(argv[2]) : 4;
+    int heavy = argc > 3 ? atoi(argv[3]) : 2;
+    int light = argc > 4 ? atoi(argv[4]) : 4;
+    double seconds = argc > 5 ? atof(argv[5]) : 5.0;
+
+    EventLoop loop;
+    InetAddress addr(kPort, "127.0.0.1");
+    TcpServer server(&loop, addr, "SkewBench");
+    server.setConnectionCallback([](const TcpConnectionPtr&){});
+    server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+    {
+        while(buf->readableBytes() > 0)
+        {
+            char c = *buf->peek(1);
+            buf->retrieve(1);
+            if(c == 'H')
+            {
+                Timestamp start = Timestamp::now();
+                while(Timestamp::now().microSecondsSinceEpoch()
+                      - start.microSecondsSinceEpoch() < kHeavyMicroSeconds)
+                {
+                }
+            }
+            conn->send(&c, 1);
+        }
+    });
+    server.setThreadNum(threads);
+    server.setLoopStrategy(strategy);
+    server.start();
+
+    std::vector<std::thread> clients;
+    for(int i = 0; i < heavy; ++i)
+    {
+        loop.runAfter(0.1 + 0.05 * i, [&clients, i]() { clients.emplace_back(heavyClient, i); });
+    }
+    loop.runAfter(0.2 + 0.05 * heavy, [&]()
+    {
+        for(int i = 0; i < light; ++i)
+        {
+            clients.emplace_back(lightClient, heavy + i);
+        }
+    });
+    loop.runAfter(0.2 + 0.05 * heavy + seconds, [&]()
+    {
+        g_stop = true;
+        loop.quit();
+    });
+    loop.loop();
+    for(auto &t : clients)
+    {
+        t.join();
+    }
+
+    std::sort(g_latencies.begin(), g_latencies.end());
+    size_t n = g_latencies.size();
+    if(n == 0)
+    {
+        printf("%s: no request finished\n", argv[1]);
+        return 1;
+    }
+    printf("%s threads=%d heavy=%d light=%d: %zu requests, p50 %ld us, p99 %ld us, max %ld us\n",
+            argv[1], threads, heavy, light, n, g_latencies[n / 2],
+            g_latencies[n * 99 / 100], g_latencies[n - 1]);
+    return 0;
+}
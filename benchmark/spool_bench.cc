@@ -0,0 +1,122 @@
+#include <mymuduo/TcpServer.h>
+#include <mymuduo/Timestamp.h>
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// slow readers downloading a big response each, the server queues the
+// whole response at once; off keeps it in the output buffers, on spools
+// everything past 1 MB per connection to a temp file
+// usage: spool_bench on|off [clients] [MB each] [reader MB/s]
+
+static const uint16_t kPort = 9997;
+
+static std::atomic<int> g_done(0);
+static std::atomic<int64_t> g_received(0);
+
+static void reader(int64_t total, double bytesPerSecond)
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    int rcvbuf = 64 * 1024;
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof rcvbuf);
+    ::connect(fd, (struct sockaddr*)&addr, sizeof(addr));
+
+    std::vector<char> buf(64 * 1024);
+    int64_t got = 0;
+    Timestamp start = Timestamp::now();
+    while(got < total)
+    {
+        ssize_t n = ::read(fd, buf.data(), buf.size());
+        if(n <= 0)
+        {
+            break;
+        }
+        got += n;
+        g_received += n;
+        double ahead = got / bytesPerSecond
+                     - (Timestamp::now().microSecondsSinceEpoch() - start.microSecondsSinceEpoch()) / 1e6;
+        if(ahead > 0)
+        {
+            ::usleep(static_cast<useconds_t>(ahead * 1e6));
+        }
+    }
+    ::close(fd);
+    ++g_done;
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc < 2)
+    {
+        printf("usage: %s on|off [clients] [MB each] [reader MB/s]\n", argv[0]);
+        return 1;
+    }
+    bool spool = strcmp(argv[1], "on") == 0;
+    int clients = argc > 2 ? atoi(argv[2]) : 16;
+    int64_t total = (argc > 3 ? atoll(argv[3]) : 32) * 1024 * 1024;
+    double rate = (argc > 4 ? atof(argv[4]) : 16.0) * 1024 * 1024;
+
+    EventLoop loop;
+    InetAddress addr(kPort, "127.0.0.1");
+    TcpServer server(&loop, addr, "SpoolBench");
+    server.setSpooling(spool);
+    const std::string chunk(256 * 1024, 'x');
+    server.setConnectionCallback([&chunk, total](const TcpConnectionPtr &conn)
+    {
+        if(conn->connected())
+        {
+            for(int64_t queued = 0; queued < total; queued += chunk.size())
+            {
+                conn->send(chunk);
+            }
+        }
+    });
+    server.setMessageCallback([](const TcpConnectionPtr&, Buffer *buf, Timestamp)
+    {
+        buf->retrieveAll();
+    });
+    server.setThreadNum(2);
+    server.start();
+
+    std::vector<std::thread> readers;
+    for(int i = 0; i < clients; ++i)
+    {
+        readers.emplace_back(reader, total, rate);
+    }
+    Timestamp start = Timestamp::now();
+    loop.runEvery(0.01, [&]()
+    {
+        if(g_done == clients)
+        {
+            loop.quit();
+        }
+    });
+    loop.loop();
+    double seconds = (Timestamp::now().microSecondsSinceEpoch() - start.microSecondsSinceEpoch()) / 1e6;
+    for(auto &t : readers)
+    {
+        t.join();
+    }
+
+    struct rusage usage;
+    ::getrusage(RUSAGE_SELF, &usage);
+    printf("spool %s clients=%d: %.1f MB in %.2fs, %.1f MB/s, max rss %.1f MB\n",
+            argv[1], clients, g_received / (1024.0 * 1024), seconds,
+            g_received / seconds / (1024 * 1024), usage.ru_maxrss / 1024.0);
+    return 0;
+}
@@ -0,0 +1,128 @@
+#include <mymuduo/TcpServer.h>
+#include <mymuduo/Timestamp.h>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+// connection storm against the accept loop
+// usage: storm_bench [max accepts per wakeup] [connections] [fd limit] [defer]
+//   a child process opens the connections and sends one byte on each,
+//   the server starts accepting a second later and keeps them all
+//   fd limit: RLIMIT_NOFILE of the server, below connections it runs
+//   into EMFILE and has to shed the rest
+//   defer: TCP_DEFER_ACCEPT
+// reports the accept rate and the cpu the main loop burnt meanwhile
+
+static const uint16_t kPort = 9991;
+
+static void storm(int connections)
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    std::vector<int> fds;
+    for(int i = 0; i < connections; ++i)
+    {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if(fd < 0 || ::connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+        {
+            ::close(fd);
+            continue;
+        }
+        char c = 'x';
+        if(::write(fd, &c, 1) != 1)
+        {
+            ::close(fd);
+            continue;
+        }
+        fds.push_back(fd);
+    }
+    ::pause(); // hold them until the server is done
+}
+
+static double threadCpuSeconds()
+{
+    struct rusage usage;
+    ::getrusage(RUSAGE_THREAD, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+         + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+int main(int argc, char *argv[])
+{
+    int maxAccepts = argc > 1 ? atoi(argv[1]) : Acceptor::kDefaultMaxAccepts;
+    int connections = argc > 2 ? atoi(argv[2]) : 3000;
+    int fdLimit = argc > 3 ? atoi(argv[3]) : 0;
+    bool defer = argc > 4 && strcmp(argv[4], "defer") == 0;
+
+    EventLoop loop;
+    InetAddress addr(kPort, "127.0.0.1");
+    TcpServer server(&loop, addr, "StormBench");
+    std::vector<TcpConnectionPtr> kept;
+    Timestamp first;
+    Timestamp last;
+    server.setConnectionCallback([&](const TcpConnectionPtr &conn)
+    {
+        if(conn->connected())
+        {
+            if(kept.empty())
+            {
+                first = Timestamp::now();
+            }
+            last = Timestamp::now();
+            kept.push_back(conn);
+        }
+    });
+    server.setMessageCallback([](const TcpConnectionPtr&, Buffer *buf, Timestamp)
+    {
+        buf->retrieveAll();
+    });
+    server.setMaxAcceptsPerWakeup(maxAccepts);
+    server.setDeferAccept(defer ? 5 : 0);
+    server.start();
+
+    pid_t child = ::fork();
+    if(child == 0)
+    {
+        storm(connections);
+        return 0;
+    }
+    if(fdLimit > 0)
+    {
+        struct rlimit rl = { static_cast<rlim_t>(fdLimit), static_cast<rlim_t>(fdLimit) };
+        ::setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    // let the storm fill the backlog before the loop starts draining it
+    ::sleep(1);
+    double seconds = 3.0;
+    double cpuStart = threadCpuSeconds();
+    double cpu = 0;
+    loop.runAfter(seconds, [&]()
+    {
+        cpu = threadCpuSeconds() - cpuStart;
+        loop.quit();
+    });
+    loop.loop();
+    ::kill(child, SIGKILL);
+    ::waitpid(child, nullptr, 0);
+
+    double span = kept.size() > 1 ? (last.microSecondsSinceEpoch() - first.microSecondsSinceEpoch()) / 1e6 : 0;
+    printf("max accepts=%d connections=%d fd limit=%d%s: accepted %zu, %.0f accepts/s, main loop cpu %.2f s of %.1f s\n",
+            maxAccepts, connections, fdLimit, defer ? " defer" : "", kept.size(),
+            span > 0 ? kept.size() / span : 0.0, cpu, seconds);
+    return 0;
+}
@@ -0,0 +1,181 @@
+#include <mymuduo/TcpServer.h>
+#include <mymuduo/Timestamp.h>
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// write syscalls per response of pipelined requests
+// usage: syscall_bench two|iov [batched] [depth] [clients] [seconds]
+//   two:     a reply is send(header) + send(body)
+//   iov:     a reply is one send(iovec[2])
+//   batched: TcpServer::setBatchedFlush, one flush per loop iteration
+// every client writes depth requests at once and waits for the replies
+
+// the library's write calls resolve to these, counted per thread
+static thread_local int64_t t_writes = 0;
+
+extern "C" ssize_t write(int fd, const void *buf, size_t count)
+{
+    ++t_writes;
+    return syscall(SYS_write, fd, buf, count);
+}
+
+extern "C" ssize_t writev(int fd, const struct iovec *iov, int iovcnt)
+{
+    ++t_writes;
+    return syscall(SYS_writev, fd, iov, iovcnt);
+}
+
+extern "C" ssize_t send(int fd, const void *buf, size_t len, int flags)
+{
+    ++t_writes;
+    return syscall(SYS_sendto, fd, buf, len, flags, nullptr, 0);
+}
+
+extern "C" ssize_t sendmsg(int fd, const struct msghdr *msg, int flags)
+{
+    ++t_writes;
+    return syscall(SYS_sendmsg, fd, msg, flags);
+}
+
+static std::atomic<bool> g_stop(false);
+static const uint16_t kPort = 9987;
+static const char kRequest[] = "GET / HTTP/1.1\n";
+static const char kHeader[] = "HTTP/1.1 200 OK\r\nContent-Length: 64\r\n\r\n";
+static const std::string kBody(64, 'b');
+
+static void client(int depth)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    if(::connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+    {
+        ::close(fd);
+        return;
+    }
+    std::string requests;
+    for(int i = 0; i < depth; ++i)
+    {
+        requests += kRequest;
+    }
+    size_t replyBytes = depth * (sizeof(kHeader) - 1 + kBody.size());
+    std::vector<char> buf(replyBytes);
+    while(!g_stop)
+    {
+        if(syscall(SYS_write, fd, requests.data(), requests.size()) != (ssize_t)requests.size())
+        {
+            break;
+        }
+        size_t got = 0;
+        ssize_t n;
+        while(got < replyBytes && (n = ::read(fd, buf.data() + got, replyBytes - got)) > 0)
+        {
+            got += n;
+        }
+        if(got < replyBytes)
+        {
+            break;
+        }
+    }
+    ::close(fd);
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc < 2)
+    {
+        printf("usage: %s two|iov [batched] [depth] [clients] [seconds]\n", argv[0]);
+        return 1;
+    }
+    bool useIov = strcmp(argv[1], "iov") == 0;
+    int arg = 2;
+    bool batched = argc > arg && strcmp(argv[arg], "batched") == 0;
+    if(batched)
+    {
+        ++arg;
+    }
+    int depth = argc > arg ? atoi(argv[arg]) : 16;
+    int clients = argc > arg + 1 ? atoi(argv[arg + 1]) : 4;
+    double seconds = argc > arg + 2 ? atof(argv[arg + 2]) : 5.0;
+
+    EventLoop loop;
+    InetAddress addr(kPort, "127.0.0.1");
+    TcpServer server(&loop, addr, "SyscallBench");
+    int64_t responses = 0;
+    server.setConnectionCallback([](const TcpConnectionPtr &conn)
+    {
+        if(conn->connected())
+        {
+            conn->setTcpNoDelay(true);  // measure the writes, not Nagle
+        }
+    });
+    server.setMessageCallback([&](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+    {
+        while(buf->readableBytes() >= sizeof(kRequest) - 1)
+        {
+            buf->retrieve(sizeof(kRequest) - 1);
+            if(useIov)
+            {
+                struct iovec iov[2];
+                iov[0].iov_base = const_cast<char*>(kHeader);
+                iov[0].iov_len = sizeof(kHeader) - 1;
+                iov[1].iov_base = const_cast<char*>(kBody.data());
+                iov[1].iov_len = kBody.size();
+                conn->send(iov, 2);
+            }
+            else
+            {
+                conn->send(kHeader, sizeof(kHeader) - 1);
+                conn->send(kBody);
+            }
+            ++responses;
+        }
+    });
+    server.setBatchedFlush(batched);
+    server.start();
+
+    std::vector<std::thread> threads;
+    int64_t writesStart = 0;
+    loop.runAfter(0.1, [&]()
+    {
+        writesStart = t_writes;
+        for(int i = 0; i < clients; ++i)
+        {
+            threads.emplace_back(client, depth);
+        }
+    });
+    int64_t writes = 0;
+    int64_t served = 0;
+    loop.runAfter(0.1 + seconds, [&]()
+    {
+        writes = t_writes - writesStart;
+        served = responses;
+        g_stop = true;
+        loop.quit();
+    });
+    loop.loop();
+    for(auto &t : threads)
+    {
+        t.detach(); // clients may block in read
+    }
+
+    printf("%s%s depth=%d clients=%d: %.0f responses/s, %.3f write syscalls/response\n",
+            useIov ? "iov" : "two", batched ? " batched" : "", depth, clients,
+            served / seconds, served > 0 ? double(writes) / served : 0.0);
+    return 0;
+}
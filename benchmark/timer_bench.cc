@@ -0,0 +1,63 @@
+#include <mymuduo/EventLoop.h>
+#include <mymuduo/Timestamp.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+// insert/cancel/expire throughput of the TimerQueue of one loop
+// usage: timer_bench [numTimers]
+
+static double nsPerOp(Timestamp start, Timestamp end, int ops)
+{
+    return (end.microSecondsSinceEpoch() - start.microSecondsSinceEpoch()) * 1000.0 / ops;
+}
+
+int main(int argc, char *argv[])
+{
+    int numTimers = argc > 1 ? atoi(argv[1]) : 200000;
+
+    EventLoop loop;
+    std::vector<TimerId> ids;
+    ids.reserve(numTimers);
+
+    // long lived timers, spread over one second like timeouts
+    srand(1);
+    Timestamp start = Timestamp::now();
+    for(int i = 0; i < numTimers; ++i)
+    {
+        double delay = 60.0 + (rand() % 1000000) / 1000000.0;
+        ids.push_back(loop.runAfter(delay, [](){}));
+    }
+    Timestamp end = Timestamp::now();
+    printf("insert  %d timers: %8.1f ns/op\n", numTimers, nsPerOp(start, end, numTimers));
+
+    // cancel every other one, what a heartbeat reset does
+    start = Timestamp::now();
+    for(int i = 0; i < numTimers; i += 2)
+    {
+        loop.cancel(ids[i]);
+    }
+    end = Timestamp::now();
+    printf("cancel  %d timers: %8.1f ns/op\n", numTimers / 2, nsPerOp(start, end, numTimers / 2));
+
+    // timers due right now, all of them fire in the next loop iteration
+    int fired = 0;
+    Timestamp due = Timestamp::now();
+    for(int i = 0; i < numTimers; ++i)
+    {
+        loop.runAt(due, [&]()
+        {
+            if(++fired == numTimers)
+            {
+                loop.quit();
+            }
+        });
+    }
+    start = Timestamp::now();
+    loop.loop();
+    end = Timestamp::now();
+    printf("expire  %d timers: %8.1f ns/op\n", numTimers, nsPerOp(start, end, numTimers));
+
+    return 0;
+}
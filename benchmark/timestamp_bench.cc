@@ -0,0 +1,66 @@
+#include <mymuduo/Timestamp.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <time.h>
+
+// nanoseconds per Timestamp::now(), monotonic() and the formatting of the
+// time of a log line, against gettimeofday() and localtime()+snprintf
+// usage: timestamp_bench [calls]
+
+static volatile int64_t g_sink;
+
+template<typename F>
+static void measure(const char *name, int calls, F f)
+{
+    Timestamp start = Timestamp::monotonic();
+    for(int i = 0; i < calls; ++i)
+    {
+        f(i);
+    }
+    double nanos = timeDifference(Timestamp::monotonic(), start) * 1e9 / calls;
+    printf("%-28s %8.1f ns/call\n", name, nanos);
+}
+
+int main(int argc, char *argv[])
+{
+    int calls = argc > 1 ? atoi(argv[1]) : 5000000;
+
+    measure("gettimeofday", calls, [](int)
+    {
+        struct timeval tv;
+        gettimeofday(&tv, nullptr);
+        g_sink = tv.tv_usec;
+    });
+    measure("Timestamp::now", calls, [](int)
+    {
+        g_sink = Timestamp::now().microSecondsSinceEpoch();
+    });
+    measure("Timestamp::monotonic", calls, [](int)
+    {
+        g_sink = Timestamp::monotonic().microSecondsSinceEpoch();
+    });
+
+    // a line per microsecond, as a busy logger sees the clock
+    const int64_t base = Timestamp::now().microSecondsSinceEpoch();
+    measure("localtime+snprintf", calls / 10, [base](int i)
+    {
+        time_t seconds = static_cast<time_t>((base + i) / Timestamp::kMicroSecondsPerSecond);
+        struct tm *tm_time = localtime(&seconds);
+        char buf[32];
+        g_sink = snprintf(buf, sizeof buf, "%4d/%02d/%02d %02d:%02d:%02d",
+                          tm_time->tm_year + 1900, tm_time->tm_mon + 1, tm_time->tm_mday,
+                          tm_time->tm_hour, tm_time->tm_min, tm_time->tm_sec);
+    });
+    measure("Timestamp::toString", calls, [base](int i)
+    {
+        g_sink = Timestamp(base + i).toString().size();
+    });
+    measure("Timestamp::format", calls, [base](int i)
+    {
+        char buf[32];
+        g_sink = Timestamp(base + i).format(buf, sizeof buf);
+    });
+    return 0;
+}
@@ -0,0 +1,132 @@
+#include <mymuduo/TcpServer.h>
+#include <mymuduo/Timestamp.h>
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// large replies: copying write() vs MSG_ZEROCOPY
+// usage: zerocopy_bench copy|zerocopy [payload KB] [clients] [seconds]
+//   the server streams one shared payload to every client, sending it
+//   again on write complete, the clients read and discard
+// over loopback the kernel has to copy the pinned pages when the
+// receiver gets them, so the saving only shows on a real NIC
+
+static std::atomic<bool> g_stop(false);
+static std::atomic<int64_t> g_bytes(0);
+static const uint16_t kPort = 9985;
+
+static int connectServer()
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    if(::connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void client()
+{
+    int fd = connectServer();
+    std::vector<char> buf(256 * 1024);
+    ssize_t n;
+    while(fd >= 0 && !g_stop && (n = ::read(fd, buf.data(), buf.size())) > 0)
+    {
+        g_bytes += n;
+    }
+    ::close(fd);
+}
+
+static double threadCpuSeconds()
+{
+    struct rusage usage;
+    ::getrusage(RUSAGE_THREAD, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+         + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc < 2)
+    {
+        printf("usage: %s copy|zerocopy [payload KB] [clients] [seconds]\n", argv[0]);
+        return 1;
+    }
+    ::signal(SIGPIPE, SIG_IGN);
+    bool zeroCopy = strcmp(argv[1], "zerocopy") == 0;
+    size_t payloadSize = (argc > 2 ? atoi(argv[2]) : 1024) * 1024;
+    int clients = argc > 3 ? atoi(argv[3]) : 4;
+    double seconds = argc > 4 ? atof(argv[4]) : 5.0;
+
+    PayloadPtr payload = std::make_shared<const std::string>(payloadSize, 'z');
+
+    EventLoop loop;
+    InetAddress addr(kPort, "127.0.0.1");
+    TcpServer server(&loop, addr, "ZeroCopyBench");
+    server.setConnectionCallback([&](const TcpConnectionPtr &conn)
+    {
+        if(conn->connected())
+        {
+            conn->send(payload);
+        }
+    });
+    server.setWriteCompleteCallback([&](const TcpConnectionPtr &conn)
+    {
+        if(!g_stop)
+        {
+            conn->send(payload);
+        }
+    });
+    server.setMessageCallback([](const TcpConnectionPtr&, Buffer *buf, Timestamp)
+    {
+        buf->retrieveAll();
+    });
+    server.setZeroCopy(zeroCopy);
+    server.start();
+
+    std::vector<std::thread> threads;
+    double cpuStart = 0;
+    loop.runAfter(0.1, [&]()
+    {
+        cpuStart = threadCpuSeconds();
+        for(int i = 0; i < clients; ++i)
+        {
+            threads.emplace_back(client);
+        }
+    });
+    double cpu = 0;
+    loop.runAfter(0.1 + seconds, [&]()
+    {
+        cpu = threadCpuSeconds() - cpuStart;
+        g_stop = true;
+        loop.quit();
+    });
+    loop.loop();
+    for(auto &t : threads)
+    {
+        t.detach(); // clients may block in read
+    }
+
+    double gb = g_bytes / 1024.0 / 1024 / 1024;
+    printf("%s payload=%zuKB clients=%d: %.2f GB/s, server cpu %.3f s/GB, payload refs %ld\n",
+            zeroCopy ? "zerocopy" : "copy", payloadSize / 1024, clients,
+            gb / seconds, gb > 0 ? cpu / gb : 0.0, payload.use_count());
+    return 0;
+}
@@ -1,6 +1,8 @@
 #include "Poller.h"
 #include "Channel.h"
 
+#include <errno.h>
+
 Poller::Poller(EventLoop *loop)
     : ownerLoop_(loop)
 {
@@ -14,3 +16,25 @@ bool Poller::hasChannel(Channel *channel) const
     ChannelMap::const_iterator it = channels_.find(channel->fd());
     return it != channels_.end() && it->second == channel;
 }
+
+ssize_t Poller::takeReceived(Channel*, Buffer*, size_t, int* saveErrno)
+{
+    *saveErrno = EOPNOTSUPP;
+    return -1;
+}
+
+void Poller::submitSend(Channel*, Buffer*)
+{
+}
+
+ssize_t Poller::takeSent(Channel*, int* saveErrno)
+{
+    *saveErrno = EOPNOTSUPP;
+    return -1;
+}
+
+int Poller::takeAccepted(Channel*, int* saveErrno)
+{
+    *saveErrno = EOPNOTSUPP;
+    return -1;
+}
@@ -0,0 +1,36 @@
+#include <mymuduo/BinaryLogging.h>
+
+#include <stdio.h>
+
+// turns the .blog files of a BinaryLogging into the text lines Logger writes
+// usage: logdecoder file.blog [more.blog ...] > text.log
+// the lines of a file come out in time order as long as no thread's batch
+// reached the file more than a second late; files are not merged
+
+int main(int argc, char *argv[])
+{
+    if(argc < 2)
+    {
+        fprintf(stderr, "usage: %s file.blog [more.blog ...]\n"
+                        "lines are put in time order within each file\n", argv[0]);
+        return 1;
+    }
+    int status = 0;
+    for(int i = 1; i < argc; ++i)
+    {
+        FILE *in = fopen(argv[i], "rb");
+        if(in == nullptr)
+        {
+            perror(argv[i]);
+            status = 1;
+            continue;
+        }
+        if(!BinaryLogging::decode(in, stdout))
+        {
+            fprintf(stderr, "%s: not a binary log, or cut short\n", argv[i]);
+            status = 1;
+        }
+        fclose(in);
+    }
+    return status;
+}